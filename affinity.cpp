@@ -0,0 +1,94 @@
+#include <sched.h>
+#include <stdlib.h>
+
+#include "affinity.h"
+
+bool parse_cpu_list(const string& list, vector<int>* cpus) {
+	cpus->clear();
+	size_t pos = 0;
+	while (pos <= list.size()) {
+		size_t comma = list.find(',', pos);
+		if (comma == string::npos) {
+			comma = list.size();
+		}
+		string part = list.substr(pos, comma - pos);
+		const char* begin = part.c_str();
+		char* end;
+		long first = strtol(begin, &end, 10);
+		if (end == begin || first < 0) {
+			return false;
+		}
+		long last = first;
+		if (*end == '-') {
+			begin = end + 1;
+			last = strtol(begin, &end, 10);
+			if (end == begin || last < first) {
+				return false;
+			}
+		}
+		if (*end != '\0') {
+			return false;
+		}
+		for (long cpu = first; cpu <= last; cpu++) {
+			cpus->push_back(cpu);
+		}
+		pos = comma + 1;
+	}
+	return !cpus->empty();
+}
+
+#ifdef __linux__
+
+// CPUs the process could run on before any thread was placed
+static const vector<int>& process_cpus() {
+	static const vector<int> cpus = [] {
+		vector<int> allowed;
+		cpu_set_t set;
+		CPU_ZERO(&set);
+		sched_getaffinity(0, sizeof(set), &set);
+		for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+			if (CPU_ISSET(cpu, &set)) {
+				allowed.push_back(cpu);
+			}
+		}
+		return allowed;
+	}();
+	return cpus;
+}
+
+// CPUs the calling thread was last placed on (empty while it has not been placed)
+static thread_local vector<int> placed;
+
+bool place_thread(const vector<int>& cpus, bool pin, int thread_num) {
+	const vector<int>& allowed = process_cpus();
+	vector<int> target = cpus;
+	if (pin) {
+		const vector<int>& from = cpus.empty() ? allowed : cpus;
+		target = vector<int>(1, from[thread_num % from.size()]);
+	}
+	if (target == placed) {
+		return true;
+	}
+
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	for (int cpu: target.empty() ? allowed : target) {
+		if (cpu >= CPU_SETSIZE) {
+			return false;
+		}
+		CPU_SET(cpu, &set);
+	}
+	if (sched_setaffinity(0, sizeof(set), &set) != 0) {
+		return false;
+	}
+	placed = target;
+	return true;
+}
+
+#else
+
+bool place_thread(const vector<int>& cpus, bool pin, int thread_num) {
+	return cpus.empty() && !pin;
+}
+
+#endif
@@ -0,0 +1,20 @@
+#ifndef AFFINITY_H
+#define AFFINITY_H
+
+#include <string>
+#include <vector>
+using namespace std;
+
+// Parses a CPU list such as "0-3,8,10-11" into cpus
+// Returns false if the list is malformed
+bool parse_cpu_list(const string& list, vector<int>* cpus);
+
+// Places the calling thread, which is thread thread_num of its team
+// With pin set, the thread runs on cpus[thread_num % cpus.size()] (or CPU thread_num if cpus is empty)
+// Otherwise it may run on any of cpus (or on any CPU the process started with if cpus is empty)
+// Agents share the OpenMP threads, so every parallel region places its threads again
+// Calls that do not change the thread's placement are cheap
+// Returns false if the placement could not be applied
+bool place_thread(const vector<int>& cpus, bool pin, int thread_num);
+
+#endif
@@ -0,0 +1,249 @@
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include <fstream>
+#include <iomanip>
+using namespace std;
+
+#include "agent_registry.h"
+#include "mcts_serial.h"
+#include "mcts_leaf_parallel.h"
+#include "mcts_root_parallel.h"
+#include "mcts_tgm_parallel.h"
+#include "mcts_tnm_parallel.h"
+
+void AgentRegistry::add(const string& name, const string& label, agent_factory_t factory, int features) {
+	Entry entry;
+	entry.name = name;
+	entry.label = label;
+	entry.factory = factory;
+	entry.features = features;
+	entries.push_back(entry);
+}
+
+const AgentRegistry::Entry* AgentRegistry::find(const string& name) const {
+	for (const Entry& entry: entries) {
+		if (entry.name == name) {
+			return &entry;
+		}
+	}
+	return NULL;
+}
+
+Agent* AgentRegistry::create(const string& name, const MctsConfig& config) const {
+	const Entry* entry = this->find(name);
+	return entry != NULL ? entry->factory(config) : NULL;
+}
+
+bool AgentRegistry::check(const string& name, const MctsConfig& config, string* error) const {
+	const Entry* entry = this->find(name);
+	// Without an iteration cap the clock would still end a deterministic search
+	if (config.deterministic && config.max_iterations <= 0) {
+		*error = "deterministic needs max_iterations";
+		return false;
+	}
+	if (config.rollout_depth > 0 && config.rollout_policy == ROLLOUT_RANDOM) {
+		*error = "rollout_depth needs the bitboard or tactical rollout_policy";
+		return false;
+	}
+	int features = entry != NULL ? entry->features : ~0;
+	if (!(features & AGENT_BATCHES) && config.eval_batch > 1) {
+		*error = "eval_batch above 1 is only supported by the serial, tgm and tnm agents, not " + name;
+		return false;
+	}
+	if (!(features & AGENT_INTERLEAVES) && config.interleave > 1) {
+		*error = "interleave above 1 is only supported by the serial agent, not " + name;
+		return false;
+	}
+	if (!(features & AGENT_RAVE) && config.rave) {
+		*error = "rave is only supported by the serial, tgm and tnm agents, not " + name;
+		return false;
+	}
+	if (!(features & AGENT_PONDERS) && config.ponder) {
+		*error = "ponder is not supported by the " + name + " agent";
+		return false;
+	}
+	if (!(features & AGENT_NODE_LOCK) && (config.node_lock != LOCK_OMP || config.lock_free_reads)) {
+		*error = "node_lock and lock_free_reads only apply to the tnm agents, not " + name;
+		return false;
+	}
+	return true;
+}
+
+string AgentRegistry::label(const string& name) const {
+	const Entry* entry = this->find(name);
+	return entry != NULL ? entry->label : "";
+}
+
+void AgentRegistry::print(ostream& out) const {
+	for (const Entry& entry: entries) {
+		out << "\t- " << entry.name << " (" << entry.label << ")" << endl;
+	}
+}
+
+AgentRegistry builtin_agents() {
+	AgentRegistry registry;
+	registry.add("serial", "Serial MCTS", [](const MctsConfig& config) -> Agent* {
+		return new MctsAgentSerial(config);
+	}, AGENT_BATCHES | AGENT_INTERLEAVES | AGENT_RAVE | AGENT_PONDERS);
+	registry.add("leaf", "Leaf Parallel MCTS", [](const MctsConfig& config) -> Agent* {
+		return new MctsAgentLeafParallel(config);
+	}, AGENT_PONDERS);
+	registry.add("root", "Root Parallel MCTS", [](const MctsConfig& config) -> Agent* {
+		return new MctsAgentRootParallel(config);
+	});
+	registry.add("tgm", "Tree Global Mutex Parallel MCTS", [](const MctsConfig& config) -> Agent* {
+		return new MctsAgentTgmParallel(config);
+	}, AGENT_BATCHES | AGENT_RAVE | AGENT_PONDERS);
+	registry.add("tnm", "Tree Node Mutex Parallel MCTS", [](const MctsConfig& config) -> Agent* {
+		return new MctsAgentTnmParallel(config);
+	}, AGENT_BATCHES | AGENT_RAVE | AGENT_NODE_LOCK | AGENT_PONDERS);
+	registry.add("tnm_seq", "Tree Node Mutex Parallel MCTS with Lock-Free Reads", [](MctsConfig config) -> Agent* {
+		config.lock_free_reads = true;
+		return new MctsAgentTnmParallel(config);
+	}, AGENT_BATCHES | AGENT_RAVE | AGENT_NODE_LOCK | AGENT_PONDERS);
+	return registry;
+}
+
+static bool parse_long(const string& value, long* out) {
+	char* end;
+	*out = strtol(value.c_str(), &end, 0);
+	return !value.empty() && *end == '\0';
+}
+
+static bool parse_int(const string& value, int* out) {
+	long parsed;
+	if (!parse_long(value, &parsed)) {
+		return false;
+	}
+	*out = parsed;
+	return true;
+}
+
+static bool parse_float(const string& value, float* out) {
+	char* end;
+	*out = strtof(value.c_str(), &end);
+	return !value.empty() && *end == '\0';
+}
+
+bool parse_double(const string& value, double* out) {
+	char* end;
+	*out = strtod(value.c_str(), &end);
+	return !value.empty() && *end == '\0';
+}
+
+bool parse_bool(const string& value, bool* out) {
+	const char* v = value.c_str();
+	if (!strcasecmp(v, "true") || !strcasecmp(v, "yes") || !strcasecmp(v, "on") || !strcmp(v, "1")) {
+		*out = true;
+		return true;
+	}
+	if (!strcasecmp(v, "false") || !strcasecmp(v, "no") || !strcasecmp(v, "off") || !strcmp(v, "0")) {
+		*out = false;
+		return true;
+	}
+	return false;
+}
+
+struct ConfigOption {
+	const char* name;
+	const char* description;
+	function<bool(MctsConfig*, const string&)> set;
+};
+
+static const vector<ConfigOption>& config_options() {
+	static const vector<ConfigOption> options = {
+		{"ucb_constant", "exploration constant of UCB", [](MctsConfig* c, const string& v) { return parse_float(v, &c->ucb_constant); }},
+		{"first_play_urgency", "selection score of an unvisited child, inf to try every move before revisiting any", [](MctsConfig* c, const string& v) { return parse_float(v, &c->first_play_urgency); }},
+		{"puct_constant", "exploration constant of PUCT, used with priors", [](MctsConfig* c, const string& v) { return parse_float(v, &c->puct_constant); }},
+		{"rollouts", "rollouts per leaf of the leaf agent", [](MctsConfig* c, const string& v) { return parse_int(v, &c->rollouts) && c->rollouts > 0; }},
+		{"threads", "threads of the parallel agents, 0 for one per CPU in cpus or OMP_NUM_THREADS", [](MctsConfig* c, const string& v) { return parse_int(v, &c->num_threads) && c->num_threads >= 0; }},
+		{"cpus", "CPUs the agent's threads run on, e.g. 0-3,8", [](MctsConfig* c, const string& v) { return parse_cpu_list(v, &c->cpus); }},
+		{"pin_threads", "pin each thread to one CPU", [](MctsConfig* c, const string& v) { return parse_bool(v, &c->pin_threads); }},
+		{"tree_reuse", "keep the tree between moves", [](MctsConfig* c, const string& v) { return parse_bool(v, &c->tree_reuse); }},
+		{"max_nodes", "stop a search once it has added this many nodes, 0 for no limit", [](MctsConfig* c, const string& v) { return parse_long(v, &c->max_nodes) && c->max_nodes >= 0; }},
+		{"max_iterations", "iterations per search, 0 for as many as the time limit allows", [](MctsConfig* c, const string& v) { return parse_long(v, &c->max_iterations) && c->max_iterations >= 0; }},
+		{"deterministic", "reproducible searches, needs max_iterations above 0", [](MctsConfig* c, const string& v) { return parse_bool(v, &c->deterministic); }},
+		{"seed", "first seed of the random number streams", [](MctsConfig* c, const string& v) { long seed; bool ok = parse_long(v, &seed); c->seed = seed; return ok; }},
+		{"rollout_policy", "Connect Four rollouts: random, bitboard or tactical (avoids blunders)", [](MctsConfig* c, const string& v) { return parse_rollout_policy(v, &c->rollout_policy); }},
+		{"rollout_depth", "moves after which bitboard and tactical rollouts stop and score the board, 0 to play to the end", [](MctsConfig* c, const string& v) { return parse_int(v, &c->rollout_depth) && c->rollout_depth >= 0; }},
+		{"eval_batch", "leaves evaluated together, 1 for synchronous evaluation (above 1 serial, tgm and tnm only)", [](MctsConfig* c, const string& v) { return parse_int(v, &c->eval_batch) && c->eval_batch > 0; }},
+		{"eval_in_flight", "leaves awaiting evaluation at once, 0 for twice eval_batch", [](MctsConfig* c, const string& v) { return parse_int(v, &c->eval_in_flight) && c->eval_in_flight >= 0; }},
+		{"eval_wait", "seconds to wait for a batch to fill up", [](MctsConfig* c, const string& v) { return parse_double(v, &c->eval_wait); }},
+		{"interleave", "descents run interleaved to overlap cache misses (above 1 serial only)", [](MctsConfig* c, const string& v) { return parse_int(v, &c->interleave) && c->interleave > 0; }},
+		{"solver_root_empty", "solve the root with at most this many empty slots", [](MctsConfig* c, const string& v) { return parse_int(v, &c->solver_root_empty); }},
+		{"solver_leaf_empty", "solve leaves with at most this many empty slots", [](MctsConfig* c, const string& v) { return parse_int(v, &c->solver_leaf_empty); }},
+		{"widening_constant", "progressive widening constant, 0 for no widening", [](MctsConfig* c, const string& v) { return parse_float(v, &c->widening_constant); }},
+		{"widening_exponent", "progressive widening exponent", [](MctsConfig* c, const string& v) { return parse_float(v, &c->widening_exponent); }},
+		{"rave", "blend all-moves-as-first statistics into UCB (serial, tgm and tnm)", [](MctsConfig* c, const string& v) { return parse_bool(v, &c->rave); }},
+		{"rave_equivalence", "edge visits at which RAVE trusts a node's own value as much as its AMAF value", [](MctsConfig* c, const string& v) { return parse_float(v, &c->rave_equivalence) && c->rave_equivalence > 0; }},
+		{"report_interval", "seconds between search snapshots", [](MctsConfig* c, const string& v) { return parse_double(v, &c->report_interval); }},
+		{"report_pv", "longest principal variation reported", [](MctsConfig* c, const string& v) { return parse_int(v, &c->report_pv); }},
+		{"early_stop", "stop once the best root move is settled", [](MctsConfig* c, const string& v) { return parse_bool(v, &c->early_stop); }},
+		{"early_stop_interval", "seconds between early stopping checks", [](MctsConfig* c, const string& v) { return parse_double(v, &c->early_stop_interval); }},
+		{"ponder", "search on the opponent's time (not root)", [](MctsConfig* c, const string& v) { return parse_bool(v, &c->ponder); }},
+		{"node_lock", "lock of each tnm node: omp, spin, ticket or futex (Linux)", [](MctsConfig* c, const string& v) { return parse_node_lock(v, &c->node_lock); }},
+		{"lock_free_reads", "tnm nodes are read through a seqlock instead of their lock (as tnm_seq)", [](MctsConfig* c, const string& v) { return parse_bool(v, &c->lock_free_reads); }},
+	};
+	return options;
+}
+
+bool set_config_option(MctsConfig* config, const string& name, const string& value) {
+	for (const ConfigOption& option: config_options()) {
+		if (name == option.name) {
+			return option.set(config, value);
+		}
+	}
+	return false;
+}
+
+void print_config_options(ostream& out) {
+	for (const ConfigOption& option: config_options()) {
+		out << "\t" << left << setw(22) << option.name << option.description << endl;
+	}
+}
+
+static string trim(const string& s) {
+	size_t begin = s.find_first_not_of(" \t\r");
+	if (begin == string::npos) {
+		return "";
+	}
+	size_t end = s.find_last_not_of(" \t\r");
+	return s.substr(begin, end - begin + 1);
+}
+
+bool parse_option(const string& arg, string* name, string* value) {
+	size_t eq = arg.find('=');
+	if (eq == string::npos) {
+		return false;
+	}
+	size_t begin = arg.find_first_not_of('-');
+	*name = trim(arg.substr(begin, eq - begin));
+	*value = trim(arg.substr(eq + 1));
+	return !name->empty();
+}
+
+bool read_config_file(const string& path, vector<pair<string, string>>* options, string* error) {
+	ifstream in(path.c_str());
+	if (!in) {
+		*error = "cannot read " + path;
+		return false;
+	}
+	string line;
+	int line_num = 0;
+	while (getline(in, line)) {
+		line_num++;
+		line = trim(line.substr(0, line.find('#')));
+		if (line.empty()) {
+			continue;
+		}
+		string name, value;
+		if (!parse_option(line, &name, &value)) {
+			*error = path + ":" + to_string(line_num) + ": expected name = value";
+			return false;
+		}
+		options->push_back(make_pair(name, value));
+	}
+	return true;
+}
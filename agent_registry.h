@@ -0,0 +1,79 @@
+#ifndef AGENT_REGISTRY_H
+#define AGENT_REGISTRY_H
+
+#include <functional>
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+using namespace std;
+
+#include "game.h"
+#include "mcts_config.h"
+
+// Builds an agent with the given options
+typedef function<Agent*(const MctsConfig& config)> agent_factory_t;
+
+// Options an agent acts on beyond the ones every agent takes, or'd together
+enum AgentFeature {
+	// eval_batch above 1
+	AGENT_BATCHES = 1,
+	// interleave above 1
+	AGENT_INTERLEAVES = 2,
+	// rave
+	AGENT_RAVE = 4,
+	// node_lock other than omp, and lock_free_reads
+	AGENT_NODE_LOCK = 8,
+	// ponder
+	AGENT_PONDERS = 16
+};
+
+// Agents that can be picked by name at run time
+class AgentRegistry {
+	private:
+		struct Entry {
+			string name;
+			string label;
+			agent_factory_t factory;
+			int features;
+		};
+		vector<Entry> entries;
+		const Entry* find(const string& name) const;
+	public:
+		// features is a set of AgentFeature flags
+		void add(const string& name, const string& label, agent_factory_t factory, int features = 0);
+		// NULL if no agent has that name
+		Agent* create(const string& name, const MctsConfig& config) const;
+		// Returns false with a message in error if the options do not work
+		// together, or turn on something the agent does not have (see AgentFeature)
+		// Options on by default, such as tree_reuse, are not checked
+		// Unknown names are left to create
+		bool check(const string& name, const MctsConfig& config, string* error) const;
+		// Human readable name, empty if no agent has that name
+		string label(const string& name) const;
+		// One "- name (label)" line per agent
+		void print(ostream& out) const;
+};
+
+// The serial, leaf, root, tgm, tnm and tnm_seq MCTS agents
+AgentRegistry builtin_agents();
+
+// Sets the option called name from its text value
+// Numbers use the usual C syntax, booleans are read by parse_bool
+// Returns false if the name is unknown or the value does not parse
+bool set_config_option(MctsConfig* config, const string& name, const string& value);
+// Reads true/false, yes/no, on/off or 1/0
+bool parse_bool(const string& value, bool* out);
+// Reads a number in the usual C syntax
+bool parse_double(const string& value, double* out);
+// One "name  description" line per option
+void print_config_options(ostream& out);
+
+// Splits "name=value" (leading dashes are dropped), returns false if there is no '='
+bool parse_option(const string& arg, string* name, string* value);
+// Reads "name = value" lines from a config file into options, in order
+// Blank lines and everything after a '#' are ignored
+// Returns false with a message in error if the file cannot be read or a line is malformed
+bool read_config_file(const string& path, vector<pair<string, string>>* options, string* error);
+
+#endif
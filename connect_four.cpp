@@ -1,9 +1,14 @@
 #include "connect_four.h"
+#include "connect_four_bitboard.h"
 
 void ConnectFourMove::print() {
 	cout << "ConnectFourMove(" << col << ")" << endl;
 }
 
+string ConnectFourMove::to_string() {
+	return std::to_string(col + 1);
+}
+
 // Returns 0 if slot is empty, 1 if has player 0 chip, 2 if has player 1 chip
 int ConnectFourPosition::get_slot(int col, int row) {
 	return (pos_vec[col] & (3 << (2*row))) >> (2*row);
@@ -48,8 +53,8 @@ int ConnectFourPosition::check_winner() {
 				if (
 					this->get_slot(c, r) == player+1 &&
 					this->get_slot(c+1, r+1) == player+1 &&
-					this->get_slot(c+2, r+1) == player+1 &&
-					this->get_slot(c+3, r+1) == player+1
+					this->get_slot(c+2, r+2) == player+1 &&
+					this->get_slot(c+3, r+3) == player+1
 				){
 					return player;
 				}
@@ -78,6 +83,26 @@ vector<int> ConnectFourPosition::get_vec() {
 	return pos_vec;
 }
 
+vector<int> ConnectFourPosition::get_canonical_vec() {
+	// Reverse the columns, whose turn it is stays last
+	vector<int> mirror = pos_vec;
+	reverse(mirror.begin(), mirror.begin() + COLS);
+	return min(pos_vec, mirror);
+}
+
+int ConnectFourPosition::move_key(Move* move) {
+	int col = ((ConnectFourMove*) move)->col;
+	int row = 0;
+	while (row < ROWS && get_slot(col, row) != 0) {
+		row++;
+	}
+	return col * ROWS + row;
+}
+
+int ConnectFourPosition::mirror_key(int key) {
+	return (COLS - 1 - key / ROWS) * ROWS + key % ROWS;
+}
+
 bool ConnectFourPosition::is_terminal() {
 	// Winner exists
 	if (this->check_winner() != -1) {
@@ -167,3 +192,14 @@ Position* ConnectFourGame::new_game() {
 	return init_pos;
 }
 
+Position* ConnectFourGame::from_moves(const string& moves) {
+	ConnectFourBitboard bb = ConnectFourBitboard::from_vec(vector<int> (COLS+1, 0));
+	for (char ch: moves) {
+		int col = ch - '1';
+		if (col < 0 || col >= COLS || !bb.can_play(col) || bb.last_player_won()) {
+			return NULL;
+		}
+		bb.play(col);
+	}
+	return new ConnectFourPosition(bb.to_vec());
+}
@@ -1,7 +1,9 @@
 #ifndef CONNECT_FOUR_H
 #define CONNECT_FOUR_H
 
+#include <algorithm>
 #include <iostream>
+#include <string>
 #include <unordered_map>
 #include <vector>
 using namespace std;
@@ -16,6 +18,8 @@ struct ConnectFourMove: public Move {
 	int col;
 	ConnectFourMove(int col): col(col) {};
 	void print() override;
+	// Column numbered 1-7, as in move strings
+	string to_string() override;
 };
 
 class ConnectFourPosition: public Position {
@@ -40,6 +44,11 @@ class ConnectFourPosition: public Position {
 		Position* make_move(Move* move) override;
 		// For hashing
 		vector<int> get_vec() override;
+		// Smaller of the position and its left-right mirror image
+		vector<int> get_canonical_vec() override;
+		// Slot the move fills, col * ROWS + row
+		int move_key(Move* move) override;
+		int mirror_key(int key) override;
 		// Helper functions
 		// For debug
 		void print() override;
@@ -50,6 +59,9 @@ struct ConnectFourGame: public Game {
 	public:
 		ConnectFourGame();
 		Position* new_game() override;
+		// Position reached by playing the given columns (1-7) from the start
+		// Returns NULL if a move is illegal
+		Position* from_moves(const string& moves);
 };
 
 #endif
@@ -0,0 +1,150 @@
+#ifndef CONNECT_FOUR_BITBOARD_H
+#define CONNECT_FOUR_BITBOARD_H
+
+#include <stdint.h>
+
+#include <vector>
+using namespace std;
+
+#include "connect_four.h"
+
+// Each column takes ROWS+1 bits, the extra bit on top keeps lines from wrapping
+#define BB_HEIGHT (ROWS+1)
+
+// Compact Connect Four board used on hot paths (rollouts, solver, perft)
+// Bit (col * BB_HEIGHT + row) is set when that slot holds a chip
+struct ConnectFourBitboard {
+	// Chips of the player to move
+	uint64_t current;
+	// Chips of both players
+	uint64_t mask;
+	// Number of chips played
+	int moves;
+
+	static uint64_t bottom_mask() {
+		uint64_t bottom = 0;
+		for (int c = 0; c < COLS; c++) {
+			bottom |= (uint64_t) 1 << (c * BB_HEIGHT);
+		}
+		return bottom;
+	}
+	static uint64_t board_mask() {
+		return bottom_mask() * (((uint64_t) 1 << ROWS) - 1);
+	}
+	static uint64_t column_mask(int col) {
+		return (((uint64_t) 1 << ROWS) - 1) << (col * BB_HEIGHT);
+	}
+	static uint64_t top_mask(int col) {
+		return (uint64_t) 1 << (ROWS - 1 + col * BB_HEIGHT);
+	}
+
+	// Build from the vector representation used by ConnectFourPosition
+	static ConnectFourBitboard from_vec(const vector<int>& pos_vec) {
+		ConnectFourBitboard bb;
+		uint64_t player0 = 0;
+		bb.mask = 0;
+		bb.moves = 0;
+		for (int c = 0; c < COLS; c++) {
+			for (int r = 0; r < ROWS; r++) {
+				int slot = (pos_vec[c] >> (2*r)) & 3;
+				if (slot == 0) {
+					break;
+				}
+				uint64_t bit = (uint64_t) 1 << (c * BB_HEIGHT + r);
+				bb.mask |= bit;
+				bb.moves++;
+				if (slot == 1) {
+					player0 |= bit;
+				}
+			}
+		}
+		bb.current = pos_vec[COLS] == 0 ? player0 : bb.mask ^ player0;
+		return bb;
+	}
+
+	// Back to the vector representation
+	vector<int> to_vec() const {
+		vector<int> pos_vec(COLS+1, 0);
+		uint64_t player0 = whose_turn() == 0 ? current : mask ^ current;
+		for (int c = 0; c < COLS; c++) {
+			for (int r = 0; r < ROWS; r++) {
+				uint64_t bit = (uint64_t) 1 << (c * BB_HEIGHT + r);
+				if (mask & bit) {
+					pos_vec[c] |= ((player0 & bit) ? 1 : 2) << (2*r);
+				}
+			}
+		}
+		pos_vec[COLS] = whose_turn();
+		return pos_vec;
+	}
+
+	int whose_turn() const {
+		return moves & 1;
+	}
+	bool can_play(int col) const {
+		return (mask & top_mask(col)) == 0;
+	}
+	// Bit of the slot a chip dropped in each column would land in
+	uint64_t possible() const {
+		return (mask + bottom_mask()) & board_mask();
+	}
+	void play(int col) {
+		current ^= mask;
+		mask |= mask + ((uint64_t) 1 << (col * BB_HEIGHT));
+		moves++;
+	}
+	bool is_full() const {
+		return moves == ROWS * COLS;
+	}
+
+	// Empty slots that would complete four in a row for the given chips
+	static uint64_t winning_slots(uint64_t chips, uint64_t mask) {
+		// Vertical
+		uint64_t r = (chips << 1) & (chips << 2) & (chips << 3);
+		// Horizontal and both diagonals
+		int shifts[3] = {BB_HEIGHT, BB_HEIGHT-1, BB_HEIGHT+1};
+		for (int i = 0; i < 3; i++) {
+			int s = shifts[i];
+			uint64_t p = (chips << s) & (chips << 2*s);
+			r |= p & (chips << 3*s);
+			r |= p & (chips >> s);
+			p = (chips >> s) & (chips >> 2*s);
+			r |= p & (chips << s);
+			r |= p & (chips >> 3*s);
+		}
+		return r & (board_mask() ^ mask);
+	}
+	// Slots where the player to move would win right away
+	uint64_t current_winning_slots() const {
+		return winning_slots(current, mask);
+	}
+	// Slots where the opponent would win if it were their move
+	uint64_t opponent_winning_slots() const {
+		return winning_slots(current ^ mask, mask);
+	}
+	bool is_winning_move(int col) const {
+		return current_winning_slots() & possible() & column_mask(col);
+	}
+	// True if the chips contain four in a row
+	static bool has_four(uint64_t chips) {
+		int shifts[4] = {1, BB_HEIGHT, BB_HEIGHT-1, BB_HEIGHT+1};
+		for (int i = 0; i < 4; i++) {
+			uint64_t m = chips & (chips >> shifts[i]);
+			if (m & (m >> 2*shifts[i])) {
+				return true;
+			}
+		}
+		return false;
+	}
+	// True if the player who just moved has four in a row
+	bool last_player_won() const {
+		return has_four(current ^ mask);
+	}
+
+	// Key unique to the position (whose turn it is follows from the number of chips)
+	uint64_t key() const {
+		return current + mask;
+	}
+};
+
+#endif
@@ -0,0 +1,47 @@
+#include <stdint.h>
+
+#include <vector>
+using namespace std;
+
+#include "connect_four.h"
+#include "connect_four_bitboard.h"
+#include "connect_four_prior.h"
+
+// Weight of a quiet move in each column, central chips take part in more lines
+static const float COLUMN_WEIGHTS[COLS] = {1, 2, 3, 4, 3, 2, 1};
+// Added for moves that win at once or block the opponent's win
+#define WIN_WEIGHT (100)
+#define BLOCK_WEIGHT (30)
+// Factor for moves that let the opponent win right on top of them
+#define UNSAFE_FACTOR (0.1)
+
+vector<float> ConnectFourPrior::priors(Position* pos, const vector<Move*>& moves) {
+	vector<float> priors(moves.size(), 1.0 / moves.size());
+	ConnectFourPosition* cf_pos = dynamic_cast<ConnectFourPosition*>(pos);
+	if (cf_pos == NULL) {
+		return priors;
+	}
+	ConnectFourBitboard bb = ConnectFourBitboard::from_vec(cf_pos->get_vec());
+	uint64_t possible = bb.possible();
+	uint64_t wins = bb.current_winning_slots();
+	uint64_t threats = bb.opponent_winning_slots();
+	float total = 0;
+	for (int i = 0; i < moves.size(); i++) {
+		int col = ((ConnectFourMove*) moves[i])->col;
+		uint64_t slot = possible & ConnectFourBitboard::column_mask(col);
+		float weight = COLUMN_WEIGHTS[col];
+		if (slot & wins) {
+			weight += WIN_WEIGHT;
+		} else if (slot & threats) {
+			weight += BLOCK_WEIGHT;
+		} else if ((slot << 1) & threats) {
+			weight *= UNSAFE_FACTOR;
+		}
+		priors[i] = weight;
+		total += weight;
+	}
+	for (float& prior: priors) {
+		prior /= total;
+	}
+	return priors;
+}
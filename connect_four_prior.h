@@ -0,0 +1,18 @@
+#ifndef CONNECT_FOUR_PRIOR_H
+#define CONNECT_FOUR_PRIOR_H
+
+#include <vector>
+using namespace std;
+
+#include "move_prior.h"
+
+// Favors central columns, moves that win at once and moves that block the
+// opponent's immediate win, and disfavors playing right below a slot the
+// opponent wins with
+// Positions of other games get uniform priors
+class ConnectFourPrior: public MovePrior {
+	public:
+		vector<float> priors(Position* pos, const vector<Move*>& moves) override;
+};
+
+#endif
@@ -0,0 +1,215 @@
+#include "timing.h"
+#include "connect_four_solver.h"
+
+// Bound types stored in the transposition table (0 marks an empty entry)
+#define TT_EXACT (1)
+#define TT_LOWER (2)
+#define TT_UPPER (3)
+
+// The limits of a search are checked once every this many nodes (a power of 2)
+#define CHECK_NODES (4096)
+
+ConnectFourSolver::ConnectFourSolver(int table_bits):
+	table((size_t) 1 << table_bits), table_mask(((uint64_t) 1 << table_bits) - 1), nodes(0) {}
+
+// Entry layout: key (49 bits) | depth (6 bits) | bound type (2 bits) | score + 1 (2 bits)
+bool ConnectFourSolver::probe(uint64_t key, int depth, int* flag, int* score) {
+	uint64_t entry = table[(key * 0x9e3779b97f4a7c15ULL >> 20) & table_mask].load(memory_order_relaxed);
+	if ((entry >> 15) != key || ((entry >> 2) & 3) == 0) {
+		return false;
+	}
+	int entry_depth = (entry >> 4) & 63;
+	*flag = (entry >> 2) & 3;
+	*score = (int) (entry & 3) - 1;
+	// Wins and losses hold at any depth, otherwise the entry must have looked at least as deep
+	bool decisive = (*flag != TT_UPPER && *score == 1) || (*flag != TT_LOWER && *score == -1);
+	return decisive || entry_depth >= depth;
+}
+
+void ConnectFourSolver::store(uint64_t key, int depth, int flag, int score) {
+	uint64_t entry = (key << 15) | ((uint64_t) depth << 4) | ((uint64_t) flag << 2) | (uint64_t) (score + 1);
+	table[(key * 0x9e3779b97f4a7c15ULL >> 20) & table_mask].store(entry, memory_order_relaxed);
+}
+
+int ConnectFourSolver::negamax(const ConnectFourBitboard& bb, int alpha, int beta, int depth, SolveRun* run, int* best_col) {
+	run->nodes++;
+	if (run->control != NULL && (run->nodes & (CHECK_NODES - 1)) == 0) {
+		double wc_time, cpu_time;
+		timing(&wc_time, &cpu_time);
+		run->aborted = run->aborted || run->control->should_stop(wc_time - run->start, 0, 0);
+	}
+	if (run->aborted) {
+		return 0;
+	}
+	if (bb.is_full()) {
+		return 0;
+	}
+	uint64_t possible = bb.possible();
+	// Take an immediate win
+	uint64_t wins = bb.current_winning_slots() & possible;
+	if (wins) {
+		if (best_col != NULL) {
+			*best_col = __builtin_ctzll(wins) / BB_HEIGHT;
+		}
+		return 1;
+	}
+	// Moves that do not hand the opponent an immediate win
+	uint64_t threats = bb.opponent_winning_slots();
+	uint64_t forced = threats & possible;
+	uint64_t moves = possible;
+	if (forced) {
+		moves = forced;
+	}
+	moves &= ~(threats >> 1);
+	// Two threats cannot both be blocked
+	if (moves == 0 || (forced & (forced - 1))) {
+		if (best_col != NULL) {
+			*best_col = __builtin_ctzll(possible) / BB_HEIGHT;
+		}
+		return -1;
+	}
+	if (depth == 0) {
+		return 0;
+	}
+
+	int alpha_orig = alpha;
+	uint64_t key = bb.key();
+	int flag, score;
+	// The root always searches so it can report a move
+	if (best_col == NULL && probe(key, depth, &flag, &score)) {
+		if (flag == TT_EXACT) {
+			return score;
+		}
+		if (flag == TT_LOWER && score > alpha) {
+			alpha = score;
+		} else if (flag == TT_UPPER && score < beta) {
+			beta = score;
+		}
+		if (alpha >= beta) {
+			return score;
+		}
+	}
+
+	// Order moves by the number of threats they create, then closest to the center
+	int cols[COLS];
+	int threat_counts[COLS];
+	int n = 0;
+	for (int i = 0; i < COLS; i++) {
+		int col = COLS / 2 + (i % 2 == 1 ? -(i+1)/2 : (i+1)/2);
+		uint64_t move = moves & ConnectFourBitboard::column_mask(col);
+		if (!move) {
+			continue;
+		}
+		int count = __builtin_popcountll(ConnectFourBitboard::winning_slots(bb.current | move, bb.mask | move));
+		int j = n++;
+		while (j > 0 && threat_counts[j-1] < count) {
+			cols[j] = cols[j-1];
+			threat_counts[j] = threat_counts[j-1];
+			j--;
+		}
+		cols[j] = col;
+		threat_counts[j] = count;
+	}
+
+	int best = -2;
+	for (int i = 0; i < n; i++) {
+		ConnectFourBitboard child = bb;
+		child.play(cols[i]);
+		int value = -negamax(child, -beta, -alpha, depth - 1, run, NULL);
+		// Keep unfinished results out of the table
+		if (run->aborted) {
+			return 0;
+		}
+		if (value > best) {
+			best = value;
+			if (best_col != NULL) {
+				*best_col = cols[i];
+			}
+		}
+		if (value > alpha) {
+			alpha = value;
+		}
+		if (alpha >= beta) {
+			break;
+		}
+	}
+
+	if (best <= alpha_orig) {
+		flag = TT_UPPER;
+	} else if (best >= beta) {
+		flag = TT_LOWER;
+	} else {
+		flag = TT_EXACT;
+	}
+	store(key, depth, flag, best);
+	return best;
+}
+
+// Iterative deepening: stop as soon as a win or loss is found within the
+// depth limit, or once the limit covers the rest of the game
+int ConnectFourSolver::deepen(const ConnectFourBitboard& bb, SolveRun* run, int* best_col) {
+	int empty = ROWS * COLS - bb.moves;
+	int score = 0;
+	int depth = 0;
+	while (!run->aborted) {
+		depth = depth + 2 < empty ? depth + 2 : empty;
+		score = negamax(bb, -1, 1, depth, run, best_col);
+		if (score != 0 || depth == empty) {
+			break;
+		}
+	}
+	nodes.fetch_add(run->nodes, memory_order_relaxed);
+	return score;
+}
+
+int ConnectFourSolver::solve_board(const ConnectFourBitboard& bb, int* best_col) {
+	SolveRun run(NULL, 0);
+	return this->deepen(bb, &run, best_col);
+}
+
+bool ConnectFourSolver::solve(Position* pos, int max_empty, float* payoff, Move** best) {
+	return this->solve_limited(pos, max_empty, payoff, best, NULL, 0);
+}
+
+bool ConnectFourSolver::solve(Position* pos, int max_empty, float* payoff, Move** best, const SearchControl& control, double start) {
+	return this->solve_limited(pos, max_empty, payoff, best, &control, start);
+}
+
+bool ConnectFourSolver::solve_limited(Position* pos, int max_empty, float* payoff, Move** best, const SearchControl* control, double start) {
+	ConnectFourPosition* cf_pos = dynamic_cast<ConnectFourPosition*>(pos);
+	if (cf_pos == NULL) {
+		return false;
+	}
+	ConnectFourBitboard bb = ConnectFourBitboard::from_vec(cf_pos->get_vec());
+	if (ROWS * COLS - bb.moves > max_empty || bb.last_player_won() || bb.is_full()) {
+		return false;
+	}
+	int best_col = -1;
+	SolveRun run(control, start);
+	int score = this->deepen(bb, &run, &best_col);
+	if (run.aborted) {
+		return false;
+	}
+	if (score == 0) {
+		*payoff = 0.5;
+	} else {
+		// Score is for the player to move
+		int winner = score == 1 ? bb.whose_turn() : 1 - bb.whose_turn();
+		*payoff = winner == 0 ? 1 : 0;
+	}
+	if (best != NULL) {
+		*best = new ConnectFourMove(best_col);
+	}
+	return true;
+}
+
+long ConnectFourSolver::get_nodes() {
+	return nodes.load();
+}
+
+void ConnectFourSolver::clear() {
+	for (int i = 0; i < table.size(); i++) {
+		table[i].store(0, memory_order_relaxed);
+	}
+	nodes = 0;
+}
@@ -0,0 +1,51 @@
+#ifndef CONNECT_FOUR_SOLVER_H
+#define CONNECT_FOUR_SOLVER_H
+
+#include <stdint.h>
+
+#include <atomic>
+#include <vector>
+using namespace std;
+
+#include "solver.h"
+#include "connect_four_bitboard.h"
+
+// Negamax search with alpha-beta pruning on the Connect Four bitboard
+// Scores are from the perspective of the player to move: 1 win, -1 loss,
+// 0 draw (or undecided within the depth limit)
+// Iterative deepening finds quick wins and losses first and fills the
+// transposition table for the deeper iterations
+class ConnectFourSolver: public Solver {
+	private:
+		// Each entry packs key, depth, bound type and score into 64 bits so that
+		// threads can share the table without locks
+		vector<atomic<uint64_t>> table;
+		uint64_t table_mask;
+		atomic<long> nodes;
+		// State of one solve call
+		struct SolveRun {
+			long nodes;
+			// Limits checked every few thousand nodes (NULL means none)
+			const SearchControl* control;
+			double start;
+			// Set once the limits are reached, the scores found since are meaningless
+			bool aborted;
+			SolveRun(const SearchControl* control, double start): nodes(0), control(control), start(start), aborted(false) {}
+		};
+		int negamax(const ConnectFourBitboard& bb, int alpha, int beta, int depth, SolveRun* run, int* best_col);
+		int deepen(const ConnectFourBitboard& bb, SolveRun* run, int* best_col);
+		bool solve_limited(Position* pos, int max_empty, float* payoff, Move** best, const SearchControl* control, double start);
+		bool probe(uint64_t key, int depth, int* flag, int* score);
+		void store(uint64_t key, int depth, int flag, int score);
+	public:
+		// Transposition table holds 2^table_bits entries
+		ConnectFourSolver(int table_bits = 20);
+		bool solve(Position* pos, int max_empty, float* payoff, Move** best) override;
+		bool solve(Position* pos, int max_empty, float* payoff, Move** best, const SearchControl& control, double start) override;
+		// Solve a bitboard directly, returns the score for the player to move
+		int solve_board(const ConnectFourBitboard& bb, int* best_col);
+		long get_nodes();
+		void clear();
+};
+
+#endif
@@ -0,0 +1,119 @@
+#include <string.h>
+
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+using namespace std;
+
+#include "game.h"
+#include "timing.h"
+#include "connect_four.h"
+#include "connect_four_solver.h"
+#include "agent_registry.h"
+
+// Fixed endgame suite: columns played (1-7) from the empty board
+// Every position has a move that is strictly better than most of the others
+const char* ENDGAME_SUITE[] = {
+	"11341671446721",          // 28 empty, win
+	"11375112264336",          // 28 empty, win
+	"666326511231474",         // 27 empty, draw
+	"3565531565543433",        // 26 empty, win
+	"517331313527737654",      // 24 empty, win
+	"714115427445225325",      // 24 empty, draw
+	"233574617776125763",      // 24 empty, win
+	"5642123422445246727",     // 23 empty, win
+	"6626311743756255221",     // 23 empty, win
+	"6643444375253446377",     // 23 empty, win
+	"7116463152527666457",     // 23 empty, win
+	"44421154434731732566",    // 22 empty, draw
+	"316541737346616617256",   // 21 empty, win
+	"7541674327255742737524",  // 20 empty, win
+	"6771735644367261477144",  // 20 empty, win
+	"12545613563544317314453",  // 19 empty, win
+};
+#define SUITE_SIZE ((int) (sizeof(ENDGAME_SUITE) / sizeof(ENDGAME_SUITE[0])))
+
+// Exact value of playing col, from the perspective of the player to move
+int move_value(ConnectFourSolver* solver, ConnectFourBitboard bb, int col) {
+	if (bb.is_winning_move(col)) {
+		return 1;
+	}
+	bb.play(col);
+	return -solver->solve_board(bb, NULL);
+}
+
+// Plays every suite position once and reports how often the agent keeps the exact value
+void bench_agent(const char* label, Agent* agent, Game* game, ConnectFourSolver* solver, float time_limit) {
+	int correct = 0;
+	double total_time = 0;
+	for (int i = 0; i < SUITE_SIZE; i++) {
+		Position* pos = ((ConnectFourGame*) game)->from_moves(ENDGAME_SUITE[i]);
+		ConnectFourBitboard bb = ConnectFourBitboard::from_vec(pos->get_vec());
+		int best_score = solver->solve_board(bb, NULL);
+
+		double start, end, cpu_time;
+		timing(&start, &cpu_time);
+		pair<Move*, int> res = agent->best_move(pos, time_limit);
+		timing(&end, &cpu_time);
+		total_time += end - start;
+		int col = ((ConnectFourMove*) res.first)->col;
+		if (move_value(solver, bb, col) == best_score) {
+			correct++;
+		}
+		agent->reset();
+		delete pos;
+	}
+	printf("%-14s %2d/%d optimal, %8.4f s/position\n", label, correct, SUITE_SIZE, total_time / SUITE_SIZE);
+}
+
+int main(int argc, char* argv[]) {
+	if (argc < 2) {
+		cout << "Usage: ./endgame_bench <Time limit> [Agents...]" << endl;
+		cout << "Agents default to serial leaf root tgm tnm" << endl;
+		exit(-1);
+	}
+	float time_limit = atof(argv[1]);
+	vector<const char*> names;
+	for (int a = 2; a < argc; a++) {
+		names.push_back(argv[a]);
+	}
+	if (names.empty()) {
+		names = {"serial", "leaf", "root", "tgm", "tnm"};
+	}
+
+	Game* connect_four = new ConnectFourGame();
+	AgentRegistry registry = builtin_agents();
+	// Reference solver, also used to grade the agents
+	ConnectFourSolver solver;
+	double start, end, cpu_time;
+	timing(&start, &cpu_time);
+	for (int i = 0; i < SUITE_SIZE; i++) {
+		Position* pos = ((ConnectFourGame*) connect_four)->from_moves(ENDGAME_SUITE[i]);
+		int col;
+		solver.solve_board(ConnectFourBitboard::from_vec(pos->get_vec()), &col);
+		delete pos;
+	}
+	timing(&end, &cpu_time);
+	printf("%-14s %2d/%d optimal, %8.4f s/position (%ld nodes)\n", "solver", SUITE_SIZE, SUITE_SIZE,
+		(end - start) / SUITE_SIZE, solver.get_nodes());
+
+	for (const char* name: names) {
+		MctsConfig pure;
+		// Solve the root when it is shallow, and leaves a few moves from the end
+		MctsConfig solved;
+		solved.solver = &solver;
+		solved.solver_root_empty = 24;
+		solved.solver_leaf_empty = 14;
+		Agent* pure_agent = registry.create(name, pure);
+		Agent* solved_agent = registry.create(name, solved);
+		if (pure_agent == NULL) {
+			cout << "Invalid agent: " << name << endl;
+			exit(-1);
+		}
+		bench_agent(name, pure_agent, connect_four, &solver, time_limit);
+		bench_agent((string(name) + "+solver").c_str(), solved_agent, connect_four, &solver, time_limit);
+		delete pure_agent;
+		delete solved_agent;
+	}
+}
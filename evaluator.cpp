@@ -0,0 +1,105 @@
+#include <stdlib.h>
+
+#include <chrono>
+#include <vector>
+using namespace std;
+
+#include "evaluator.h"
+
+void Evaluator::evaluate_batch(vector<Position*>& positions, vector<float>& values, unsigned int* seed) {
+	values.resize(positions.size());
+	for (int i = 0; i < positions.size(); i++) {
+		values[i] = this->evaluate(positions[i], seed);
+	}
+}
+
+RolloutEvaluator::RolloutEvaluator(RolloutPolicy* policy) {
+	this->policy = policy != NULL ? policy : &random_policy;
+}
+
+float RolloutEvaluator::evaluate(Position* pos, unsigned int* seed) {
+	return policy->rollout(pos, seed);
+}
+
+float RolloutEvaluator::evaluate_moves(Position* pos, unsigned int* seed, vector<PlayedMove>* played) {
+	return policy->rollout_moves(pos, seed, played);
+}
+
+EvalBatcher::EvalBatcher(Evaluator* evaluator, int batch_size, double max_wait, unsigned int seed):
+	evaluator(evaluator), batch_size(batch_size), max_wait(max_wait), seed(seed), stopping(false) {
+	worker = thread(&EvalBatcher::run, this);
+}
+
+EvalBatcher::~EvalBatcher() {
+	{
+		lock_guard<mutex> guard(queue_mutex);
+		stopping = true;
+	}
+	pending_cv.notify_all();
+	worker.join();
+}
+
+void EvalBatcher::submit(EvalRequest* req) {
+	{
+		lock_guard<mutex> guard(queue_mutex);
+		pending.push_back(req);
+	}
+	pending_cv.notify_one();
+}
+
+void EvalBatcher::poll(vector<EvalRequest*>& done, bool block) {
+	unique_lock<mutex> guard(queue_mutex);
+	if (block) {
+		completed_cv.wait(guard, [this] { return !completed.empty(); });
+	}
+	done.insert(done.end(), completed.begin(), completed.end());
+	completed.clear();
+}
+
+void EvalBatcher::wait(vector<EvalRequest*>& done, double seconds) {
+	unique_lock<mutex> guard(queue_mutex);
+	chrono::duration<double> timeout(seconds);
+	completed_cv.wait_for(guard, timeout, [this] { return !completed.empty(); });
+	done.insert(done.end(), completed.begin(), completed.end());
+	completed.clear();
+}
+
+// Inference thread: wait for a full batch (or max_wait), evaluate it, publish results
+void EvalBatcher::run() {
+	vector<EvalRequest*> batch;
+	vector<Position*> positions;
+	vector<float> values;
+	while (true) {
+		{
+			unique_lock<mutex> guard(queue_mutex);
+			pending_cv.wait(guard, [this] { return stopping || !pending.empty(); });
+			if (stopping && pending.empty()) {
+				return;
+			}
+			// Give the batch a chance to fill up
+			chrono::duration<double> wait(max_wait);
+			pending_cv.wait_for(guard, wait, [this] { return stopping || pending.size() >= batch_size; });
+			while (!pending.empty() && batch.size() < batch_size) {
+				batch.push_back(pending.front());
+				pending.pop_front();
+			}
+		}
+
+		// Evaluate without holding the queue lock so the search can keep submitting
+		for (EvalRequest* req: batch) {
+			positions.push_back(req->pos);
+		}
+		evaluator->evaluate_batch(positions, values, &seed);
+		for (int i = 0; i < batch.size(); i++) {
+			batch[i]->value = values[i];
+		}
+
+		{
+			lock_guard<mutex> guard(queue_mutex);
+			completed.insert(completed.end(), batch.begin(), batch.end());
+		}
+		completed_cv.notify_all();
+		batch.clear();
+		positions.clear();
+	}
+}
@@ -0,0 +1,80 @@
+#ifndef EVALUATOR_H
+#define EVALUATOR_H
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+using namespace std;
+
+#include "game.h"
+#include "rollout_policy.h"
+
+// Abstract leaf evaluator
+// Estimates the payoff of a position from the perspective of player 0
+class Evaluator {
+	public:
+		// Must be safe to call from several threads at once
+		virtual float evaluate(Position* pos, unsigned int* seed) = 0;
+		// Same, and appends the moves of the simulation it ran to played for RAVE
+		// Evaluators that do not play the position out record nothing
+		virtual float evaluate_moves(Position* pos, unsigned int* seed, vector<PlayedMove>* /* played */) {
+			return this->evaluate(pos, seed);
+		}
+		// Evaluate a group of positions together
+		// Expensive evaluators (e.g. a model) override this to amortize their cost
+		virtual void evaluate_batch(vector<Position*>& positions, vector<float>& values, unsigned int* seed);
+		virtual ~Evaluator() {}
+};
+
+// Evaluates a leaf by playing it out with a rollout policy
+// Uniformly random moves until a terminal state unless another policy is given
+class RolloutEvaluator: public Evaluator {
+	private:
+		RolloutPolicy* policy;
+		RandomRolloutPolicy random_policy;
+	public:
+		RolloutEvaluator(RolloutPolicy* policy = NULL);
+		float evaluate(Position* pos, unsigned int* seed) override;
+		float evaluate_moves(Position* pos, unsigned int* seed, vector<PlayedMove>* played) override;
+};
+
+// A leaf waiting to be evaluated asynchronously
+struct EvalRequest {
+	Position* pos;
+	float value;
+	// Caller's bookkeeping, e.g. the path to back propagate along
+	void* data;
+	EvalRequest(Position* pos, void* data): pos(pos), value(0), data(data) {}
+};
+
+// Groups queued leaves into batches and evaluates them on its own inference thread
+// so that the tree can keep being searched while evaluations are pending
+class EvalBatcher {
+	private:
+		Evaluator* evaluator;
+		int batch_size;
+		// Seconds to wait for a batch to fill up before evaluating a partial one
+		double max_wait;
+		unsigned int seed;
+		bool stopping;
+		deque<EvalRequest*> pending;
+		vector<EvalRequest*> completed;
+		mutex queue_mutex;
+		condition_variable pending_cv;
+		condition_variable completed_cv;
+		thread worker;
+		void run();
+	public:
+		EvalBatcher(Evaluator* evaluator, int batch_size, double max_wait, unsigned int seed);
+		~EvalBatcher();
+		// Queue a leaf for evaluation
+		void submit(EvalRequest* req);
+		// Move finished requests into done, waiting for at least one if block is set
+		void poll(vector<EvalRequest*>& done, bool block);
+		// Same as a blocking poll but gives up after seconds, for batchers shared by several threads
+		void wait(vector<EvalRequest*>& done, double seconds);
+};
+
+#endif
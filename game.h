@@ -1,7 +1,9 @@
 #ifndef GAME_H
 #define GAME_H
 
+#include <atomic>
 #include <iostream>
+#include <string>
 #include <vector>
 using namespace std;
 
@@ -17,6 +19,17 @@ struct pos_hash {
 
 struct Move {
 	virtual void print() = 0;
+	// Short text form, e.g. for search telemetry
+	virtual string to_string() = 0;
+	virtual ~Move() {}
+};
+
+// A move made during a simulation, for all-moves-as-first (RAVE) statistics
+struct PlayedMove {
+	int player;
+	// See Position::move_key
+	int key;
+	PlayedMove(int player, int key): player(player), key(key) {}
 };
 
 // Abstract class
@@ -34,7 +47,24 @@ class Position {
 		virtual Position* make_move(Move* move) = 0;
 		// Need to be able to represent each position as a vector in order to hash it
 		virtual vector<int> get_vec() = 0;
+		// Same vector for every position equivalent under the game's symmetries,
+		// so the search tree can store them as one node
+		virtual vector<int> get_canonical_vec() {
+			return get_vec();
+		}
+		// Small non-negative id of a legal move that stays the same wherever in the game
+		// the move is made (e.g. the slot it fills), for all-moves-as-first statistics
+		// -1 means the game does not support them
+		virtual int move_key(Move* /* move */) {
+			return -1;
+		}
+		// Key of the same move in the mirror image of the position, for games
+		// whose canonical vec may be the mirror image
+		virtual int mirror_key(int key) {
+			return key;
+		}
 		virtual void print() = 0;
+		virtual ~Position() {}
 };
 
 class Game {
@@ -42,10 +72,45 @@ class Game {
 		virtual Position* new_game() = 0;	
 };
 
+// Limits on one call to best_move
+struct SearchControl {
+	// Seconds the search may take
+	float time_limit;
+	// Another thread sets this to end the search as soon as possible (NULL means none)
+	atomic<bool>* stop;
+	// Caps on the number of iterations and on the number of nodes the search adds
+	// to the tree (0 means none)
+	long max_iterations;
+	long max_nodes;
+
+	SearchControl(float time_limit): time_limit(time_limit), stop(NULL), max_iterations(0), max_nodes(0) {}
+
+	bool stop_requested() const {
+		return stop != NULL && stop->load(memory_order_relaxed);
+	}
+	// True once any of the limits is reached
+	bool should_stop(double elapsed, long iterations, long nodes) const {
+		return elapsed >= time_limit || stop_requested()
+			|| (max_iterations > 0 && iterations >= max_iterations)
+			|| (max_nodes > 0 && nodes >= max_nodes);
+	}
+};
+
 class Agent {
 	public:
 		virtual pair<Move*, int> best_move(Position* pos, float time_limit) = 0; 
+		// Search bounded by control
+		// Agents that do not override this only honor the time limit
+		virtual pair<Move*, int> best_move(Position* pos, const SearchControl& control) {
+			return best_move(pos, control.time_limit);
+		}
 		virtual void reset() = 0;
+		// Keep searching pos in the background (e.g. on the opponent's time)
+		// until the next call to best_move or stop_pondering
+		// pos must stay alive until then
+		virtual void start_pondering(Position* /* pos */) {}
+		virtual void stop_pondering() {}
+		virtual ~Agent() {}
 };
 
 #endif
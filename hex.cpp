@@ -0,0 +1,189 @@
+#include <string.h>
+
+#include "hex.h"
+
+void HexMove::print() {
+	cout << "HexMove(" << this->to_string() << ")" << endl;
+}
+
+string HexMove::to_string() {
+	return string(1, 'a' + cell % HEX_SIZE) + std::to_string(cell / HEX_SIZE + 1);
+}
+
+int hex_neighbors(int cell, int neighbors[6]) {
+	static const int DR[6] = {-1, -1, 0, 0, 1, 1};
+	static const int DC[6] = {0, 1, -1, 1, -1, 0};
+	int row = cell / HEX_SIZE;
+	int col = cell % HEX_SIZE;
+	int n = 0;
+	for (int d = 0; d < 6; d++) {
+		int r = row + DR[d];
+		int c = col + DC[d];
+		if (r >= 0 && r < HEX_SIZE && c >= 0 && c < HEX_SIZE) {
+			neighbors[n++] = r * HEX_SIZE + c;
+		}
+	}
+	return n;
+}
+
+HexPosition::HexPosition(): turn(0), empty(HEX_CELLS), winner(-1) {
+	memset(cells, 0, sizeof(cells));
+	for (int i = 0; i < HEX_NODES; i++) {
+		parent[i] = i;
+	}
+}
+
+// Root of node's set, halving the path on the way
+int HexPosition::find(int node) {
+	while (parent[node] != node) {
+		parent[node] = parent[parent[node]];
+		node = parent[node];
+	}
+	return node;
+}
+
+void HexPosition::unite(int a, int b) {
+	a = this->find(a);
+	b = this->find(b);
+	if (a != b) {
+		parent[a] = b;
+	}
+}
+
+// Puts a stone of the player to move on cell and passes the turn
+void HexPosition::place(int cell) {
+	int player = turn;
+	cells[cell] = player + 1;
+	int neighbors[6];
+	int n = hex_neighbors(cell, neighbors);
+	for (int i = 0; i < n; i++) {
+		if (cells[neighbors[i]] == player + 1) {
+			this->unite(cell, neighbors[i]);
+		}
+	}
+	int row = cell / HEX_SIZE;
+	int col = cell % HEX_SIZE;
+	// Only the player who just moved can have won
+	if (player == 0) {
+		if (row == 0) {
+			this->unite(cell, HEX_TOP);
+		}
+		if (row == HEX_SIZE - 1) {
+			this->unite(cell, HEX_BOTTOM);
+		}
+		if (this->find(HEX_TOP) == this->find(HEX_BOTTOM)) {
+			winner = 0;
+		}
+	} else {
+		if (col == 0) {
+			this->unite(cell, HEX_LEFT);
+		}
+		if (col == HEX_SIZE - 1) {
+			this->unite(cell, HEX_RIGHT);
+		}
+		if (this->find(HEX_LEFT) == this->find(HEX_RIGHT)) {
+			winner = 1;
+		}
+	}
+	turn = 1 - turn;
+	empty--;
+}
+
+bool HexPosition::is_terminal() {
+	// There are no draws, the board fills up only once someone has won
+	return winner != -1;
+}
+
+// Returns payoff of state (assuming it is terminal)
+float HexPosition::payoff() {
+	return winner == 0 ? 1 : 0;
+}
+
+int HexPosition::whose_turn() const {
+	return turn;
+}
+
+vector<Move*> HexPosition::possible_moves() {
+	vector<Move*> moves;
+	moves.reserve(empty);
+	for (int cell = 0; cell < HEX_CELLS; cell++) {
+		if (cells[cell] == 0) {
+			moves.push_back(new HexMove(cell));
+		}
+	}
+	return moves;
+}
+
+Position* HexPosition::make_move(Move* move) {
+	HexPosition* new_pos = new HexPosition(*this);
+	new_pos->place(((HexMove*) move)->cell);
+	return new_pos;
+}
+
+vector<int> HexPosition::get_vec() {
+	vector<int> vec((HEX_CELLS + 15) / 16 + 1, 0);
+	for (int cell = 0; cell < HEX_CELLS; cell++) {
+		vec[cell / 16] |= cells[cell] << (2 * (cell % 16));
+	}
+	vec.back() = turn;
+	return vec;
+}
+
+vector<int> HexPosition::get_canonical_vec() {
+	vector<int> vec = this->get_vec();
+	vector<int> rotated(vec.size(), 0);
+	for (int cell = 0; cell < HEX_CELLS; cell++) {
+		rotated[cell / 16] |= cells[HEX_CELLS - 1 - cell] << (2 * (cell % 16));
+	}
+	rotated.back() = turn;
+	return min(vec, rotated);
+}
+
+int HexPosition::move_key(Move* move) {
+	return ((HexMove*) move)->cell;
+}
+
+int HexPosition::mirror_key(int key) {
+	return HEX_CELLS - 1 - key;
+}
+
+void HexPosition::print() {
+	cout << "Turn: " << this->whose_turn() << endl;
+	for (int r = 0; r < HEX_SIZE; r++) {
+		cout << string(r, ' ');
+		for (int c = 0; c < HEX_SIZE; c++) {
+			cout << ".XO"[cells[r * HEX_SIZE + c]] << " ";
+		}
+		cout << endl;
+	}
+}
+
+HexGame::HexGame() {}
+
+Position* HexGame::new_game() {
+	return new HexPosition();
+}
+
+Position* HexGame::from_moves(const string& moves) {
+	Position* pos = new HexPosition();
+	int i = 0;
+	while (i < moves.size()) {
+		int col = moves[i++] - 'a';
+		int row = 0;
+		while (i < moves.size() && moves[i] >= '0' && moves[i] <= '9') {
+			row = row * 10 + moves[i++] - '0';
+		}
+		row--;
+		HexPosition* hex_pos = (HexPosition*) pos;
+		if (col < 0 || col >= HEX_SIZE || row < 0 || row >= HEX_SIZE
+			|| hex_pos->get_cell(row * HEX_SIZE + col) != 0 || pos->is_terminal()) {
+			delete pos;
+			return NULL;
+		}
+		HexMove move(row * HEX_SIZE + col);
+		Position* next = pos->make_move(&move);
+		delete pos;
+		pos = next;
+	}
+	return pos;
+}
@@ -0,0 +1,84 @@
+#ifndef HEX_H
+#define HEX_H
+
+#include <stdint.h>
+
+#include <iostream>
+#include <string>
+#include <vector>
+using namespace std;
+
+#include "game.h"
+
+// 11x11 Hex, without the swap rule
+// Player 0 moves first and joins the top and bottom rows, player 1 joins the
+// left and right columns. A full board always has exactly one winner
+#define HEX_SIZE (11)
+#define HEX_CELLS (HEX_SIZE * HEX_SIZE)
+// Union-find also holds one node per edge of the board
+#define HEX_TOP (HEX_CELLS)
+#define HEX_BOTTOM (HEX_CELLS + 1)
+#define HEX_LEFT (HEX_CELLS + 2)
+#define HEX_RIGHT (HEX_CELLS + 3)
+#define HEX_NODES (HEX_CELLS + 4)
+
+struct HexMove: public Move {
+	// row * HEX_SIZE + col
+	int cell;
+	HexMove(int cell): cell(cell) {};
+	void print() override;
+	// Column letter and row number, e.g. f6
+	string to_string() override;
+};
+
+// Cells adjacent to cell, returns how many (up to 6)
+int hex_neighbors(int cell, int neighbors[6]);
+
+class HexPosition: public Position {
+	private:
+		// 0 means empty, 1 means player 0, 2 means player 1
+		uint8_t cells[HEX_CELLS];
+		// Union-find over the stones of each player and the board edges, kept up
+		// to date by make_move so that a win is detected in amortized constant time
+		uint8_t parent[HEX_NODES];
+		int turn;
+		int empty;
+		// -1 while nobody has won
+		int winner;
+		int find(int node);
+		void unite(int a, int b);
+		void place(int cell);
+	public:
+		HexPosition();
+		// 0 if the cell is empty, otherwise 1 + the player whose stone is there
+		int get_cell(int cell) const {
+			return cells[cell];
+		}
+		bool is_terminal() override;
+		// Returns payoff of state (assuming it is terminal)
+		float payoff() override;
+		int whose_turn() const override;
+		// One move per empty cell
+		vector<Move*> possible_moves() override;
+		Position* make_move(Move* move) override;
+		// Cells packed 16 to an int, then whose turn it is
+		vector<int> get_vec() override;
+		// Smaller of the position and its 180 degree rotation, which keeps each
+		// player's edges
+		vector<int> get_canonical_vec() override;
+		// The cell the move fills
+		int move_key(Move* move) override;
+		int mirror_key(int key) override;
+		void print() override;
+};
+
+struct HexGame: public Game {
+	public:
+		HexGame();
+		Position* new_game() override;
+		// Position reached by playing the given cells, e.g. "f6e7d9"
+		// Returns NULL if a move is illegal
+		Position* from_moves(const string& moves);
+};
+
+#endif
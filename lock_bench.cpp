@@ -0,0 +1,230 @@
+#include <omp.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#include <string>
+#include <vector>
+using namespace std;
+
+#include "timing.h"
+#include "node_lock.h"
+
+// Microbenchmark of the node locks under the access pattern of the tnm agent:
+// threads descend a fixed tree, at each node locking the node and then every child
+// in turn to read their statistics, spin in place of a rollout, and finally lock
+// every node of the path again to back up a random result
+
+// Children of every inner node and levels below the root
+#define BRANCHING (7)
+#define DEPTH (4)
+
+// Stand-in for a tree node: the lock and the statistics threads change under it
+struct BenchNode {
+	NodeLock lock;
+	float reward;
+	int visits;
+	BenchNode(NodeLockKind kind): lock(kind), reward(0), visits(0) {}
+};
+
+// The same node on a cache line of its own, as in the tnm agent
+struct alignas(CACHE_LINE_SIZE) PaddedBenchNode: BenchNode {
+	PaddedBenchNode(NodeLockKind kind): BenchNode(kind) {}
+};
+
+// Complete tree stored breadth first in one block, so that with packed nodes
+// siblings share cache lines
+class BenchTree {
+	private:
+		char* block;
+		size_t node_size;
+		int size;
+	public:
+		BenchTree(NodeLockKind kind, bool padded) {
+			size = 0;
+			for (int level = 0, width = 1; level <= DEPTH; level++, width *= BRANCHING) {
+				size += width;
+			}
+			node_size = padded ? sizeof(PaddedBenchNode) : sizeof(BenchNode);
+			block = (char*) cache_aligned_alloc(size * node_size);
+			for (int i = 0; i < size; i++) {
+				if (padded) {
+					new (block + i * node_size) PaddedBenchNode(kind);
+				} else {
+					new (block + i * node_size) BenchNode(kind);
+				}
+			}
+		}
+		~BenchTree() {
+			for (int i = 0; i < size; i++) {
+				this->node(i)->~BenchNode();
+			}
+			free(block);
+		}
+		BenchNode* node(int i) {
+			return (BenchNode*) (block + i * node_size);
+		}
+};
+
+// Picks the child of parent with the highest UCB, reading each under its lock
+int select_child(BenchTree& tree, int parent, unsigned int* seed) {
+	BenchNode* node = tree.node(parent);
+	node->lock.lock();
+	int parent_visits = node->visits;
+	node->lock.unlock();
+	int best = -1;
+	float best_ucb = -INFINITY;
+	for (int c = parent * BRANCHING + 1; c <= parent * BRANCHING + BRANCHING; c++) {
+		BenchNode* child = tree.node(c);
+		child->lock.lock();
+		float ucb = child->visits == 0 ? INFINITY
+			: child->reward / child->visits + sqrt(2 * log(max(parent_visits, 1)) / child->visits);
+		child->lock.unlock();
+		// Random tie-breaking spreads threads over unvisited children
+		if (ucb > best_ucb || (ucb == best_ucb && rand_r(seed) % 2)) {
+			best_ucb = ucb;
+			best = c;
+		}
+	}
+	return best;
+}
+
+// Busy work standing in for a rollout
+unsigned int rollout(int work, unsigned int x) {
+	for (int i = 0; i < work; i++) {
+		x ^= x << 13;
+		x ^= x >> 17;
+		x ^= x << 5;
+	}
+	return x;
+}
+
+// Iterations per second of threads sharing one tree for seconds
+double iterations_per_second(NodeLockKind kind, bool padded, int threads, int work, double seconds) {
+	BenchTree tree(kind, padded);
+	long iterations = 0;
+	double start, cpu;
+	timing(&start, &cpu);
+	#pragma omp parallel num_threads(threads) reduction(+:iterations)
+	{
+		unsigned int seed = omp_get_thread_num() + 1;
+		unsigned int sink = seed;
+		double now = start;
+		int path[DEPTH + 1];
+		while (now - start < seconds) {
+			// Check the clock every few iterations only
+			for (int k = 0; k < 16; k++) {
+				path[0] = 0;
+				for (int level = 1; level <= DEPTH; level++) {
+					path[level] = select_child(tree, path[level - 1], &seed);
+				}
+				sink = rollout(work, sink);
+				float reward = rand_r(&seed) % 2;
+				for (int level = 0; level <= DEPTH; level++) {
+					BenchNode* node = tree.node(path[level]);
+					node->lock.lock();
+					node->visits++;
+					node->reward += reward;
+					node->lock.unlock();
+				}
+				iterations++;
+			}
+			timing(&now, &cpu);
+		}
+		// Keep the busy work from being optimized away
+		if (sink == 0) {
+			printf(" ");
+		}
+	}
+	double end;
+	timing(&end, &cpu);
+	return iterations / (end - start);
+}
+
+vector<string> split_list(const string& list) {
+	vector<string> items;
+	size_t pos = 0;
+	while (pos <= list.size()) {
+		size_t comma = list.find(',', pos);
+		if (comma == string::npos) {
+			comma = list.size();
+		}
+		if (comma > pos) {
+			items.push_back(list.substr(pos, comma - pos));
+		}
+		pos = comma + 1;
+	}
+	return items;
+}
+
+void usage() {
+	cout << "Usage: ./lock_bench [Options]" << endl;
+	cout << "\t--locks=<list>       node locks to measure (default omp,spin,ticket and on Linux futex)" << endl;
+	cout << "\t--threads=<list>     thread counts (default 1,2,4,8)" << endl;
+	cout << "\t--work=<list>        busy work per rollout, 0 for pure contention (default 0,2000)" << endl;
+	cout << "\t--seconds=<s>        time per measurement (default 0.2)" << endl;
+	exit(-1);
+}
+
+int main(int argc, char* argv[]) {
+	vector<NodeLockKind> kinds = {LOCK_OMP, LOCK_SPIN, LOCK_TICKET};
+#ifdef __linux__
+	kinds.push_back(LOCK_FUTEX);
+#endif
+	vector<int> thread_counts = {1, 2, 4, 8};
+	vector<int> works = {0, 2000};
+	double seconds = 0.2;
+	for (int i = 1; i < argc; i++) {
+		const char* eq = strchr(argv[i], '=');
+		if (strncmp(argv[i], "--", 2) || eq == NULL) {
+			usage();
+		}
+		string name(argv[i] + 2, eq - argv[i] - 2);
+		string value(eq + 1);
+		if (name == "locks") {
+			kinds.clear();
+			for (string& l: split_list(value)) {
+				NodeLockKind kind;
+				if (!parse_node_lock(l, &kind)) {
+					usage();
+				}
+				kinds.push_back(kind);
+			}
+		} else if (name == "threads") {
+			thread_counts.clear();
+			for (string& t: split_list(value)) {
+				thread_counts.push_back(atoi(t.c_str()));
+			}
+		} else if (name == "work") {
+			works.clear();
+			for (string& w: split_list(value)) {
+				works.push_back(atoi(w.c_str()));
+			}
+		} else if (name == "seconds") {
+			seconds = atof(value.c_str());
+		} else {
+			usage();
+		}
+	}
+	if (kinds.empty() || thread_counts.empty() || works.empty() || seconds <= 0) {
+		usage();
+	}
+
+	printf("%-8s %-8s %8s %8s %14s\n", "lock", "layout", "threads", "work", "iterations/s");
+	for (int work: works) {
+		for (int threads: thread_counts) {
+			for (NodeLockKind kind: kinds) {
+				for (bool padded: {false, true}) {
+					double ips = iterations_per_second(kind, padded, threads, work, seconds);
+					printf("%-8s %-8s %8d %8d %14.0f\n", node_lock_name(kind), padded ? "padded" : "packed",
+						threads, work, ips);
+					fflush(stdout);
+				}
+			}
+		}
+	}
+	return 0;
+}
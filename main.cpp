@@ -1,46 +1,66 @@
 #include <string.h>
 
 #include <cstdlib>
+#include <iomanip>
 #include <iostream>
+#include <string>
 #include <vector>
 using namespace std;
 
 #include "game.h"
-#include "mcts_serial.h"
 #include "connect_four.h"
-#include "mcts_leaf_parallel.h"
-#include "mcts_root_parallel.h"
-#include "mcts_tgm_parallel.h"
-#include "mcts_tnm_parallel.h"
+#include "hex.h"
+#include "connect_four_solver.h"
+#include "connect_four_prior.h"
+#include "rollout_policy.h"
+#include "evaluator.h"
+#include "time_manager.h"
+#include "agent_registry.h"
+
+// Own moves in a long game, for the time manager
+#define CONNECT_FOUR_EXPECTED_MOVES (ROWS * COLS / 2)
+#define HEX_EXPECTED_MOVES (40)
 
 class RandomAgent: public Agent {
-	pair<Move*,int> best_move(Position* pos, float time_limit) override {
-		vector<Move*> poss_moves = pos->possible_moves();
-		Move* rand_move = poss_moves[rand() % poss_moves.size()];
-		return make_pair(rand_move, 0);
-	}
+	private:
+		unsigned int seed;
+	public:
+		RandomAgent(unsigned int seed): seed(seed) {}
+
+		pair<Move*,int> best_move(Position* pos, float /* time_limit */) override {
+			vector<Move*> poss_moves = pos->possible_moves();
+			Move* rand_move = poss_moves[rand_r(&seed) % poss_moves.size()];
+			return make_pair(rand_move, 0);
+		}
 
-	void reset() override {}
+		void reset() override {}
 };
 
-void compare_agents(Game* game, Agent* a1, Agent* a2, int test_games, float epsilon, float time_limit) {
+// Agents with a game clock in clocks search for the time it allots, the others for time_limit
+void compare_agents(Game* game, Agent* a1, Agent* a2, int test_games, float epsilon, float time_limit, TimeManager* clocks[2]) {
 	float p0_wins = 0;
 	pair<int, int> a1_iter = make_pair(0, 0);
 	pair<int, int> a2_iter = make_pair(0, 0);
+	int flags[2] = {0, 0};
 	for (int i = 0; i < test_games; i++) {
 		Position* pos = game->new_game();
+		for (int a = 0; a < 2; a++) {
+			if (clocks[a] != NULL) {
+				clocks[a]->new_game();
+			}
+		}
 		while (!pos->is_terminal()) {
 			float r = (float) rand() / RAND_MAX;
 			Move* move;
 			if (r < epsilon) {
 				// Use strategy here
 				if (pos->whose_turn() == 0) {
-					pair<Move*, int> res = a1->best_move(pos, time_limit);
+					pair<Move*, int> res = clocks[0] != NULL ? clocks[0]->search(a1, pos) : a1->best_move(pos, time_limit);
 					move = res.first;
 					a1_iter.first += res.second;
 					a1_iter.second++;
 				} else {
-					pair<Move*, int> res = a2->best_move(pos, time_limit);
+					pair<Move*, int> res = clocks[1] != NULL ? clocks[1]->search(a2, pos) : a2->best_move(pos, time_limit);
 					move = res.first;
 					a2_iter.first += res.second;
 					a2_iter.second++;
@@ -52,9 +72,21 @@ void compare_agents(Game* game, Agent* a1, Agent* a2, int test_games, float epsi
 			}
 			// Move to next position
 			pos = pos->make_move(move);
+			// Whoever just moved can think on the opponent's time
+			if (!pos->is_terminal()) {
+				Agent* mover = pos->whose_turn() == 1 ? a1 : a2;
+				mover->start_pondering(pos);
+			}
 		}
 		p0_wins += pos->payoff();
+		for (int a = 0; a < 2; a++) {
+			if (clocks[a] != NULL && clocks[a]->flagged()) {
+				flags[a]++;
+			}
+		}
 		// Reset agent cache
+		a1->stop_pondering();
+		a2->stop_pondering();
 		a1->reset();
 		a2->reset();
 	}
@@ -64,58 +96,182 @@ void compare_agents(Game* game, Agent* a1, Agent* a2, int test_games, float epsi
 	float a2_avg_iter = (float) a2_iter.first / a2_iter.second;
 	printf("Agent 1 Average MCTS Iterations: %f\n", a1_avg_iter);
 	printf("Agent 2 Average MCTS Iterations: %f\n", a2_avg_iter);
+	for (int a = 0; a < 2; a++) {
+		if (clocks[a] != NULL) {
+			printf("Agent %d clock: %f s used per game, out of time in %d games\n", a + 1,
+				clocks[a]->total_time_used() / test_games, flags[a]);
+		}
+	}
+}
+
+void usage(const AgentRegistry& registry) {
+	cout << "Usage: ./mcts_connect_four [Options] <Agent 1> <Agent 2> <Test games> <Epsilon> <Time limit> [Report interval]" << endl;
+	cout << "Valid agents are:" << endl;
+	registry.print(cout);
+	cout << "With a report interval (seconds), MCTS agents write search snapshots to stderr as JSON lines" << endl;
+	cout << "Options set both agents with --name=value, or one agent with --1.name=value or --2.name=value" << endl;
+	cout << "--config=<file> reads options from a file of name = value lines" << endl;
+	cout << "--game=<name> plays connect_four (the default) or hex (11x11)" << endl;
+	cout << "\t" << left << setw(22) << "clock" << "seconds on the agent's game clock, spread over its moves in place of the time limit" << endl;
+	cout << "\t" << left << setw(22) << "increment" << "seconds added to the game clock after every move" << endl;
+	cout << "\t" << left << setw(22) << "solver" << "use the exact endgame solver" << endl;
+	cout << "\t" << left << setw(22) << "priors" << "select with PUCT and static Connect Four move priors" << endl;
+	print_config_options(cout);
+	exit(-1);
+}
+
+// Applies one option to the agents it names
+void apply_option(const string& name, const string& value, MctsConfig configs[2], bool use_solver[2], bool use_priors[2],
+		double clocks[2], double increments[2]) {
+	int first = 0;
+	int last = 1;
+	string key = name;
+	if (name.size() > 2 && (name[0] == '1' || name[0] == '2') && name[1] == '.') {
+		first = last = name[0] - '1';
+		key = name.substr(2);
+	}
+	for (int a = first; a <= last; a++) {
+		bool ok;
+		if (key == "solver") {
+			ok = parse_bool(value, &use_solver[a]);
+		} else if (key == "priors") {
+			ok = parse_bool(value, &use_priors[a]);
+		} else if (key == "clock") {
+			ok = parse_double(value, &clocks[a]) && clocks[a] >= 0;
+		} else if (key == "increment") {
+			ok = parse_double(value, &increments[a]) && increments[a] >= 0;
+		} else {
+			ok = set_config_option(&configs[a], key, value);
+		}
+		if (!ok) {
+			cout << "Invalid option: " << name << "=" << value << endl;
+			exit(-1);
+		}
+	}
 }
 
 int main(int argc, char* argv[]) {
-	if (argc != 6) {
-		cout << "Usage: ./mcts_connect_four <Agent 1> <Agent 2> <Test games> <Epsilon> <Time limit>" << endl;
-		cout << "Valid agents are:" << endl;
-		cout << "\t- random" << endl;
-		cout << "\t- serial" << endl;
-		cout << "\t- leaf (Leaf Rollout Parallelization)" << endl;
-		cout << "\t- tgm (Tree Global Mutex Parallelization)" << endl;
-		cout << "\t- tnm (Tree Node Mutex Parallelization)" << endl;
-		exit(-1);
+	AgentRegistry registry = builtin_agents();
+	registry.add("random", "Random", [](const MctsConfig& config) -> Agent* {
+		return new RandomAgent(config.seed);
+	});
+
+	// Options may appear anywhere, everything else is positional
+	MctsConfig configs[2];
+	bool use_solver[2] = {false, false};
+	bool use_priors[2] = {false, false};
+	string game_name = "connect_four";
+	double clocks[2] = {0, 0};
+	double increments[2] = {0, 0};
+	vector<char*> args;
+	for (int i = 1; i < argc; i++) {
+		if (strncmp(argv[i], "--", 2)) {
+			args.push_back(argv[i]);
+			continue;
+		}
+		string name, value;
+		if (!parse_option(argv[i], &name, &value)) {
+			usage(registry);
+		}
+		if (name == "game") {
+			game_name = value;
+		} else if (name == "config") {
+			vector<pair<string, string>> options;
+			string error;
+			if (!read_config_file(value, &options, &error)) {
+				cout << error << endl;
+				exit(-1);
+			}
+			for (auto& option: options) {
+				apply_option(option.first, option.second, configs, use_solver, use_priors, clocks, increments);
+			}
+		} else {
+			apply_option(name, value, configs, use_solver, use_priors, clocks, increments);
+		}
+	}
+	if (args.size() != 5 && args.size() != 6) {
+		usage(registry);
 	}
 	
-	Game* connect_four = new ConnectFourGame();
+	Game* game;
+	if (game_name == "connect_four") {
+		game = new ConnectFourGame();
+	} else if (game_name == "hex") {
+		game = new HexGame();
+	} else {
+		cout << "Invalid game: " << game_name << endl;
+		exit(-1);
+	}
 	
 	// Initialize hyper-parameters
-	int test_games = atoi(argv[3]);
-	float epsilon = atof(argv[4]);
-	float time_limit = atof(argv[5]);
+	int test_games = atoi(args[2]);
+	float epsilon = atof(args[3]);
+	float time_limit = atof(args[4]);
 	cout << "Simulating " << test_games << " games" << endl;
 	cout << "Epsilon: " << epsilon << endl;
 	cout << "Time limit for each MCTS run: " << time_limit << endl;
+	for (int a = 0; a < 2; a++) {
+		if (clocks[a] > 0) {
+			cout << "Game clock of player " << a << ": " << clocks[a] << " s + " << increments[a] << " s per move" << endl;
+		}
+	}
+
+	// Optional live search telemetry
+	NdjsonListener listener(stderr);
+	ConnectFourSolver solver;
+	ConnectFourPrior prior;
+	// Hex fills the board in one go instead of playing random moves through Position
+	HexRolloutPolicy hex_policy;
+	RolloutEvaluator hex_evaluator(&hex_policy);
+	TimeManager* managers[2] = {NULL, NULL};
+	for (int a = 0; a < 2; a++) {
+		if (game_name == "hex") {
+			if (configs[a].rollout_policy != ROLLOUT_RANDOM) {
+				cout << "Invalid options for agent " << a + 1 << ": rollout_policy is for connect_four" << endl;
+				exit(-1);
+			}
+			configs[a].evaluator = &hex_evaluator;
+		} else if (configs[a].rollout_policy != ROLLOUT_RANDOM) {
+			configs[a].evaluator = new RolloutEvaluator(new_rollout_policy(configs[a].rollout_policy, configs[a].rollout_depth));
+		}
+		if (args.size() == 6) {
+			configs[a].listener = &listener;
+			configs[a].report_interval = atof(args[5]);
+		}
+		// The clock reads the root of every search, and passes reports on to stderr
+		if (clocks[a] > 0) {
+			int expected_moves = game_name == "hex" ? HEX_EXPECTED_MOVES : CONNECT_FOUR_EXPECTED_MOVES;
+			managers[a] = new TimeManager(clocks[a], increments[a], expected_moves, configs[a].listener);
+			configs[a].listener = managers[a];
+			if (args.size() != 6) {
+				// Final reports only
+				configs[a].report_interval = INFINITY;
+			}
+		}
+		if (use_solver[a]) {
+			configs[a].solver = &solver;
+		}
+		if (use_priors[a]) {
+			configs[a].prior = &prior;
+		}
+	}
 	
 	// Initialize agents from command line
 	Agent* agents[2];
 	for (int a = 0; a < 2; a++) {
+		string error;
+		if (!registry.check(args[a], configs[a], &error)) {
+			cout << "Invalid options for agent " << a + 1 << ": " << error << endl;
+			exit(-1);
+		}
 		cout << "Player " << a << ": ";
-		if (!strcmp(argv[1+a], "random")) {
-			agents[a] = new RandomAgent();
-			cout << "Random" << endl;
-		} else if (!strcmp(argv[1+a], "serial")) {
-			agents[a] = new MctsAgentSerial();
-			cout << "Serial MCTS" << endl;
-		} else if (!strcmp(argv[1+a], "leaf")) {
-			agents[a] = new MctsAgentLeafParallel();
-			cout << "Leaf Parallel MCTS" << endl;
-		} else if (!strcmp(argv[1+a], "root")) {
-			agents[a] = new MctsAgentRootParallel();
-			cout << "Root Parallel MCTS" << endl;
-		} else if (!strcmp(argv[1+a], "tgm")) {
-			agents[a] = new MctsAgentTgmParallel();
-			cout << "Tree Global Mutex Parallel MCTS" << endl;
-		} else if (!strcmp(argv[1+a], "tnm")) {
-			agents[a] = new MctsAgentTnmParallel();
-			cout << "Tree Node Mutex Parallel MCTS" << endl;
-		} else {
-			cout << "Invalid input: " << argv[1+a];
+		agents[a] = registry.create(args[a], configs[a]);
+		if (agents[a] == NULL) {
+			cout << "Invalid input: " << args[a];
 			exit(-1);
 		}
+		cout << registry.label(args[a]) << endl;
 	}
 
-	compare_agents(connect_four, agents[0], agents[1], test_games, epsilon, time_limit);
+	compare_agents(game, agents[0], agents[1], test_games, epsilon, time_limit, managers);
 }
-
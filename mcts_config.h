@@ -0,0 +1,203 @@
+#ifndef MCTS_CONFIG_H
+#define MCTS_CONFIG_H
+
+#include <omp.h>
+
+#include <climits>
+#include <cmath>
+#include <vector>
+using namespace std;
+
+#include "affinity.h"
+#include "evaluator.h"
+#include "move_prior.h"
+#include "node_lock.h"
+#include "ponder.h"
+#include "rave.h"
+#include "solver.h"
+#include "telemetry.h"
+
+// Proven value of a node that has not been solved yet
+// Solved nodes store the exact payoff for player 0 (0, 0.5 or 1)
+#define UNPROVEN (-1)
+
+// Time limit of searches that are bounded by an iteration count instead
+#define UNBOUNDED_TIME (1e6)
+
+// Ranks a proven payoff against win ratios when choosing the final move:
+// proven wins beat any ratio and proven losses lose to any ratio
+inline float proven_ratio(float proven) {
+	if (proven == 1) {
+		return 2;
+	}
+	if (proven == 0) {
+		return -1;
+	}
+	return proven;
+}
+
+// Options shared by the MCTS agents
+struct MctsConfig {
+	// Exploration constant of UCB
+	float ucb_constant;
+	// Score an unvisited child gets in selection, as a win ratio for the player choosing it
+	// INFINITY means every move is tried once before any child is revisited
+	float first_play_urgency;
+	// Static move priors, which switch selection from UCB to PUCT (NULL means none)
+	MovePrior* prior;
+	// Exploration constant of PUCT
+	float puct_constant;
+	// Rollouts run in parallel on each leaf by the leaf agent
+	int rollouts;
+	// Threads used by the parallel agents (0 means one per CPU in cpus, or the OpenMP default)
+	int num_threads;
+	// CPUs the agent's threads run on (empty means any)
+	vector<int> cpus;
+	// Pin each thread to a single CPU
+	bool pin_threads;
+	// Keep the tree between moves so the subtree of the new position is reused
+	bool tree_reuse;
+	// Memory budget: stop a search once it has added this many nodes to the tree
+	// (0 means no budget); nodes kept from earlier moves with tree_reuse do not count
+	long max_nodes;
+	// Iterations per search (0 means as many as the time limit allows)
+	long max_iterations;
+	// Reproducible searches: the same position and seed give the same tree and move
+	// on every run, which turns off the time limit, early stopping, pondering and
+	// asynchronous evaluation; needs max_iterations (AgentRegistry::check)
+	bool deterministic;
+	// First seed of the agent's random number streams
+	unsigned int seed;
+	// How leaves are evaluated (NULL means random rollouts)
+	Evaluator* evaluator;
+	// Connect Four rollouts the tools build evaluator from, and the moves after
+	// which they stop and score the board (0 means play to the end)
+	RolloutPolicyKind rollout_policy;
+	int rollout_depth;
+	// Leaves evaluated together by the asynchronous batcher (serial, tgm and tnm agents)
+	// 1 means leaves are evaluated synchronously inside the search loop
+	int eval_batch;
+	// Maximum number of leaves awaiting evaluation at once, shared by all threads (0 means twice eval_batch)
+	int eval_in_flight;
+	// Seconds the batcher waits for a batch to fill up
+	double eval_wait;
+	// Descents the serial agent interleaves, so that each one's cache misses
+	// overlap with the others' work (1 means one descent at a time, as the
+	// other agents always do)
+	int interleave;
+	// Exact endgame solver (NULL means none)
+	Solver* solver;
+	// Solve the root instead of searching when it has at most this many empty slots
+	int solver_root_empty;
+	// Solve leaves with at most this many empty slots (0 means never)
+	int solver_leaf_empty;
+	// Progressive widening: a node visited n times may have up to
+	// ceil(widening_constant * n^widening_exponent) children
+	// 0 means every move is tried once before any child is revisited
+	float widening_constant;
+	float widening_exponent;
+	// RAVE: blend each edge's all-moves-as-first value into UCB, which gives useful
+	// estimates after far fewer iterations (serial, tgm and tnm agents)
+	bool rave;
+	// Edge visits at which the edge's own value and its AMAF value get the same weight
+	float rave_equivalence;
+	// Receives snapshots of the search while it runs (NULL means none)
+	SearchListener* listener;
+	// Seconds between snapshots
+	double report_interval;
+	// Longest principal variation reported
+	int report_pv;
+	// Stop searching once the most visited root move can no longer be overtaken
+	bool early_stop;
+	// Seconds between early stopping checks
+	double early_stop_interval;
+	// Search in the background between moves when asked to ponder
+	bool ponder;
+	// Lock of each node in the tnm agent
+	NodeLockKind node_lock;
+	// tnm readers copy a node through its seqlock instead of taking its lock
+	bool lock_free_reads;
+
+	MctsConfig(): ucb_constant(2), first_play_urgency(INFINITY), prior(NULL), puct_constant(1.5), rollouts(20), num_threads(0), pin_threads(false), tree_reuse(true), max_nodes(0),
+		max_iterations(0), deterministic(false), seed(0),
+		evaluator(NULL), rollout_policy(ROLLOUT_RANDOM), rollout_depth(0), eval_batch(1), eval_in_flight(0), eval_wait(0.0005), interleave(1),
+		solver(NULL), solver_root_empty(20), solver_leaf_empty(0),
+		widening_constant(0), widening_exponent(0.5), rave(false), rave_equivalence(500),
+		listener(NULL), report_interval(0.1), report_pv(8),
+		early_stop(false), early_stop_interval(0.01), ponder(false), node_lock(LOCK_OMP), lock_free_reads(false) {}
+
+	int threads() const {
+		if (num_threads > 0) {
+			return num_threads;
+		}
+		return cpus.empty() ? omp_get_max_threads() : cpus.size();
+	}
+	// Moves the calling thread onto the agent's CPUs
+	// Called at the start of every parallel region since agents share the OpenMP threads
+	void place(int thread_num) const {
+		place_thread(cpus, pin_threads, thread_num);
+	}
+	// Limits of a search of time_limit seconds
+	SearchControl search_control(float time_limit) const {
+		SearchControl control(time_limit);
+		control.max_nodes = max_nodes;
+		control.max_iterations = max_iterations;
+		if (deterministic && max_iterations > 0) {
+			control.time_limit = UNBOUNDED_TIME;
+		}
+		return control;
+	}
+	// True if leaves go to an asynchronous batcher, which would make the tree depend on timing
+	bool batches_evaluations() const {
+		return eval_batch > 1 && !deterministic;
+	}
+	int max_in_flight() const {
+		return eval_in_flight > 0 ? eval_in_flight : 2 * eval_batch;
+	}
+	// Gives up once control would stop a search started at start, which then searches instead
+	bool solve_root(Position* pos, float* payoff, Move** best, const SearchControl& control, double start) const {
+		return solver != NULL && solver->solve(pos, solver_root_empty, payoff, best, control, start);
+	}
+	bool solve_leaf(Position* pos, float* payoff) const {
+		return solver != NULL && solver_leaf_empty > 0 && solver->solve(pos, solver_leaf_empty, payoff, NULL);
+	}
+	// True if the runner-up root move could not catch up with the best one even if
+	// every remaining iteration went to it, at the rate searched so far
+	bool can_stop_early(int best_visits, int second_visits, long iterations, double elapsed, float time_limit) const {
+		if (!early_stop || deterministic || elapsed <= 0) {
+			return false;
+		}
+		double remaining = (time_limit - elapsed) * iterations / elapsed;
+		return best_visits - second_visits > remaining;
+	}
+	// Selection score of a child for the player choosing it
+	// value is the child's win ratio for that player, ignored if the edge was never visited
+	// prior is the edge's prior, negative without priors
+	float selection_score(float value, int edge_visits, int parent_visits, float prior) const {
+		if (edge_visits == 0) {
+			if (first_play_urgency == INFINITY) {
+				return INFINITY;
+			}
+			value = first_play_urgency;
+		}
+		// PUCT: exploration follows the prior and fades as the edge is visited
+		if (prior >= 0) {
+			return value + puct_constant * prior * sqrt((float) parent_visits) / (1 + edge_visits);
+		}
+		// An unvisited child is explored as if it had been visited once
+		return value + sqrt(ucb_constant * log(max(parent_visits, 1)) / max(edge_visits, 1));
+	}
+	// RAVE equivalence passed to selection, 0 when RAVE is off
+	float amaf_equivalence() const {
+		return rave ? rave_equivalence : 0;
+	}
+	// Number of children a node with the given visits may have
+	int widening_limit(int visits) const {
+		if (widening_constant <= 0) {
+			return INT_MAX;
+		}
+		return max(1, (int) ceil(widening_constant * pow((float) visits, widening_exponent)));
+	}
+};
+
+#endif
@@ -10,9 +10,13 @@ using namespace std;
 #include "timing.h"
 #include "mcts_leaf_parallel.h"
 
-#define ROLLOUTS (20)
+MctsNodeLeafParallel::MctsNodeLeafParallel(Position* p): reward(0), visits(0), proven(UNPROVEN), am_leaf(true), pos(p), children(vector<child_info_lp>()) {}
 
-MctsNodeLeafParallel::MctsNodeLeafParallel(Position* p): pos(p), reward(0), visits(0), children(vector<child_info_lp>()) {}
+MctsNodeLeafParallel::~MctsNodeLeafParallel() {
+	for (Move* move: untried) {
+		delete move;
+	}
+}
 
 // Accessor functions
 float MctsNodeLeafParallel::get_reward() {
@@ -24,11 +28,12 @@ int MctsNodeLeafParallel::get_visits() {
 }
 
 bool MctsNodeLeafParallel::is_leaf() {
-	return children.empty();
+	return am_leaf;
 }
 
-void MctsNodeLeafParallel::add_child(MctsNodeLeafParallel* new_child) {
+void MctsNodeLeafParallel::add_child(MctsNodeLeafParallel* new_child, float prior) {
 	children.push_back(make_pair(new_child, make_pair(0, 0)));
+	priors.push_back(prior);
 }
 
 void MctsNodeLeafParallel::inc_reward(float delta) {
@@ -39,45 +44,144 @@ void MctsNodeLeafParallel::inc_visits(float delta) {
 	visits += delta;
 }
 
-void MctsNodeLeafParallel::expand(pos_map_lp_t* pos_map) {
-	// Get next possible moves
-	vector<Move*> next_moves = pos->possible_moves();
-	for (Move* move: next_moves) {
-		// See subsequent positions and either locate corresponding node already in tree
+bool MctsNodeLeafParallel::is_proven() {
+	return proven != UNPROVEN;
+}
+
+float MctsNodeLeafParallel::get_proven() {
+	return proven;
+}
+
+void MctsNodeLeafParallel::set_proven(float value) {
+	proven = value;
+}
+
+// A node is solved once the player to move has a child proven to win
+// or once every child is solved
+// Returns whether the node is solved
+bool MctsNodeLeafParallel::update_proven() {
+	if (this->is_proven()) {
+		return true;
+	}
+	if (children.empty()) {
+		return false;
+	}
+	// Payoff that is a win for the player to move
+	float win = pos->whose_turn() == 0 ? 1 : 0;
+	// Moves that were never tried could still be better
+	bool all_proven = untried.empty();
+	float best_value = UNPROVEN;
+	for (child_info_lp child: children) {
+		if (!child.first->is_proven()) {
+			all_proven = false;
+			continue;
+		}
+		float value = child.first->get_proven();
+		if (value == win) {
+			proven = win;
+			return true;
+		}
+		// A draw beats a loss
+		if (best_value == UNPROVEN || value == 0.5) {
+			best_value = value;
+		}
+	}
+	if (all_proven) {
+		proven = best_value;
+	}
+	return all_proven;
+}
+
+// Children are created lazily: expanding only generates the moves
+// and expand_child turns them into children when selection asks for one
+// With priors, the most likely moves become children first
+void MctsNodeLeafParallel::expand(MovePrior* prior) {
+	untried = pos->possible_moves();
+	if (prior != NULL) {
+		untried_priors = prior->priors(pos, untried);
+		sort_by_prior(untried, untried_priors);
+	}
+	am_leaf = false;
+}
+
+// True if there is a move left to try and the node may have another child
+bool MctsNodeLeafParallel::can_widen(int max_children) {
+	return !untried.empty() && children.size() < max_children;
+}
+
+// Creates the child for the next untried move and returns it
+// Returns NULL if the remaining moves only reach children we already have
+MctsNodeLeafParallel* MctsNodeLeafParallel::expand_child(pos_map_lp_t* pos_map) {
+	while (!untried.empty()) {
+		Move* move = untried.back();
+		untried.pop_back();
+		float prior = -1;
+		if (!untried_priors.empty()) {
+			prior = untried_priors.back();
+			untried_priors.pop_back();
+		}
+		// See subsequent position and either locate corresponding node already in tree
 		// or insert into tree
+		// Mirror images of a position share one node
 		Position* new_pos = pos->make_move(move);
-		if (pos_map->find(new_pos->get_vec()) == pos_map->end()) {
+		delete move;
+		vector<int> key = new_pos->get_canonical_vec();
+		auto it = pos_map->find(key);
+		if (it == pos_map->end()) {
 			MctsNodeLeafParallel* new_child = new MctsNodeLeafParallel(new_pos);
-			pos_map->insert(make_pair(new_pos->get_vec(), new_child));
+			it = pos_map->insert(make_pair(key, new_child)).first;
+		} else {
+			delete new_pos;
+		}
+		// Symmetric moves reach the same child, keep a single edge to it
+		// that carries the priors of both
+		bool duplicate = false;
+		for (int j = 0; j < children.size(); j++) {
+			if (children[j].first == it->second) {
+				duplicate = true;
+				if (prior >= 0) {
+					priors[j] += prior;
+				}
+				break;
+			}
 		}
 		// Add subsequent node as child of current node
-		this->add_child(pos_map->find(new_pos->get_vec())->second);
+		if (!duplicate) {
+			this->add_child(it->second, prior);
+			return it->second;
+		}
 	}
+	return NULL;
 }
 
-float MctsNodeLeafParallel::calc_ucb2_child(child_info_lp child){
+float MctsNodeLeafParallel::calc_ucb2_child(child_info_lp child, float prior, const MctsConfig& config){
 	int edge_visits = child.second.second;
 	MctsNodeLeafParallel* child_node = child.first;
-	// If node has never been visited before
+	// If node has never been visited before, it is scored by first play urgency
 	if (edge_visits == 0 || child_node->get_visits() == 0) {
-		return INFINITY;
+		return config.selection_score(0, 0, this->get_visits(), prior);
 	}
 	float exploit = (float) child_node->get_reward() / (float) child_node->get_visits();
-	float explore = sqrt(UCB_CONSTANT * log(this->get_visits()) / edge_visits);
-	// Player 0 views results favorably while player 1 wants to negate it
+	// Player 0 views results favorably while player 1 wants to minimize them
+	// The child's turn is the opponent of the player choosing it
 	if (child_node->pos->whose_turn() == 0) {
-		return exploit + explore;
-	} 
-	return -1.0 * exploit + explore;
+		exploit = 1 - exploit;
+	}
+	return config.selection_score(exploit, edge_visits, this->get_visits(), prior);
 }
 
-// Calculate UCB for each node
-// Return the node that maximizes UCB
-MctsNodeLeafParallel* MctsNodeLeafParallel::select_child() {
+// Calculate UCB (PUCT with priors) for each node
+// Return the node that maximizes it
+MctsNodeLeafParallel* MctsNodeLeafParallel::select_child(const MctsConfig& config, unsigned int* seed) {
 	float max_ucb = -INFINITY;
 	vector<MctsNodeLeafParallel*> optimal_children;
-	for (child_info_lp child: this->children) {
-		float child_ucb = this->calc_ucb2_child(child);
+	for (int j = 0; j < this->children.size(); j++) {
+		child_info_lp child = this->children[j];
+		// Solved children need no more search
+		if (child.first->is_proven()) {
+			continue;
+		}
+		float child_ucb = this->calc_ucb2_child(child, priors[j], config);
 		if (child_ucb == INFINITY) {
 			return child.first;
 		}
@@ -89,49 +193,152 @@ MctsNodeLeafParallel* MctsNodeLeafParallel::select_child() {
 			optimal_children.push_back(child.first);
 		}
 	}
-	int rand_idx = rand() % optimal_children.size();
+	// Every child was solved through another parent
+	// The next back propagation will mark this node as solved too
+	if (optimal_children.empty()) {
+		return this->children[0].first;
+	}
+	int rand_idx = rand_r(seed) % optimal_children.size();
 	return optimal_children[rand_idx];
 }
 
-// Assumes that caller has at least one child
-MctsNodeLeafParallel* MctsNodeLeafParallel::select_first_child() {
-	return this->children[0].first;
+// True if selection should try the next untried move instead of revisiting a child
+// Always the case while first play urgency is infinite, otherwise the move must
+// score at least as high as every child
+bool MctsNodeLeafParallel::prefers_untried(const MctsConfig& config) {
+	float prior = untried_priors.empty() ? -1 : untried_priors.back();
+	float untried_score = config.selection_score(0, 0, this->get_visits(), prior);
+	if (untried_score == INFINITY) {
+		return true;
+	}
+	for (int j = 0; j < children.size(); j++) {
+		if (!children[j].first->is_proven() && this->calc_ucb2_child(children[j], priors[j], config) > untried_score) {
+			return false;
+		}
+	}
+	return true;
 }
 
-MctsAgentLeafParallel::MctsAgentLeafParallel() {}
+// Visits along the two most visited edges
+void MctsNodeLeafParallel::top_two_visits(int* best, int* second) {
+	*best = 0;
+	*second = 0;
+	for (child_info_lp child: children) {
+		int edge_visits = child.second.second;
+		if (edge_visits > *best) {
+			*second = *best;
+			*best = edge_visits;
+		} else if (edge_visits > *second) {
+			*second = edge_visits;
+		}
+	}
+}
+
+// Snapshot of the search for telemetry
+static SearchInfo snapshot(SearchReporter& reporter, Position* p, pos_map_lp_t* pos_map, long iterations, double elapsed) {
+	node_lookup_t lookup = [pos_map](const vector<int>& key, int* visits, float* reward) {
+		auto it = pos_map->find(key);
+		if (it == pos_map->end()) {
+			return false;
+		}
+		*visits = it->second->get_visits();
+		*reward = it->second->get_reward();
+		return true;
+	};
+	size_t tree_bytes = estimate_tree_bytes(pos_map->size(), sizeof(MctsNodeLeafParallel), p->get_vec().size());
+	return reporter.snapshot(p, lookup, pos_map->size(), tree_bytes, iterations, elapsed);
+}
+
+MctsAgentLeafParallel::MctsAgentLeafParallel(MctsConfig config): config(config) {
+	evaluator = config.evaluator != NULL ? config.evaluator : &rollout_evaluator;
+}
 
 // time_limit is in seconds
 pair<Move*,int> MctsAgentLeafParallel::best_move(Position* p, float time_limit) {
+	return this->best_move(p, config.search_control(time_limit));
+}
+
+pair<Move*,int> MctsAgentLeafParallel::best_move(Position* p, const SearchControl& control) {
+	// Whatever was searched while pondering stays in the tree
+	ponderer.stop();
+	// Unless every search starts from scratch
+	if (!config.tree_reuse) {
+		this->reset();
+	}
+	return this->search(p, control);
+}
+
+// Grows the tree under p until the next best_move
+void MctsAgentLeafParallel::start_pondering(Position* p) {
+	// A background search would make the tree depend on timing
+	if (!config.ponder || config.deterministic) {
+		return;
+	}
+	SearchControl control = config.search_control(PONDER_TIME_LIMIT);
+	control.stop = ponderer.get_stop_flag();
+	ponderer.start([this, p, control]() {
+		this->search(p, control);
+	});
+}
+
+void MctsAgentLeafParallel::stop_pondering() {
+	ponderer.stop();
+}
+
+pair<Move*,int> MctsAgentLeafParallel::search(Position* p, const SearchControl& control) {
 	double wc_time, cpu_time;
 	timing(&wc_time, &cpu_time);
 	double start = wc_time;
 
+	// Near the end of the game the exact solver is much faster than searching
+	float solved_payoff;
+	Move* solved_move;
+	if (config.solve_root(p, &solved_payoff, &solved_move, control, start)) {
+		return make_pair(solved_move, 0);
+	}
+
 	// Look up node in search tree or create new one
 	MctsNodeLeafParallel* pos_node;
-	if (pos_map.find(p->get_vec()) != pos_map.end()) {
-		pos_node = pos_map.find(p->get_vec())->second;
+	if (pos_map.find(p->get_canonical_vec()) != pos_map.end()) {
+		pos_node = pos_map.find(p->get_canonical_vec())->second;
 	} else {
 		pos_node = new MctsNodeLeafParallel(p);
-		pos_map.insert(make_pair(p->get_vec(), pos_node));
+		pos_map.insert(make_pair(p->get_canonical_vec(), pos_node));
 	}
 
-	unsigned int seeds[ROLLOUTS];
-	for (int i = 0; i < ROLLOUTS; i++) {
-		seeds[i] = i;
+	// One random number stream per rollout, so results do not depend on
+	// which thread runs it, and one to break ties while traversing
+	vector<unsigned int> seeds(config.rollouts);
+	for (int i = 0; i < config.rollouts; i++) {
+		seeds[i] = config.seed + i;
 	}
+	unsigned int seed = config.seed + config.rollouts;
 
+	SearchReporter reporter(config.listener, config.report_interval, config.report_pv);
+	// Only nodes this search adds count against the node cap, not those kept from earlier moves
+	long start_nodes = pos_map.size();
 	int iterations = 0;
 	double elapsed = 0.0;
-	// Continue search algorithm while time_limit is not complete
-	while (elapsed < time_limit) {
+	double next_check = 0.0;
+	// Continue search algorithm until a limit in control is reached
+	// and while the position is not solved
+	while (!control.should_stop(elapsed, iterations, pos_map.size() - start_nodes) && !pos_node->is_proven()) {
 		// Start at base node
 		MctsNodeLeafParallel* leaf_node = pos_node;
 		vector<MctsNodeLeafParallel*> path;
 		path.push_back(pos_node);
 
 		// Traverse tree until we reach a leaf by picking child with highest UCB
+		// or a node that may try a new move
+		MctsNodeLeafParallel* new_child = NULL;
 		while (!leaf_node->is_leaf()) {
-			leaf_node = leaf_node->select_child();
+			if (leaf_node->can_widen(config.widening_limit(leaf_node->get_visits())) && leaf_node->prefers_untried(config)) {
+				new_child = leaf_node->expand_child(&pos_map);
+				if (new_child != NULL) {
+					break;
+				}
+			}
+			leaf_node = leaf_node->select_child(config, &seed);
 			path.push_back(leaf_node);
 		}
 
@@ -143,58 +350,73 @@ pair<Move*,int> MctsAgentLeafParallel::best_move(Position* p, float time_limit)
 		// If game over, we have reached terminal node
 		if (leaf_node->pos->is_terminal()) {
 			rollout_reward = leaf_node->pos->payoff();
+			leaf_node->set_proven(rollout_reward);
 			iterations++;
 		}
 		// If not game over, then we need to expand and rollout
 		else {
 			// Get the node to rollout from
 			MctsNodeLeafParallel* playout_node;
-			if (leaf_node->get_visits() == 0) {
+			if (new_child != NULL) {
+				playout_node = new_child;
+				path.push_back(playout_node);
+			} else if (leaf_node->get_visits() == 0) {
 				playout_node = leaf_node;
 			} else {
-				leaf_node->expand(&pos_map);
-				playout_node = leaf_node->select_first_child();
+				leaf_node->expand(config.prior);
+				playout_node = leaf_node->expand_child(&pos_map);
 				path.push_back(playout_node);
 			}
 			
 			Position* curr_pos = playout_node->pos; 
+			rollout_reward = 0;
 			
-			// ** BEGIN PARALLEL SECTION **
-			// Rollout
-			#pragma omp parallel \
-				shared(rollout_reward, seeds) \
-				firstprivate(curr_pos) \
-				default(none)
-			{
-				// Parrallelize leaf rollouts here
-				// Do dynamic scheduling because rollout may be different complexity
-				#pragma omp for schedule(runtime)
-				for (int r = 0; r < ROLLOUTS; r++) {
-					// Rollout
-					while (!curr_pos->is_terminal()) {
-						vector<Move*> poss_moves = curr_pos->possible_moves();
-						// Generate random number from seed corresponding to rollout number
-						Move* next_move = poss_moves[rand_r(&(seeds[r])) % poss_moves.size()];
-						curr_pos = curr_pos->make_move(next_move);
+			// Shallow enough to solve exactly, no rollouts needed
+			if (config.solve_leaf(curr_pos, &rollout_reward)) {
+				playout_node->set_proven(rollout_reward);
+				rollout_visits = 1;
+				iterations++;
+			} else {
+				int rollouts_done = 0;
+				// ** BEGIN PARALLEL SECTION **
+				// Rollout
+				#pragma omp parallel \
+					num_threads(config.threads()) \
+					shared(rollout_reward, rollouts_done, seeds, curr_pos, control, start) \
+					default(none)
+				{
+					config.place(omp_get_thread_num());
+
+					// Parrallelize leaf rollouts here
+					// Do dynamic scheduling because rollout may be different complexity
+					#pragma omp for schedule(runtime)
+					for (int r = 0; r < config.rollouts; r++) {
+						// Skip the remaining rollouts once the search has to stop
+						double now, cpu;
+						timing(&now, &cpu);
+						if (control.should_stop(now - start, 0, 0)) {
+							continue;
+						}
+						// Generate random numbers from seed corresponding to rollout number
+						float value = evaluator->evaluate(curr_pos, &(seeds[r]));
+						#pragma omp atomic update
+						rollout_reward += value;
+						#pragma omp atomic update
+						rollouts_done++;
 					}
-					//printf("%d\n", omp_get_thread_num());
-					// Now at terminal state
-					#pragma omp atomic update
-					rollout_reward += 1;
 				}
+				// ** END PARALLEL SECTION **
+				
+				rollout_visits = rollouts_done;
+				// Count multiple rollouts as multiple iterations
+				iterations += rollouts_done;
 			}
-			// ** END PARALLEL SECTION **
-			
-			rollout_visits = ROLLOUTS;
-			// Count multiple rollouts as multiple iterations
-			iterations += ROLLOUTS;
 		}
 
 		// Back propagate
 		for (int i = 0; i < path.size(); i++) {
 			MctsNodeLeafParallel* node = path[i];
 			//printf("Path[%d] = %p\n", i, node);
-			Position* node_pos = node->pos;
 			node->inc_visits(rollout_visits);
 			node->inc_reward(rollout_reward);
 			// Update edge info
@@ -211,23 +433,60 @@ pair<Move*,int> MctsAgentLeafParallel::best_move(Position* p, float time_limit)
 			}
 		}
 
+		// Solved results can only change along the path we took, from the bottom up
+		for (int i = path.size() - 1; i >= 0; i--) {
+			if (!path[i]->update_proven()) {
+				break;
+			}
+		}
+
 		// Update elapsed time
 		timing(&wc_time, &cpu_time);
 		elapsed = wc_time - start;
+
+		// Report progress
+		if (reporter.due(elapsed)) {
+			reporter.report(snapshot(reporter, p, &pos_map, iterations, elapsed));
+		}
+
+		// Stop once the most visited move can no longer be overtaken
+		if (config.early_stop && elapsed >= next_check) {
+			next_check = elapsed + config.early_stop_interval;
+			int best_visits, second_visits;
+			pos_node->top_two_visits(&best_visits, &second_visits);
+			if (config.can_stop_early(best_visits, second_visits, iterations, elapsed, control.time_limit)) {
+				break;
+			}
+		}
 	}	
+	if (reporter.enabled()) {
+		SearchInfo info = snapshot(reporter, p, &pos_map, iterations, elapsed);
+		info.final = true;
+		reporter.report(info);
+	}
 
 	// Choose best action
 	float max_ratio = -INFINITY;
 	Move* best_move = NULL;
-	for (Move* move: p->possible_moves()) {
+	vector<Move*> moves = p->possible_moves();
+	for (Move* move: moves) {
 		Position* next_pos = p->make_move(move);
-		MctsNodeLeafParallel* next_node = pos_map.find(next_pos->get_vec())->second;	
+		// Child may not exist yet if the search was very short
+		if (pos_map.find(next_pos->get_canonical_vec()) == pos_map.end()) {
+			continue;
+		}
+		MctsNodeLeafParallel* next_node = pos_map.find(next_pos->get_canonical_vec())->second;	
 		// printf("%p: (%f, %d)\n", next_node, next_node->get_reward(), next_node->get_visits());
 		// move->print();
-		if (next_node->get_visits() == 0) {
+		float curr_ratio;
+		// Solved children are ranked by their exact value
+		if (next_node->is_proven()) {
+			curr_ratio = proven_ratio(next_node->get_proven());
+		} else if (next_node->get_visits() == 0) {
 			continue;
+		} else {
+			curr_ratio = (float) next_node->get_reward() / (float) next_node->get_visits();
 		}
-		float curr_ratio = (float) next_node->get_reward() / (float) next_node->get_visits();
 		// Player 1 wants least number of wins for player 0
 		if (p->whose_turn() == 1) {
 			curr_ratio *= -1.0;
@@ -237,10 +496,19 @@ pair<Move*,int> MctsAgentLeafParallel::best_move(Position* p, float time_limit)
 			best_move = move;
 		}
 	}
+	// Nothing was searched, any legal move will do
+	if (best_move == NULL) {
+		best_move = moves[0];
+	}
 	return make_pair(best_move, iterations);
 }
 
+pos_map_lp_t* MctsAgentLeafParallel::get_pos_map() {
+	return &pos_map;
+}
+
 void MctsAgentLeafParallel::reset() {
+	ponderer.stop();
 	for (auto it: pos_map) {
 		// Delete node
 		delete it.second;
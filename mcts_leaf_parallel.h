@@ -7,30 +7,47 @@
 using namespace std;
 
 #include "game.h"
+#include "mcts_config.h"
 
-#define UCB_CONSTANT (2)
 
 // Node in computation tree to represent positions
 class MctsNodeLeafParallel {
 	private:
 		float reward;
 		int visits;
+		// Exact payoff once the node is solved, UNPROVEN otherwise
+		float proven;
+		bool am_leaf;
+		// Moves that have not been turned into children yet
+		vector<Move*> untried;
+		// Priors of the untried moves, in the same order (empty without priors)
+		vector<float> untried_priors;
 	public:
 		Position* pos;
 		vector<pair<MctsNodeLeafParallel*, pair<float, int>>> children;
+		// Prior of each edge, in the same order as children (-1 without priors)
+		vector<float> priors;
 		// Functions
 		MctsNodeLeafParallel(Position* p);
+		~MctsNodeLeafParallel();
 		float get_reward();
 		int get_visits();
 		bool is_leaf();
 		int get_player();
-		void add_child(MctsNodeLeafParallel* new_child);
+		void add_child(MctsNodeLeafParallel* new_child, float prior);
 		void inc_reward(float delta);
 		void inc_visits(float delta);
-		void expand(unordered_map<vector<int>, MctsNodeLeafParallel*, pos_hash>* pos_map);
-		float calc_ucb2_child(pair<MctsNodeLeafParallel*, pair<float, int>> child);
-		MctsNodeLeafParallel* select_child();
-		MctsNodeLeafParallel* select_first_child();
+		bool is_proven();
+		float get_proven();
+		void set_proven(float value);
+		bool update_proven();
+		void expand(MovePrior* prior);
+		bool can_widen(int max_children);
+		bool prefers_untried(const MctsConfig& config);
+		MctsNodeLeafParallel* expand_child(unordered_map<vector<int>, MctsNodeLeafParallel*, pos_hash>* pos_map);
+		float calc_ucb2_child(pair<MctsNodeLeafParallel*, pair<float, int>> child, float prior, const MctsConfig& config);
+		MctsNodeLeafParallel* select_child(const MctsConfig& config, unsigned int* seed);
+		void top_two_visits(int* best, int* second);
 };
 
 typedef pair<MctsNodeLeafParallel*, pair<float,int>> child_info_lp;
@@ -38,11 +55,22 @@ typedef unordered_map<vector<int>, MctsNodeLeafParallel*, pos_hash> pos_map_lp_t
 
 class MctsAgentLeafParallel: public Agent {
 	private:
+		MctsConfig config;
+		Evaluator* evaluator;
+		RolloutEvaluator rollout_evaluator;
 		pos_map_lp_t pos_map;
+		// Background search between moves, declared last so it stops before the tree goes away
+		Ponderer ponderer;
+		pair<Move*,int> search(Position* p, const SearchControl& control);
 	public:
-		MctsAgentLeafParallel();
+		MctsAgentLeafParallel(MctsConfig config = MctsConfig());
 		pair<Move*,int> best_move(Position* p, float time_limit);
+		pair<Move*,int> best_move(Position* p, const SearchControl& control) override;
 		void reset();
+		// Search tree for tests and tools, not to be used while a search is running
+		pos_map_lp_t* get_pos_map();
+		void start_pondering(Position* p) override;
+		void stop_pondering() override;
 };
 
 #endif
@@ -2,6 +2,7 @@
 #include <stdlib.h>
 #include <time.h>
 
+#include <algorithm>
 #include <cmath>
 #include <iostream>
 #include <vector>
@@ -10,7 +11,13 @@ using namespace std;
 #include "timing.h"
 #include "mcts_root_parallel.h"
 
-MctsNodeRootParallel::MctsNodeRootParallel(Position* p): pos(p), reward(0), visits(0), children(vector<child_info_rp>()) {}
+MctsNodeRootParallel::MctsNodeRootParallel(Position* p): reward(0), visits(0), proven(UNPROVEN), am_leaf(true), pos(p), children(vector<child_info_rp>()) {}
+
+MctsNodeRootParallel::~MctsNodeRootParallel() {
+	for (Move* move: untried) {
+		delete move;
+	}
+}
 
 // Accessor functions
 float MctsNodeRootParallel::get_reward() {
@@ -22,11 +29,12 @@ int MctsNodeRootParallel::get_visits() {
 }
 
 bool MctsNodeRootParallel::is_leaf() {
-	return children.empty();
+	return am_leaf;
 }
 
-void MctsNodeRootParallel::add_child(MctsNodeRootParallel* new_child) {
+void MctsNodeRootParallel::add_child(MctsNodeRootParallel* new_child, float prior) {
 	children.push_back(make_pair(new_child, make_pair(0.0, 0)));
+	priors.push_back(prior);
 }
 
 void MctsNodeRootParallel::inc_reward(float delta) {
@@ -37,45 +45,144 @@ void MctsNodeRootParallel::inc_visits(float delta) {
 	visits += delta;
 }
 
-void MctsNodeRootParallel::expand(pos_map_rp_t* pos_map) {
-	// Get next possible moves
-	vector<Move*> next_moves = pos->possible_moves();
-	for (Move* move: next_moves) {
-		// See subsequent positions and either locate corresponding node already in tree
+bool MctsNodeRootParallel::is_proven() {
+	return proven != UNPROVEN;
+}
+
+float MctsNodeRootParallel::get_proven() {
+	return proven;
+}
+
+void MctsNodeRootParallel::set_proven(float value) {
+	proven = value;
+}
+
+// A node is solved once the player to move has a child proven to win
+// or once every child is solved
+// Returns whether the node is solved
+bool MctsNodeRootParallel::update_proven() {
+	if (this->is_proven()) {
+		return true;
+	}
+	if (children.empty()) {
+		return false;
+	}
+	// Payoff that is a win for the player to move
+	float win = pos->whose_turn() == 0 ? 1 : 0;
+	// Moves that were never tried could still be better
+	bool all_proven = untried.empty();
+	float best_value = UNPROVEN;
+	for (child_info_rp child: children) {
+		if (!child.first->is_proven()) {
+			all_proven = false;
+			continue;
+		}
+		float value = child.first->get_proven();
+		if (value == win) {
+			proven = win;
+			return true;
+		}
+		// A draw beats a loss
+		if (best_value == UNPROVEN || value == 0.5) {
+			best_value = value;
+		}
+	}
+	if (all_proven) {
+		proven = best_value;
+	}
+	return all_proven;
+}
+
+// Children are created lazily: expanding only generates the moves
+// and expand_child turns them into children when selection asks for one
+// With priors, the most likely moves become children first
+void MctsNodeRootParallel::expand(MovePrior* prior) {
+	untried = pos->possible_moves();
+	if (prior != NULL) {
+		untried_priors = prior->priors(pos, untried);
+		sort_by_prior(untried, untried_priors);
+	}
+	am_leaf = false;
+}
+
+// True if there is a move left to try and the node may have another child
+bool MctsNodeRootParallel::can_widen(int max_children) {
+	return !untried.empty() && children.size() < max_children;
+}
+
+// Creates the child for the next untried move and returns it
+// Returns NULL if the remaining moves only reach children we already have
+MctsNodeRootParallel* MctsNodeRootParallel::expand_child(pos_map_rp_t* pos_map) {
+	while (!untried.empty()) {
+		Move* move = untried.back();
+		untried.pop_back();
+		float prior = -1;
+		if (!untried_priors.empty()) {
+			prior = untried_priors.back();
+			untried_priors.pop_back();
+		}
+		// See subsequent position and either locate corresponding node already in tree
 		// or insert into tree
+		// Mirror images of a position share one node
 		Position* new_pos = pos->make_move(move);
-		if (pos_map->find(new_pos->get_vec()) == pos_map->end()) {
+		delete move;
+		vector<int> key = new_pos->get_canonical_vec();
+		auto it = pos_map->find(key);
+		if (it == pos_map->end()) {
 			MctsNodeRootParallel* new_child = new MctsNodeRootParallel(new_pos);
-			pos_map->insert(make_pair(new_pos->get_vec(), new_child));
+			it = pos_map->insert(make_pair(key, new_child)).first;
+		} else {
+			delete new_pos;
+		}
+		// Symmetric moves reach the same child, keep a single edge to it
+		// that carries the priors of both
+		bool duplicate = false;
+		for (int j = 0; j < children.size(); j++) {
+			if (children[j].first == it->second) {
+				duplicate = true;
+				if (prior >= 0) {
+					priors[j] += prior;
+				}
+				break;
+			}
 		}
 		// Add subsequent node as child of current node
-		this->add_child(pos_map->find(new_pos->get_vec())->second);
+		if (!duplicate) {
+			this->add_child(it->second, prior);
+			return it->second;
+		}
 	}
+	return NULL;
 }
 
-float MctsNodeRootParallel::calc_ucb2_child(child_info_rp child){
+float MctsNodeRootParallel::calc_ucb2_child(child_info_rp child, float prior, const MctsConfig& config){
 	int edge_visits = child.second.second;
 	MctsNodeRootParallel* child_node = child.first;
-	// If node has never been visited before
+	// If node has never been visited before, it is scored by first play urgency
 	if (edge_visits == 0 || child_node->get_visits() == 0) {
-		return INFINITY;
+		return config.selection_score(0, 0, this->get_visits(), prior);
 	}
 	float exploit = (float) child_node->get_reward() / (float) child_node->get_visits();
-	float explore = sqrt(UCB_CONSTANT * log(this->get_visits()) / edge_visits);
-	// Player 0 views results favorably while player 1 wants to negate it
+	// Player 0 views results favorably while player 1 wants to minimize them
+	// The child's turn is the opponent of the player choosing it
 	if (child_node->pos->whose_turn() == 0) {
-		return exploit + explore;
-	} 
-	return -1.0 * exploit + explore;
+		exploit = 1 - exploit;
+	}
+	return config.selection_score(exploit, edge_visits, this->get_visits(), prior);
 }
 
-// Calculate UCB for each node
-// Return the node that maximizes UCB
-MctsNodeRootParallel* MctsNodeRootParallel::select_child(unsigned int* seed) {
+// Calculate UCB (PUCT with priors) for each node
+// Return the node that maximizes it
+MctsNodeRootParallel* MctsNodeRootParallel::select_child(const MctsConfig& config, unsigned int* seed) {
 	float max_ucb = -INFINITY;
 	vector<MctsNodeRootParallel*> optimal_children;
-	for (child_info_rp child: this->children) {
-		float child_ucb = this->calc_ucb2_child(child);
+	for (int j = 0; j < this->children.size(); j++) {
+		child_info_rp child = this->children[j];
+		// Solved children need no more search
+		if (child.first->is_proven()) {
+			continue;
+		}
+		float child_ucb = this->calc_ucb2_child(child, priors[j], config);
 		if (child_ucb == INFINITY) {
 			return child.first;
 		}
@@ -87,22 +194,83 @@ MctsNodeRootParallel* MctsNodeRootParallel::select_child(unsigned int* seed) {
 			optimal_children.push_back(child.first);
 		}
 	}
+	// Every child was solved through another parent
+	// The next back propagation will mark this node as solved too
+	if (optimal_children.empty()) {
+		return this->children[0].first;
+	}
 	int rand_idx = rand_r(seed) % optimal_children.size();
 	return optimal_children[rand_idx];
 }
 
-// Assumes that caller has at least one child
-MctsNodeRootParallel* MctsNodeRootParallel::select_first_child() {
-	return this->children[0].first;
+// True if selection should try the next untried move instead of revisiting a child
+// Always the case while first play urgency is infinite, otherwise the move must
+// score at least as high as every child
+bool MctsNodeRootParallel::prefers_untried(const MctsConfig& config) {
+	float prior = untried_priors.empty() ? -1 : untried_priors.back();
+	float untried_score = config.selection_score(0, 0, this->get_visits(), prior);
+	if (untried_score == INFINITY) {
+		return true;
+	}
+	for (int j = 0; j < children.size(); j++) {
+		if (!children[j].first->is_proven() && this->calc_ucb2_child(children[j], priors[j], config) > untried_score) {
+			return false;
+		}
+	}
+	return true;
 }
 
-MctsAgentRootParallel::MctsAgentRootParallel() {}
+// Visits along the two most visited edges
+void MctsNodeRootParallel::top_two_visits(int* best, int* second) {
+	*best = 0;
+	*second = 0;
+	for (child_info_rp child: children) {
+		int edge_visits = child.second.second;
+		if (edge_visits > *best) {
+			*second = *best;
+			*best = edge_visits;
+		} else if (edge_visits > *second) {
+			*second = edge_visits;
+		}
+	}
+}
+
+// Snapshot of the search for telemetry
+static SearchInfo snapshot(SearchReporter& reporter, Position* p, pos_map_rp_t* pos_map, long iterations, double elapsed) {
+	node_lookup_t lookup = [pos_map](const vector<int>& key, int* visits, float* reward) {
+		auto it = pos_map->find(key);
+		if (it == pos_map->end()) {
+			return false;
+		}
+		*visits = it->second->get_visits();
+		*reward = it->second->get_reward();
+		return true;
+	};
+	size_t tree_bytes = estimate_tree_bytes(pos_map->size(), sizeof(MctsNodeRootParallel), p->get_vec().size());
+	return reporter.snapshot(p, lookup, pos_map->size(), tree_bytes, iterations, elapsed);
+}
+
+MctsAgentRootParallel::MctsAgentRootParallel(MctsConfig config): config(config) {
+	evaluator = config.evaluator != NULL ? config.evaluator : &rollout_evaluator;
+}
 
 // time_limit is in seconds
 pair<Move*,int> MctsAgentRootParallel::best_move(Position* p, float time_limit) {
+	return this->best_move(p, config.search_control(time_limit));
+}
+
+pair<Move*,int> MctsAgentRootParallel::best_move(Position* p, const SearchControl& control) {
 	double wc_time, cpu_time;
 	timing(&wc_time, &cpu_time);
 	double start = wc_time;
+
+	// Near the end of the game the exact solver is much faster than searching
+	float solved_payoff;
+	Move* solved_move;
+	if (config.solve_root(p, &solved_payoff, &solved_move, control, start)) {
+		return make_pair(solved_move, 0);
+	}
+
 	int iterations = 0;
 
 	// Scores of children that we aggregate from parallel processes
@@ -112,33 +280,54 @@ pair<Move*,int> MctsAgentRootParallel::best_move(Position* p, float time_limit)
 		next_positions.push_back(p->make_move(move));
 	}
 	vector<pair<float, int>> scores = vector<pair<float, int>>(poss_moves.size(), make_pair(0.0, 0));
+	// Exact values of children solved in any thread's tree
+	vector<float> proven = vector<float>(poss_moves.size(), UNPROVEN);
+
+	SearchReporter reporter(config.listener, config.report_interval, config.report_pv);
+	// Master thread's view of its own tree at the end of the search
+	SearchInfo final_info;
 
 	#pragma omp parallel \
-		shared(p, start, iterations, time_limit, scores, next_positions) \
+		num_threads(config.threads()) \
+		shared(p, start, iterations, control, scores, proven, next_positions, reporter, final_info) \
 		private(wc_time, cpu_time) \
 		default(none)
 	{
+		config.place(omp_get_thread_num());
+
 		// Each thread needs it own tree
 		pos_map_rp_t pos_map;
 		MctsNodeRootParallel* pos_node = new MctsNodeRootParallel(p);
-		pos_map.insert(make_pair(p->get_vec(), pos_node));
+		pos_map.insert(make_pair(p->get_canonical_vec(), pos_node));
 
 		// Each thread should get its own random seed
-		unsigned int seed = omp_get_thread_num();
+		unsigned int seed = config.seed + omp_get_thread_num();
 
 		double elapsed = 0.0;
+		double next_check = 0.0;
 		int my_iterations = 0;
 
-		// Continue search algorithm while time_limit is not complete
-		while (elapsed < time_limit) {
+		// Continue search algorithm until a limit in control is reached
+		// and while the position is not solved
+		// Each tree gets an even share of the iteration and node caps
+		while (!control.should_stop(elapsed, (long) my_iterations * omp_get_num_threads(),
+			(long) pos_map.size() * omp_get_num_threads()) && !pos_node->is_proven()) {
 			// Start at base node
 			MctsNodeRootParallel* leaf_node = pos_node;
 			vector<MctsNodeRootParallel*> path;
 			path.push_back(pos_node);
 
 			// Traverse tree until we reach a leaf by picking child with highest UCB
+			// or a node that may try a new move
+			MctsNodeRootParallel* new_child = NULL;
 			while (!leaf_node->is_leaf()) {
-				leaf_node = leaf_node->select_child(&seed);
+				if (leaf_node->can_widen(config.widening_limit(leaf_node->get_visits())) && leaf_node->prefers_untried(config)) {
+					new_child = leaf_node->expand_child(&pos_map);
+					if (new_child != NULL) {
+						break;
+					}
+				}
+				leaf_node = leaf_node->select_child(config, &seed);
 				path.push_back(leaf_node);
 			}
 
@@ -149,28 +338,29 @@ pair<Move*,int> MctsAgentRootParallel::best_move(Position* p, float time_limit)
 			// If game over, we have reached terminal node
 			if (leaf_node->pos->is_terminal()) {
 				rollout_reward = leaf_node->pos->payoff();
+				leaf_node->set_proven(rollout_reward);
 			}
 			// If not game over, then we need to expand and rollout
 			else {
 				// Get the node to rollout from
 				MctsNodeRootParallel* playout_node;
-				if (leaf_node->get_visits() == 0) {
+				if (new_child != NULL) {
+					playout_node = new_child;
+					path.push_back(playout_node);
+				} else if (leaf_node->get_visits() == 0) {
 					playout_node = leaf_node;
 				} else {
-					leaf_node->expand(&pos_map);
-					playout_node = leaf_node->select_first_child();
+					leaf_node->expand(config.prior);
+					playout_node = leaf_node->expand_child(&pos_map);
 					path.push_back(playout_node);
 				}
 
-				// Rollout
-				Position* curr_pos = playout_node->pos; 	
-				while (!curr_pos->is_terminal()) {
-					vector<Move*> poss_moves = curr_pos->possible_moves();
-					Move* next_move = poss_moves[rand_r(&seed) % poss_moves.size()];
-					curr_pos = curr_pos->make_move(next_move);
+				// Evaluate, exactly if the leaf is shallow enough
+				if (config.solve_leaf(playout_node->pos, &rollout_reward)) {
+					playout_node->set_proven(rollout_reward);
+				} else {
+					rollout_reward = evaluator->evaluate(playout_node->pos, &seed);
 				}
-				// Now at terminal state
-				rollout_reward = curr_pos->payoff();			
 			}
 
 			my_iterations++;
@@ -179,7 +369,6 @@ pair<Move*,int> MctsAgentRootParallel::best_move(Position* p, float time_limit)
 			for (int i = 0; i < path.size(); i++) {
 				MctsNodeRootParallel* node = path[i];
 				//printf("Path[%d] = %p\n", i, node);
-				Position* node_pos = node->pos;
 				node->inc_visits(rollout_visits);
 				node->inc_reward(rollout_reward);
 				// Update edge info
@@ -196,25 +385,55 @@ pair<Move*,int> MctsAgentRootParallel::best_move(Position* p, float time_limit)
 				}
 			}
 
+			// Solved results can only change along the path we took, from the bottom up
+			for (int i = path.size() - 1; i >= 0; i--) {
+				if (!path[i]->update_proven()) {
+					break;
+				}
+			}
+
 			// Update elapsed time
 			timing(&wc_time, &cpu_time);
 			elapsed = wc_time - start;
+
+			// Master thread reports progress from its own tree
+			// Other threads search at about the same rate
+			if (omp_get_thread_num() == 0 && reporter.due(elapsed)) {
+				long all_iterations = (long) my_iterations * omp_get_num_threads();
+				reporter.report(snapshot(reporter, p, &pos_map, all_iterations, elapsed));
+			}
+
+			// Each thread stops once the most visited move in its tree can no longer be overtaken
+			if (config.early_stop && elapsed >= next_check) {
+				next_check = elapsed + config.early_stop_interval;
+				int best_visits, second_visits;
+				pos_node->top_two_visits(&best_visits, &second_visits);
+				if (config.can_stop_early(best_visits, second_visits, my_iterations, elapsed, control.time_limit)) {
+					break;
+				}
+			}
 		}
 		// All done with iterations
 		#pragma omp atomic update
 		iterations += my_iterations;
+		if (omp_get_thread_num() == 0 && reporter.enabled()) {
+			final_info = snapshot(reporter, p, &pos_map, my_iterations, elapsed);
+		}
 	
 		// Do root synchronization
 		for (int i = 0; i < next_positions.size(); i++) {
 			// Ensure entry exists
-			if (pos_map.find(next_positions[i]->get_vec()) == pos_map.end()) {
+			if (pos_map.find(next_positions[i]->get_canonical_vec()) == pos_map.end()) {
 				continue;	
 			}
-			MctsNodeRootParallel* next_node = pos_map.find(next_positions[i]->get_vec())->second;
+			MctsNodeRootParallel* next_node = pos_map.find(next_positions[i]->get_canonical_vec())->second;
 			#pragma omp critical
 			{
 				scores[i].first += next_node->get_reward();
 				scores[i].second += next_node->get_visits(); 
+				if (next_node->is_proven()) {
+					proven[i] = next_node->get_proven();
+				}
 			}
 		}
 
@@ -225,12 +444,43 @@ pair<Move*,int> MctsAgentRootParallel::best_move(Position* p, float time_limit)
 		pos_map.clear();
 	}
 
+	// Final report combines every thread's statistics of the root moves
+	if (reporter.enabled()) {
+		timing(&wc_time, &cpu_time);
+		final_info.elapsed = wc_time - start;
+		final_info.iterations = iterations;
+		final_info.root.clear();
+		for (int i = 0; i < poss_moves.size(); i++) {
+			if (scores[i].second == 0) {
+				continue;
+			}
+			RootMoveInfo info;
+			info.move = poss_moves[i]->to_string();
+			info.visits = scores[i].second;
+			info.value = scores[i].first / scores[i].second;
+			final_info.root.push_back(info);
+		}
+		stable_sort(final_info.root.begin(), final_info.root.end(), [](const RootMoveInfo& a, const RootMoveInfo& b) {
+			return a.visits > b.visits;
+		});
+		final_info.final = true;
+		reporter.report(final_info);
+	}
+
 	// Choose best action
 	float max_ratio = -INFINITY;
 	Move* best_move = NULL;
 	for (int i = 0; i < poss_moves.size(); i++) {
 		Move* move = poss_moves[i];
-		float curr_ratio = scores[i].first / scores[i].second;
+		float curr_ratio;
+		// Solved children are ranked by their exact value
+		if (proven[i] != UNPROVEN) {
+			curr_ratio = proven_ratio(proven[i]);
+		} else if (scores[i].second == 0) {
+			continue;
+		} else {
+			curr_ratio = scores[i].first / scores[i].second;
+		}
 		// Player 1 wants least number of wins for player 0
 		if (p->whose_turn() == 1) {
 			curr_ratio *= -1.0;
@@ -240,6 +490,10 @@ pair<Move*,int> MctsAgentRootParallel::best_move(Position* p, float time_limit)
 			best_move = move;
 		}
 	}
+	// Nothing was searched, any legal move will do
+	if (best_move == NULL) {
+		best_move = poss_moves[0];
+	}
 	return make_pair(best_move, iterations);
 }
 
@@ -7,39 +7,61 @@
 using namespace std;
 
 #include "game.h"
+#include "mcts_config.h"
 
-#define UCB_CONSTANT (2)
 
 // Node in computation tree to represent positions
 class MctsNodeRootParallel {
 	private:
 		float reward;
 		int visits;
+		// Exact payoff once the node is solved, UNPROVEN otherwise
+		float proven;
+		bool am_leaf;
+		// Moves that have not been turned into children yet
+		vector<Move*> untried;
+		// Priors of the untried moves, in the same order (empty without priors)
+		vector<float> untried_priors;
 	public:
 		Position* pos;
 		vector<pair<MctsNodeRootParallel*, pair<float, int>>> children;
+		// Prior of each edge, in the same order as children (-1 without priors)
+		vector<float> priors;
 		// Functions
 		MctsNodeRootParallel(Position* p);
+		~MctsNodeRootParallel();
 		float get_reward();
 		int get_visits();
 		bool is_leaf();
 		int get_player();
-		void add_child(MctsNodeRootParallel* new_child);
+		void add_child(MctsNodeRootParallel* new_child, float prior);
 		void inc_reward(float delta);
 		void inc_visits(float delta);
-		void expand(unordered_map<vector<int>, MctsNodeRootParallel*, pos_hash>* pos_map);
-		float calc_ucb2_child(pair<MctsNodeRootParallel*, pair<float, int>> child);
-		MctsNodeRootParallel* select_child(unsigned int* seed);
-		MctsNodeRootParallel* select_first_child();
+		bool is_proven();
+		float get_proven();
+		void set_proven(float value);
+		bool update_proven();
+		void expand(MovePrior* prior);
+		bool can_widen(int max_children);
+		bool prefers_untried(const MctsConfig& config);
+		MctsNodeRootParallel* expand_child(unordered_map<vector<int>, MctsNodeRootParallel*, pos_hash>* pos_map);
+		float calc_ucb2_child(pair<MctsNodeRootParallel*, pair<float, int>> child, float prior, const MctsConfig& config);
+		MctsNodeRootParallel* select_child(const MctsConfig& config, unsigned int* seed);
+		void top_two_visits(int* best, int* second);
 };
 
 typedef pair<MctsNodeRootParallel*, pair<float,int>> child_info_rp;
 typedef unordered_map<vector<int>, MctsNodeRootParallel*, pos_hash> pos_map_rp_t;
 
 class MctsAgentRootParallel: public Agent {
+	private:
+		MctsConfig config;
+		Evaluator* evaluator;
+		RolloutEvaluator rollout_evaluator;
 	public:
-		MctsAgentRootParallel();
+		MctsAgentRootParallel(MctsConfig config = MctsConfig());
 		pair<Move*,int> best_move(Position* p, float time_limit);
+		pair<Move*,int> best_move(Position* p, const SearchControl& control) override;
 		void reset();
 };
 
@@ -6,7 +6,13 @@ using namespace std;
 #include "timing.h"
 #include "mcts_serial.h"
 
-MctsNodeSerial::MctsNodeSerial(Position* p): pos(p), reward(0), visits(0), children(vector<child_info>()) {}
+MctsNodeSerial::MctsNodeSerial(Position* p): reward(0), visits(0), proven(UNPROVEN), am_leaf(true), player(p->whose_turn()), pos(p), children(vector<child_info>()) {}
+
+MctsNodeSerial::~MctsNodeSerial() {
+	for (Move* move: untried) {
+		delete move;
+	}
+}
 
 // Accessor functions
 float MctsNodeSerial::get_reward() {
@@ -18,11 +24,17 @@ int MctsNodeSerial::get_visits() {
 }
 
 bool MctsNodeSerial::is_leaf() {
-	return children.empty();
+	return am_leaf;
 }
 
-void MctsNodeSerial::add_child(MctsNodeSerial* new_child) {
+int MctsNodeSerial::get_player() {
+	return player;
+}
+
+void MctsNodeSerial::add_child(MctsNodeSerial* new_child, int key, bool mirrored, float prior) {
 	children.push_back(make_pair(new_child, make_pair(0.0, 0)));
+	amaf.push_back(AmafEdge(key, mirrored));
+	priors.push_back(prior);
 }
 
 void MctsNodeSerial::inc_reward(float delta) {
@@ -33,45 +45,159 @@ void MctsNodeSerial::inc_visits(float delta) {
 	visits += delta;
 }
 
-void MctsNodeSerial::expand(pos_map_t* pos_map) {
-	// Get next possible moves
-	vector<Move*> next_moves = pos->possible_moves();
-	for (Move* move: next_moves) {
-		// See subsequent positions and either locate corresponding node already in tree
+void MctsNodeSerial::update_edge(MctsNodeSerial* child, float reward_delta, int visits_delta) {
+	for (int j = 0; j < children.size(); j++) {
+		// This is the edge we traversed
+		if (children[j].first == child) {
+			children[j].second.first += reward_delta;
+			children[j].second.second += visits_delta;
+			break;
+		}
+	}
+}
+
+bool MctsNodeSerial::is_proven() {
+	return proven != UNPROVEN;
+}
+
+float MctsNodeSerial::get_proven() {
+	return proven;
+}
+
+void MctsNodeSerial::set_proven(float value) {
+	proven = value;
+}
+
+// A node is solved once the player to move has a child proven to win
+// or once every child is solved
+// Returns whether the node is solved
+bool MctsNodeSerial::update_proven() {
+	if (this->is_proven()) {
+		return true;
+	}
+	if (children.empty()) {
+		return false;
+	}
+	// Payoff that is a win for the player to move
+	float win = this->get_player() == 0 ? 1 : 0;
+	// Moves that were never tried could still be better
+	bool all_proven = untried.empty();
+	float best_value = UNPROVEN;
+	for (child_info child: children) {
+		if (!child.first->is_proven()) {
+			all_proven = false;
+			continue;
+		}
+		float value = child.first->get_proven();
+		if (value == win) {
+			proven = win;
+			return true;
+		}
+		// A draw beats a loss
+		if (best_value == UNPROVEN || value == 0.5) {
+			best_value = value;
+		}
+	}
+	if (all_proven) {
+		proven = best_value;
+	}
+	return all_proven;
+}
+
+// Children are created lazily: expanding only generates the moves
+// and expand_child turns them into children when selection asks for one
+// With priors, the most likely moves become children first
+void MctsNodeSerial::expand(MovePrior* prior) {
+	untried = pos->possible_moves();
+	if (prior != NULL) {
+		untried_priors = prior->priors(pos, untried);
+		sort_by_prior(untried, untried_priors);
+	}
+	am_leaf = false;
+}
+
+// True if there is a move left to try and the node may have another child
+bool MctsNodeSerial::can_widen(int max_children) {
+	return !untried.empty() && children.size() < max_children;
+}
+
+// Creates the child for the next untried move and returns it
+// Returns NULL if the remaining moves only reach children we already have
+MctsNodeSerial* MctsNodeSerial::expand_child(pos_map_t* pos_map) {
+	while (!untried.empty()) {
+		Move* move = untried.back();
+		untried.pop_back();
+		float prior = -1;
+		if (!untried_priors.empty()) {
+			prior = untried_priors.back();
+			untried_priors.pop_back();
+		}
+		// See subsequent position and either locate corresponding node already in tree
 		// or insert into tree
+		// Mirror images of a position share one node
 		Position* new_pos = pos->make_move(move);
-		if (pos_map->find(new_pos->get_vec()) == pos_map->end()) {
+		int move_key = pos->move_key(move);
+		delete move;
+		vector<int> key = new_pos->get_canonical_vec();
+		auto it = pos_map->find(key);
+		bool mirrored = false;
+		if (it == pos_map->end()) {
 			MctsNodeSerial* new_child = new MctsNodeSerial(new_pos);
-			pos_map->insert(make_pair(new_pos->get_vec(), new_child));
+			it = pos_map->insert(make_pair(key, new_child)).first;
+		} else {
+			mirrored = it->second->pos->get_vec() != new_pos->get_vec();
+			delete new_pos;
+		}
+		// Symmetric moves reach the same child, keep a single edge to it
+		// that carries the priors of both
+		bool duplicate = false;
+		for (int j = 0; j < children.size(); j++) {
+			if (children[j].first == it->second) {
+				duplicate = true;
+				if (prior >= 0) {
+					priors[j] += prior;
+				}
+				break;
+			}
 		}
 		// Add subsequent node as child of current node
-		this->add_child(pos_map->find(new_pos->get_vec())->second);
+		if (!duplicate) {
+			this->add_child(it->second, move_key, mirrored, prior);
+			return it->second;
+		}
 	}
+	return NULL;
 }
 
-float MctsNodeSerial::calc_ucb2_child(child_info child){
+float MctsNodeSerial::calc_ucb2_child(child_info child, const AmafEdge& amaf, float prior, const MctsConfig& config){
 	int edge_visits = child.second.second;
 	MctsNodeSerial* child_node = child.first;
-	// If node has never been visited before
+	// If node has never been visited before, it is scored by first play urgency
 	if (edge_visits == 0 || child_node->get_visits() == 0) {
-		return INFINITY;
+		return config.selection_score(0, 0, this->get_visits(), prior);
 	}
 	float exploit = (float) child_node->get_reward() / (float) child_node->get_visits();
-	float explore = sqrt(UCB_CONSTANT * log(this->get_visits()) / edge_visits);
-	// Player 0 views results favorably while player 1 wants to negate it
-	if (child_node->pos->whose_turn() == 0) {
-		return exploit + explore;
-	} 
-	return -1.0 * exploit + explore;
+	exploit = rave_value(exploit, edge_visits, amaf, config.amaf_equivalence());
+	// Player 0 views results favorably while player 1 wants to minimize them
+	// The child's turn is the opponent of the player choosing it
+	if (child_node->get_player() == 0) {
+		exploit = 1 - exploit;
+	}
+	return config.selection_score(exploit, edge_visits, this->get_visits(), prior);
 }
 
-// Calculate UCB for each node
-// Return the node that maximizes UCB
-MctsNodeSerial* MctsNodeSerial::select_child() {
+// Calculate UCB (PUCT with priors) for each node
+// Return the node that maximizes it
+MctsNodeSerial* MctsNodeSerial::select_child(const MctsConfig& config, unsigned int* seed) {
 	float max_ucb = -INFINITY;
 	vector<MctsNodeSerial*> optimal_children;
-	for (child_info child: this->children) {
-		float child_ucb = this->calc_ucb2_child(child);
+	for (int j = 0; j < this->children.size(); j++) {
+		child_info child = this->children[j];
+		// Solved children need no more search
+		if (child.first->is_proven()) {
+			continue;
+		}
+		float child_ucb = this->calc_ucb2_child(child, amaf[j], priors[j], config);
 		if (child_ucb == INFINITY) {
 			return child.first;
 		}
@@ -83,118 +209,495 @@ MctsNodeSerial* MctsNodeSerial::select_child() {
 			optimal_children.push_back(child.first);
 		}
 	}
-	int rand_idx = rand() % optimal_children.size();
+	// Every child was solved through another parent
+	// The next back propagation will mark this node as solved too
+	if (optimal_children.empty()) {
+		return this->children[0].first;
+	}
+	int rand_idx = rand_r(seed) % optimal_children.size();
 	return optimal_children[rand_idx];
 }
 
-// Assumes that caller has at least one child
-MctsNodeSerial* MctsNodeSerial::select_first_child() {
-	return this->children[0].first;
+// Adds the move made here towards next (NULL at the bottom of the path) to the
+// moves of a simulation, then credits reward to every edge whose move the player
+// to move made
+void MctsNodeSerial::update_amaf(MctsNodeSerial* next, AmafMoves& moves, float reward) {
+	int player = this->get_player();
+	for (int j = 0; j < children.size(); j++) {
+		if (children[j].first == next) {
+			// The moves below next were made in the frame of its stored position
+			if (amaf[j].mirrored) {
+				moves.mirror(pos);
+			}
+			moves.add(player, amaf[j].key);
+			break;
+		}
+	}
+	moves.update(amaf, player, reward);
+}
+
+// True if selection should try the next untried move instead of revisiting a child
+// Always the case while first play urgency is infinite, otherwise the move must
+// score at least as high as every child
+bool MctsNodeSerial::prefers_untried(const MctsConfig& config) {
+	float prior = untried_priors.empty() ? -1 : untried_priors.back();
+	float untried_score = config.selection_score(0, 0, this->get_visits(), prior);
+	if (untried_score == INFINITY) {
+		return true;
+	}
+	for (int j = 0; j < children.size(); j++) {
+		if (!children[j].first->is_proven() && this->calc_ucb2_child(children[j], amaf[j], priors[j], config) > untried_score) {
+			return false;
+		}
+	}
+	return true;
+}
+
+// Visits along the two most visited edges
+void MctsNodeSerial::top_two_visits(int* best, int* second) {
+	*best = 0;
+	*second = 0;
+	for (child_info child: children) {
+		int edge_visits = child.second.second;
+		if (edge_visits > *best) {
+			*second = *best;
+			*best = edge_visits;
+		} else if (edge_visits > *second) {
+			*second = edge_visits;
+		}
+	}
+}
+
+// Starts loading what selection at this node reads, one level of indirection per stage:
+// the edges (stage 0), then the child nodes they point to (stage 1)
+void MctsNodeSerial::prefetch(int stage) {
+	if (stage == 0) {
+		for (int j = 0; j < children.size(); j += CACHE_LINE_SIZE / sizeof(child_info)) {
+			__builtin_prefetch(&children[j]);
+		}
+		__builtin_prefetch(priors.data());
+		if (!amaf.empty()) {
+			__builtin_prefetch(amaf.data());
+		}
+	} else {
+		for (child_info& child: children) {
+			__builtin_prefetch(child.first);
+		}
+	}
+}
+
+// Find the next node to evaluate: traverse tree until we reach a leaf by picking
+// child with highest UCB, or a node that may try a new move, and expand it
+static MctsNodeSerial* descend(MctsNodeSerial* pos_node, vector<MctsNodeSerial*>& path, pos_map_t* pos_map, const MctsConfig& config, unsigned int* seed) {
+	MctsNodeSerial* leaf_node = pos_node;
+	path.push_back(pos_node);
+	while (!leaf_node->is_leaf()) {
+		if (leaf_node->can_widen(config.widening_limit(leaf_node->get_visits())) && leaf_node->prefers_untried(config)) {
+			MctsNodeSerial* new_child = leaf_node->expand_child(pos_map);
+			if (new_child != NULL) {
+				path.push_back(new_child);
+				return new_child;
+			}
+		}
+		leaf_node = leaf_node->select_child(config, seed);
+		path.push_back(leaf_node);
+	}
+	// If game over, we have reached terminal node
+	if (leaf_node->pos->is_terminal() || leaf_node->get_visits() == 0) {
+		return leaf_node;
+	}
+	leaf_node->expand(config.prior);
+	MctsNodeSerial* playout_node = leaf_node->expand_child(pos_map);
+	path.push_back(playout_node);
+	return playout_node;
+}
+
+static void backprop(vector<MctsNodeSerial*>& path, float rollout_reward, int rollout_visits) {
+	for (int i = 0; i < path.size(); i++) {
+		MctsNodeSerial* node = path[i];
+		node->inc_visits(rollout_visits);
+		node->inc_reward(rollout_reward);
+		// Update edge info
+		if (i != path.size() - 1) {
+			node->update_edge(path[i+1], rollout_reward, rollout_visits);
+		}
+	}
+}
+
+// Updates the all-moves-as-first statistics of the path from the bottom up,
+// with the moves the evaluator made after the last node in played
+static void backprop_amaf(vector<MctsNodeSerial*>& path, const vector<PlayedMove>& played, float rollout_reward) {
+	AmafMoves moves(played);
+	for (int i = path.size() - 1; i >= 0; i--) {
+		MctsNodeSerial* next = i != path.size() - 1 ? path[i+1] : NULL;
+		path[i]->update_amaf(next, moves, rollout_reward);
+	}
+}
+
+// Solved results can only change along the path we took, from the bottom up
+static void backprop_proof(vector<MctsNodeSerial*>& path) {
+	for (int i = path.size() - 1; i >= 0; i--) {
+		if (!path[i]->update_proven()) {
+			break;
+		}
+	}
+}
+
+// A virtual loss makes a pending path look like a loss for the player who chose each node
+// so that descents made while it is being evaluated spread out over the tree
+// Adds (sign 1) or removes (sign -1) it at node i of path and on the edge into it
+static void virtual_loss_at(vector<MctsNodeSerial*>& path, int i, int sign) {
+	MctsNodeSerial* node = path[i];
+	float loss = sign * (1.0 - node->get_player());
+	node->inc_visits(sign);
+	node->inc_reward(loss);
+	if (i != 0) {
+		path[i-1]->update_edge(node, loss, sign);
+	}
+}
+
+static void apply_virtual_loss(vector<MctsNodeSerial*>& path, int sign) {
+	for (int i = 0; i < path.size(); i++) {
+		virtual_loss_at(path, i, sign);
+	}
+}
+
+// Stages of an interleaved descent at each node: prefetch the edges,
+// prefetch the children, then choose where to go
+#define SELECT_STAGE (2)
+
+// Makes one descent into each path like descend does, switching between them
+// at every stage so that the memory each one waits for is loaded while the others run
+// Each node a descent reaches carries a virtual loss right away, so the descents
+// spread out over the tree; the caller removes them before back propagating
+// The first descent to reach a node nothing has evaluated claims it and stops there
+// to evaluate it, later ones treat it like any visited leaf and expand it
+static void descend_interleaved(MctsNodeSerial* pos_node, vector<vector<MctsNodeSerial*>>& paths, pos_map_t* pos_map, const MctsConfig& config, unsigned int* seed) {
+	vector<int> stage(paths.size(), 0);
+	// Node each descent claimed, NULL if none
+	vector<MctsNodeSerial*> claimed(paths.size(), NULL);
+	for (int d = 0; d < paths.size(); d++) {
+		if (pos_node->get_visits() == 0) {
+			claimed[d] = pos_node;
+		}
+		paths[d].push_back(pos_node);
+		virtual_loss_at(paths[d], 0, 1);
+	}
+	int active = paths.size();
+	while (active > 0) {
+		for (int d = 0; d < paths.size(); d++) {
+			vector<MctsNodeSerial*>& path = paths[d];
+			MctsNodeSerial* node = path.back();
+			if (stage[d] < 0) {
+				continue;
+			}
+			if (stage[d] < SELECT_STAGE && !node->is_leaf()) {
+				node->prefetch(stage[d]);
+				stage[d]++;
+				continue;
+			}
+			MctsNodeSerial* next = NULL;
+			bool finished = false;
+			if (!node->is_leaf()) {
+				if (node->can_widen(config.widening_limit(node->get_visits())) && node->prefers_untried(config)) {
+					next = node->expand_child(pos_map);
+					finished = next != NULL;
+				}
+				if (next == NULL) {
+					next = node->select_child(config, seed);
+				}
+			} else if (node->pos->is_terminal() || claimed[d] == node) {
+				stage[d] = -1;
+				active--;
+				continue;
+			} else {
+				node->expand(config.prior);
+				next = node->expand_child(pos_map);
+				finished = true;
+			}
+			if (next->get_visits() == 0) {
+				claimed[d] = next;
+			}
+			path.push_back(next);
+			virtual_loss_at(path, path.size() - 1, 1);
+			__builtin_prefetch(next);
+			if (finished) {
+				stage[d] = -1;
+				active--;
+			} else {
+				stage[d] = 0;
+			}
+		}
+	}
+}
+
+// Snapshot of the search for telemetry
+static SearchInfo snapshot(SearchReporter& reporter, Position* p, pos_map_t* pos_map, long iterations, double elapsed) {
+	node_lookup_t lookup = [pos_map](const vector<int>& key, int* visits, float* reward) {
+		auto it = pos_map->find(key);
+		if (it == pos_map->end()) {
+			return false;
+		}
+		*visits = it->second->get_visits();
+		*reward = it->second->get_reward();
+		return true;
+	};
+	size_t tree_bytes = estimate_tree_bytes(pos_map->size(), sizeof(MctsNodeSerial), p->get_vec().size());
+	return reporter.snapshot(p, lookup, pos_map->size(), tree_bytes, iterations, elapsed);
 }
 
-MctsAgentSerial::MctsAgentSerial() {}
+MctsAgentSerial::MctsAgentSerial(MctsConfig config): config(config), seed(config.seed) {
+	evaluator = config.evaluator != NULL ? config.evaluator : &rollout_evaluator;
+}
+
+// Search where leaf evaluations are queued to a batcher running on its own thread
+// Leaves stay queued with a virtual loss and are back propagated as results arrive
+int MctsAgentSerial::search_async(Position* p, MctsNodeSerial* pos_node, SearchReporter& reporter, double start, const SearchControl& control) {
+	EvalBatcher batcher(evaluator, config.eval_batch, config.eval_wait, seed++);
+	int max_in_flight = config.max_in_flight();
+	int in_flight = 0;
+	int iterations = 0;
+	long start_nodes = pos_map.size();
+	double wc_time, cpu_time;
+	double elapsed = 0.0;
+	double next_check = 0.0;
+	vector<EvalRequest*> done;
+	bool searching = true;
+	while (searching || in_flight > 0) {
+		// Queue leaves while there is room in the pipeline
+		while (searching && in_flight < max_in_flight) {
+			vector<MctsNodeSerial*>* path = new vector<MctsNodeSerial*>();
+			MctsNodeSerial* playout_node = descend(pos_node, *path, &pos_map, config, &seed);
+			float solved_payoff;
+			if (playout_node->pos->is_terminal() || config.solve_leaf(playout_node->pos, &solved_payoff)) {
+				// Nothing to wait for
+				if (playout_node->pos->is_terminal()) {
+					solved_payoff = playout_node->pos->payoff();
+				}
+				playout_node->set_proven(solved_payoff);
+				backprop(*path, solved_payoff, 1);
+				backprop_proof(*path);
+				if (config.rave) {
+					backprop_amaf(*path, vector<PlayedMove>(), solved_payoff);
+				}
+				iterations++;
+				delete path;
+			} else {
+				apply_virtual_loss(*path, 1);
+				batcher.submit(new EvalRequest(playout_node->pos, path));
+				in_flight++;
+			}
+			timing(&wc_time, &cpu_time);
+			elapsed = wc_time - start;
+			searching = !control.should_stop(elapsed, iterations + in_flight, pos_map.size() - start_nodes) && !pos_node->is_proven();
+		}
+
+		// Back propagate finished leaves, only blocking when we cannot queue more
+		bool must_wait = in_flight >= max_in_flight || !searching;
+		batcher.poll(done, in_flight > 0 && must_wait);
+		for (EvalRequest* req: done) {
+			vector<MctsNodeSerial*>* path = (vector<MctsNodeSerial*>*) req->data;
+			apply_virtual_loss(*path, -1);
+			backprop(*path, req->value, 1);
+			// The batcher does not report the moves of its simulations
+			if (config.rave) {
+				backprop_amaf(*path, vector<PlayedMove>(), req->value);
+			}
+			iterations++;
+			in_flight--;
+			delete path;
+			delete req;
+		}
+		done.clear();
+
+		// Update elapsed time
+		timing(&wc_time, &cpu_time);
+		elapsed = wc_time - start;
+		searching = !control.should_stop(elapsed, iterations + in_flight, pos_map.size() - start_nodes) && !pos_node->is_proven();
+
+		// Report progress
+		if (reporter.due(elapsed)) {
+			reporter.report(snapshot(reporter, p, &pos_map, iterations, elapsed));
+		}
+
+		// Stop once the most visited move can no longer be overtaken
+		if (config.early_stop && elapsed >= next_check) {
+			next_check = elapsed + config.early_stop_interval;
+			int best_visits, second_visits;
+			pos_node->top_two_visits(&best_visits, &second_visits);
+			if (config.can_stop_early(best_visits, second_visits, iterations, elapsed, control.time_limit)) {
+				searching = false;
+			}
+		}
+	}
+	return iterations;
+}
 
 // time_limit is in seconds
 pair<Move*,int> MctsAgentSerial::best_move(Position* p, float time_limit) {
+	return this->best_move(p, config.search_control(time_limit));
+}
+
+pair<Move*,int> MctsAgentSerial::best_move(Position* p, const SearchControl& control) {
+	// Whatever was searched while pondering stays in the tree
+	ponderer.stop();
+	// Unless every search starts from scratch
+	if (!config.tree_reuse) {
+		this->reset();
+	}
+	return this->search(p, control);
+}
+
+// Grows the tree under p until the next best_move
+void MctsAgentSerial::start_pondering(Position* p) {
+	// A background search would make the tree depend on timing
+	if (!config.ponder || config.deterministic) {
+		return;
+	}
+	SearchControl control = config.search_control(PONDER_TIME_LIMIT);
+	control.stop = ponderer.get_stop_flag();
+	ponderer.start([this, p, control]() {
+		this->search(p, control);
+	});
+}
+
+void MctsAgentSerial::stop_pondering() {
+	ponderer.stop();
+}
+
+pair<Move*,int> MctsAgentSerial::search(Position* p, const SearchControl& control) {
+	// Run on the agent's CPU
+	config.place(0);
+
 	double wc_time, cpu_time;
 	timing(&wc_time, &cpu_time);
 	double start = wc_time;
 
+	// Near the end of the game the exact solver is much faster than searching
+	float solved_payoff;
+	Move* solved_move;
+	if (config.solve_root(p, &solved_payoff, &solved_move, control, start)) {
+		return make_pair(solved_move, 0);
+	}
+
 	// Look up node in search tree or create new one
 	MctsNodeSerial* pos_node;
-	if (pos_map.find(p->get_vec()) != pos_map.end()) {
-		pos_node = pos_map.find(p->get_vec())->second;
+	if (pos_map.find(p->get_canonical_vec()) != pos_map.end()) {
+		pos_node = pos_map.find(p->get_canonical_vec())->second;
 	} else {
 		pos_node = new MctsNodeSerial(p);
-		pos_map.insert(make_pair(p->get_vec(), pos_node));
+		pos_map.insert(make_pair(p->get_canonical_vec(), pos_node));
 	}
 
+	SearchReporter reporter(config.listener, config.report_interval, config.report_pv);
+	// Only nodes this search adds count against the node cap, not those kept from earlier moves
+	long start_nodes = pos_map.size();
 	int iterations = 0;
 	double elapsed = 0.0;
-	// Continue search algorithm while time_limit is not complete
-	while (elapsed < time_limit) {
-		// Start at base node
-		MctsNodeSerial* leaf_node = pos_node;
-		vector<MctsNodeSerial*> path;
-		path.push_back(pos_node);
-
-		// Traverse tree until we reach a leaf by picking child with highest UCB
-		while (!leaf_node->is_leaf()) {
-			leaf_node = leaf_node->select_child();
-			path.push_back(leaf_node);
-		}
-
-		float rollout_reward;
-		int rollout_visits = 1;
-
-		// We have now reached leaf
-		// If game over, we have reached terminal node
-		if (leaf_node->pos->is_terminal()) {
-			rollout_reward = leaf_node->pos->payoff();
-		}
-		// If not game over, then we need to expand and rollout
-		else {
-			// Get the node to rollout from
-			MctsNodeSerial* playout_node;
-			if (leaf_node->get_visits() == 0) {
-				playout_node = leaf_node;
+	// The batcher's timing decides the order of back propagation
+	if (config.batches_evaluations()) {
+		iterations = this->search_async(p, pos_node, reporter, start, control);
+	} else {
+		double next_check = 0.0;
+		// Continue search algorithm until a limit in control is reached
+		// and while the position is not solved
+		while (!control.should_stop(elapsed, iterations, pos_map.size() - start_nodes) && !pos_node->is_proven()) {
+			// Descents made together take turns, hiding each other's memory stalls
+			long batch = config.interleave;
+			if (control.max_iterations > 0) {
+				batch = min(batch, control.max_iterations - iterations);
+			}
+			vector<vector<MctsNodeSerial*>> paths(batch);
+			if (batch == 1) {
+				descend(pos_node, paths[0], &pos_map, config, &seed);
 			} else {
-				leaf_node->expand(&pos_map);
-				playout_node = leaf_node->select_first_child();
-				path.push_back(playout_node);
-			}
-
-			// Rollout
-			Position* curr_pos = playout_node->pos; 	
-			while (!curr_pos->is_terminal()) {
-				vector<Move*> poss_moves = curr_pos->possible_moves();
-				Move* next_move = poss_moves[rand() % poss_moves.size()];
-				curr_pos = curr_pos->make_move(next_move);
-			}
-			// Now at terminal state
-			rollout_reward = curr_pos->payoff();			
-		}
-
-		iterations++;
-
-		// Back propagate
-		for (int i = 0; i < path.size(); i++) {
-			MctsNodeSerial* node = path[i];
-			//printf("Path[%d] = %p\n", i, node);
-			Position* node_pos = node->pos;
-			node->inc_visits(rollout_visits);
-			node->inc_reward(rollout_reward);
-			// Update edge info
-			if (i != path.size() - 1) {
-				// Update edge reward and visits
-				for (int j = 0; j < node->children.size(); j++) {
-					// This is the edge we traversed
-					if (node->children[j].first == path[i+1]) {
-						node->children[j].second.first += rollout_reward;
-						node->children[j].second.second += rollout_visits;
-						break;
-					}
+				descend_interleaved(pos_node, paths, &pos_map, config, &seed);
+				for (vector<MctsNodeSerial*>& path: paths) {
+					apply_virtual_loss(path, -1);
 				}
 			}
-		}
 
-		// Update elapsed time
+			for (vector<MctsNodeSerial*>& path: paths) {
+				MctsNodeSerial* playout_node = path.back();
+
+				float rollout_reward;
+				// Moves made by the evaluator, for RAVE
+				vector<PlayedMove> played;
+				// If game over, we have reached terminal node
+				if (playout_node->pos->is_terminal()) {
+					rollout_reward = playout_node->pos->payoff();
+					playout_node->set_proven(rollout_reward);
+				}
+				// Solve it exactly if it is shallow enough
+				else if (config.solve_leaf(playout_node->pos, &rollout_reward)) {
+					playout_node->set_proven(rollout_reward);
+				}
+				// Otherwise estimate its value with the evaluator
+				else if (config.rave) {
+					rollout_reward = evaluator->evaluate_moves(playout_node->pos, &seed, &played);
+				} else {
+					rollout_reward = evaluator->evaluate(playout_node->pos, &seed);
+				}
+
+				iterations++;
+
+				// Back propagate
+				backprop(path, rollout_reward, 1);
+				backprop_proof(path);
+				if (config.rave) {
+					backprop_amaf(path, played, rollout_reward);
+				}
+			}
+
+			// Update elapsed time
+			timing(&wc_time, &cpu_time);
+			elapsed = wc_time - start;
+
+			// Report progress
+			if (reporter.due(elapsed)) {
+				reporter.report(snapshot(reporter, p, &pos_map, iterations, elapsed));
+			}
+
+			// Stop once the most visited move can no longer be overtaken
+			if (config.early_stop && elapsed >= next_check) {
+				next_check = elapsed + config.early_stop_interval;
+				int best_visits, second_visits;
+				pos_node->top_two_visits(&best_visits, &second_visits);
+				if (config.can_stop_early(best_visits, second_visits, iterations, elapsed, control.time_limit)) {
+					break;
+				}
+			}
+		}
+	}
+	if (reporter.enabled()) {
 		timing(&wc_time, &cpu_time);
-		elapsed = wc_time - start;
+		SearchInfo info = snapshot(reporter, p, &pos_map, iterations, wc_time - start);
+		info.final = true;
+		reporter.report(info);
 	}
 
 	// Choose best action
 	float max_ratio = -INFINITY;
 	Move* best_move = NULL;
-	for (Move* move: p->possible_moves()) {
+	vector<Move*> moves = p->possible_moves();
+	for (Move* move: moves) {
 		Position* next_pos = p->make_move(move);
-		MctsNodeSerial* next_node = pos_map.find(next_pos->get_vec())->second;	
+		// Child may not exist yet if the search was very short
+		if (pos_map.find(next_pos->get_canonical_vec()) == pos_map.end()) {
+			continue;
+		}
+		MctsNodeSerial* next_node = pos_map.find(next_pos->get_canonical_vec())->second;	
 		// printf("%p: (%f, %d)\n", next_node, next_node->get_reward(), next_node->get_visits());
 		// move->print();
-		if (next_node->get_visits() == 0) {
+		float curr_ratio;
+		// Solved children are ranked by their exact value
+		if (next_node->is_proven()) {
+			curr_ratio = proven_ratio(next_node->get_proven());
+		} else if (next_node->get_visits() == 0) {
 			continue;
+		} else {
+			curr_ratio = (float) next_node->get_reward() / (float) next_node->get_visits();
 		}
-		float curr_ratio = (float) next_node->get_reward() / (float) next_node->get_visits();
 		// Player 1 wants least number of wins for player 0
 		if (p->whose_turn() == 1) {
 			curr_ratio *= -1.0;
@@ -204,10 +707,23 @@ pair<Move*,int> MctsAgentSerial::best_move(Position* p, float time_limit) {
 			best_move = move;
 		}
 	}
+	// Nothing was searched, any legal move will do
+	if (best_move == NULL) {
+		best_move = moves[0];
+	}
 	return make_pair(best_move, iterations);
 }
 
+pos_map_t* MctsAgentSerial::get_pos_map() {
+	return &pos_map;
+}
+
 void MctsAgentSerial::reset() {
+	ponderer.stop();
+	// Replay the same random numbers in the next game
+	if (config.deterministic) {
+		seed = config.seed;
+	}
 	for (auto it: pos_map) {
 		// Delete node
 		delete it.second;
@@ -7,30 +7,55 @@
 using namespace std;
 
 #include "game.h"
+#include "mcts_config.h"
 
-#define UCB_CONSTANT (2)
 
 // Node in computation tree to represent positions
 class MctsNodeSerial {
 	private:
 		float reward;
 		int visits;
+		// Exact payoff once the node is solved, UNPROVEN otherwise
+		float proven;
+		bool am_leaf;
+		// Player to move, kept here so selection does not have to load the position
+		int player;
+		// Moves that have not been turned into children yet
+		vector<Move*> untried;
+		// Priors of the untried moves, in the same order (empty without priors)
+		vector<float> untried_priors;
 	public:
 		Position* pos;
 		vector<pair<MctsNodeSerial*, pair<float, int>>> children;
+		// All-moves-as-first statistics of each edge, in the same order as children
+		vector<AmafEdge> amaf;
+		// Prior of each edge, in the same order as children (-1 without priors)
+		vector<float> priors;
 		// Functions
 		MctsNodeSerial(Position* p);
+		~MctsNodeSerial();
 		float get_reward();
 		int get_visits();
 		bool is_leaf();
+		// Player to move in pos
 		int get_player();
-		void add_child(MctsNodeSerial* new_child);
+		void add_child(MctsNodeSerial* new_child, int key, bool mirrored, float prior);
 		void inc_reward(float delta);
 		void inc_visits(float delta);
-		void expand(unordered_map<vector<int>, MctsNodeSerial*, pos_hash>* pos_map);
-		float calc_ucb2_child(pair<MctsNodeSerial*, pair<float, int>> child);
-		MctsNodeSerial* select_child();
-		MctsNodeSerial* select_first_child();
+		bool is_proven();
+		float get_proven();
+		void set_proven(float value);
+		bool update_proven();
+		void update_edge(MctsNodeSerial* child, float reward_delta, int visits_delta);
+		void expand(MovePrior* prior);
+		bool can_widen(int max_children);
+		bool prefers_untried(const MctsConfig& config);
+		MctsNodeSerial* expand_child(unordered_map<vector<int>, MctsNodeSerial*, pos_hash>* pos_map);
+		float calc_ucb2_child(pair<MctsNodeSerial*, pair<float, int>> child, const AmafEdge& amaf, float prior, const MctsConfig& config);
+		MctsNodeSerial* select_child(const MctsConfig& config, unsigned int* seed);
+		void update_amaf(MctsNodeSerial* next, AmafMoves& moves, float reward);
+		void top_two_visits(int* best, int* second);
+		void prefetch(int stage);
 };
 
 typedef pair<MctsNodeSerial*, pair<float,int>> child_info;
@@ -39,10 +64,23 @@ typedef unordered_map<vector<int>, MctsNodeSerial*, pos_hash> pos_map_t;
 class MctsAgentSerial: public Agent {
 	private:
 		pos_map_t pos_map;
+		MctsConfig config;
+		Evaluator* evaluator;
+		RolloutEvaluator rollout_evaluator;
+		unsigned int seed;
+		int search_async(Position* p, MctsNodeSerial* pos_node, SearchReporter& reporter, double start, const SearchControl& control);
+		// Background search between moves, declared last so it stops before the tree goes away
+		Ponderer ponderer;
+		pair<Move*,int> search(Position* p, const SearchControl& control);
 	public:
-		MctsAgentSerial();
+		MctsAgentSerial(MctsConfig config = MctsConfig());
 		pair<Move*,int> best_move(Position* p, float time_limit);
+		pair<Move*,int> best_move(Position* p, const SearchControl& control) override;
 		void reset();
+		// Search tree for tests and tools, not to be used while a search is running
+		pos_map_t* get_pos_map();
+		void start_pondering(Position* p) override;
+		void stop_pondering() override;
 };
 
 #endif
@@ -7,9 +7,16 @@
 using namespace std;
 
 #include "timing.h"
+#include "round_schedule.h"
 #include "mcts_tgm_parallel.h"
 
-MctsNodeTgmParallel::MctsNodeTgmParallel(Position* p): pos(p), reward(0), visits(0), children(vector<child_info_tgm>()) {}
+MctsNodeTgmParallel::MctsNodeTgmParallel(Position* p): reward(0), visits(0), proven(UNPROVEN), am_leaf(true), pos(p), children(vector<child_info_tgm>()) {}
+
+MctsNodeTgmParallel::~MctsNodeTgmParallel() {
+	for (Move* move: untried) {
+		delete move;
+	}
+}
 
 // Accessor functions
 float MctsNodeTgmParallel::get_reward() {
@@ -21,11 +28,13 @@ int MctsNodeTgmParallel::get_visits() {
 }
 
 bool MctsNodeTgmParallel::is_leaf() {
-	return children.empty();
+	return am_leaf;
 }
 
-void MctsNodeTgmParallel::add_child(MctsNodeTgmParallel* new_child) {
+void MctsNodeTgmParallel::add_child(MctsNodeTgmParallel* new_child, int key, bool mirrored, float prior) {
 	children.push_back(make_pair(new_child, make_pair(0.0, 0)));
+	amaf.push_back(AmafEdge(key, mirrored));
+	priors.push_back(prior);
 }
 
 void MctsNodeTgmParallel::inc_reward(float delta) {
@@ -36,45 +45,148 @@ void MctsNodeTgmParallel::inc_visits(float delta) {
 	visits += delta;
 }
 
-void MctsNodeTgmParallel::expand(pos_map_tgm_t* pos_map) {
-	// Get next possible moves
-	vector<Move*> next_moves = pos->possible_moves();
-	for (Move* move: next_moves) {
-		// See subsequent positions and either locate corresponding node already in tree
+bool MctsNodeTgmParallel::is_proven() {
+	return proven != UNPROVEN;
+}
+
+float MctsNodeTgmParallel::get_proven() {
+	return proven;
+}
+
+void MctsNodeTgmParallel::set_proven(float value) {
+	proven = value;
+}
+
+// A node is solved once the player to move has a child proven to win
+// or once every child is solved
+// Returns whether the node is solved
+bool MctsNodeTgmParallel::update_proven() {
+	if (this->is_proven()) {
+		return true;
+	}
+	if (children.empty()) {
+		return false;
+	}
+	// Payoff that is a win for the player to move
+	float win = pos->whose_turn() == 0 ? 1 : 0;
+	// Moves that were never tried could still be better
+	bool all_proven = untried.empty();
+	float best_value = UNPROVEN;
+	for (child_info_tgm child: children) {
+		if (!child.first->is_proven()) {
+			all_proven = false;
+			continue;
+		}
+		float value = child.first->get_proven();
+		if (value == win) {
+			proven = win;
+			return true;
+		}
+		// A draw beats a loss
+		if (best_value == UNPROVEN || value == 0.5) {
+			best_value = value;
+		}
+	}
+	if (all_proven) {
+		proven = best_value;
+	}
+	return all_proven;
+}
+
+// Children are created lazily: expanding only generates the moves
+// and expand_child turns them into children when selection asks for one
+// With priors, the most likely moves become children first
+void MctsNodeTgmParallel::expand(MovePrior* prior) {
+	untried = pos->possible_moves();
+	if (prior != NULL) {
+		untried_priors = prior->priors(pos, untried);
+		sort_by_prior(untried, untried_priors);
+	}
+	am_leaf = false;
+}
+
+// True if there is a move left to try and the node may have another child
+bool MctsNodeTgmParallel::can_widen(int max_children) {
+	return !untried.empty() && children.size() < max_children;
+}
+
+// Creates the child for the next untried move and returns it
+// Returns NULL if the remaining moves only reach children we already have
+MctsNodeTgmParallel* MctsNodeTgmParallel::expand_child(pos_map_tgm_t* pos_map) {
+	while (!untried.empty()) {
+		Move* move = untried.back();
+		untried.pop_back();
+		float prior = -1;
+		if (!untried_priors.empty()) {
+			prior = untried_priors.back();
+			untried_priors.pop_back();
+		}
+		// See subsequent position and either locate corresponding node already in tree
 		// or insert into tree
+		// Mirror images of a position share one node
 		Position* new_pos = pos->make_move(move);
-		if (pos_map->find(new_pos->get_vec()) == pos_map->end()) {
+		int move_key = pos->move_key(move);
+		delete move;
+		vector<int> key = new_pos->get_canonical_vec();
+		auto it = pos_map->find(key);
+		bool mirrored = false;
+		if (it == pos_map->end()) {
 			MctsNodeTgmParallel* new_child = new MctsNodeTgmParallel(new_pos);
-			pos_map->insert(make_pair(new_pos->get_vec(), new_child));
+			it = pos_map->insert(make_pair(key, new_child)).first;
+		} else {
+			mirrored = it->second->pos->get_vec() != new_pos->get_vec();
+			delete new_pos;
+		}
+		// Symmetric moves reach the same child, keep a single edge to it
+		// that carries the priors of both
+		bool duplicate = false;
+		for (int j = 0; j < children.size(); j++) {
+			if (children[j].first == it->second) {
+				duplicate = true;
+				if (prior >= 0) {
+					priors[j] += prior;
+				}
+				break;
+			}
 		}
 		// Add subsequent node as child of current node
-		this->add_child(pos_map->find(new_pos->get_vec())->second);
+		if (!duplicate) {
+			this->add_child(it->second, move_key, mirrored, prior);
+			return it->second;
+		}
 	}
+	return NULL;
 }
 
-float MctsNodeTgmParallel::calc_ucb2_child(child_info_tgm child){
+float MctsNodeTgmParallel::calc_ucb2_child(child_info_tgm child, const AmafEdge& amaf, float prior, const MctsConfig& config){
 	int edge_visits = child.second.second;
 	MctsNodeTgmParallel* child_node = child.first;
-	// If node has never been visited before
+	// If node has never been visited before, it is scored by first play urgency
 	if (edge_visits == 0 || child_node->get_visits() == 0) {
-		return INFINITY;
+		return config.selection_score(0, 0, this->get_visits(), prior);
 	}
 	float exploit = (float) child_node->get_reward() / (float) child_node->get_visits();
-	float explore = sqrt(UCB_CONSTANT * log(this->get_visits()) / edge_visits);
-	// Player 0 views results favorably while player 1 wants to negate it
+	exploit = rave_value(exploit, edge_visits, amaf, config.amaf_equivalence());
+	// Player 0 views results favorably while player 1 wants to minimize them
+	// The child's turn is the opponent of the player choosing it
 	if (child_node->pos->whose_turn() == 0) {
-		return exploit + explore;
-	} 
-	return -1.0 * exploit + explore;
+		exploit = 1 - exploit;
+	}
+	return config.selection_score(exploit, edge_visits, this->get_visits(), prior);
 }
 
-// Calculate UCB for each node
-// Return the node that maximizes UCB
-MctsNodeTgmParallel* MctsNodeTgmParallel::select_child(unsigned int* seed) {
+// Calculate UCB (PUCT with priors) for each node
+// Return the node that maximizes it
+MctsNodeTgmParallel* MctsNodeTgmParallel::select_child(const MctsConfig& config, unsigned int* seed) {
 	float max_ucb = -INFINITY;
 	vector<MctsNodeTgmParallel*> optimal_children;
-	for (child_info_tgm child: this->children) {
-		float child_ucb = this->calc_ucb2_child(child);
+	for (int j = 0; j < this->children.size(); j++) {
+		child_info_tgm child = this->children[j];
+		// Solved children need no more search
+		if (child.first->is_proven()) {
+			continue;
+		}
+		float child_ucb = this->calc_ucb2_child(child, amaf[j], priors[j], config);
 		if (child_ucb == INFINITY) {
 			return child.first;
 		}
@@ -86,143 +198,480 @@ MctsNodeTgmParallel* MctsNodeTgmParallel::select_child(unsigned int* seed) {
 			optimal_children.push_back(child.first);
 		}
 	}
+	// Every child was solved through another parent
+	// The next back propagation will mark this node as solved too
+	if (optimal_children.empty()) {
+		return this->children[0].first;
+	}
 	int rand_idx = rand_r(seed) % optimal_children.size();
 	return optimal_children[rand_idx];
 }
 
-// Assumes that caller has at least one child
-MctsNodeTgmParallel* MctsNodeTgmParallel::select_first_child() {
-	return this->children[0].first;
+// Adds the move made here towards next (NULL at the bottom of the path) to the
+// moves of a simulation, then credits reward to every edge whose move the player
+// to move made
+void MctsNodeTgmParallel::update_amaf(MctsNodeTgmParallel* next, AmafMoves& moves, float reward) {
+	int player = pos->whose_turn();
+	for (int j = 0; j < children.size(); j++) {
+		if (children[j].first == next) {
+			// The moves below next were made in the frame of its stored position
+			if (amaf[j].mirrored) {
+				moves.mirror(pos);
+			}
+			moves.add(player, amaf[j].key);
+			break;
+		}
+	}
+	moves.update(amaf, player, reward);
+}
+
+// True if selection should try the next untried move instead of revisiting a child
+// Always the case while first play urgency is infinite, otherwise the move must
+// score at least as high as every child
+bool MctsNodeTgmParallel::prefers_untried(const MctsConfig& config) {
+	float prior = untried_priors.empty() ? -1 : untried_priors.back();
+	float untried_score = config.selection_score(0, 0, this->get_visits(), prior);
+	if (untried_score == INFINITY) {
+		return true;
+	}
+	for (int j = 0; j < children.size(); j++) {
+		if (!children[j].first->is_proven() && this->calc_ucb2_child(children[j], amaf[j], priors[j], config) > untried_score) {
+			return false;
+		}
+	}
+	return true;
+}
+
+// Visits along the two most visited edges
+void MctsNodeTgmParallel::top_two_visits(int* best, int* second) {
+	*best = 0;
+	*second = 0;
+	for (child_info_tgm child: children) {
+		int edge_visits = child.second.second;
+		if (edge_visits > *best) {
+			*second = *best;
+			*best = edge_visits;
+		} else if (edge_visits > *second) {
+			*second = edge_visits;
+		}
+	}
+}
+
+// Snapshot of the search for telemetry
+// Holds the tree lock only while reading each node, so building the positions
+// and move names of the report does not stall the search
+static SearchInfo snapshot(SearchReporter& reporter, Position* p, pos_map_tgm_t* pos_map, omp_lock_t* tree_mutex, long iterations, double elapsed) {
+	node_lookup_t lookup = [pos_map, tree_mutex](const vector<int>& key, int* visits, float* reward) {
+		omp_set_lock(tree_mutex);
+		auto it = pos_map->find(key);
+		bool found = it != pos_map->end();
+		if (found) {
+			*visits = it->second->get_visits();
+			*reward = it->second->get_reward();
+		}
+		omp_unset_lock(tree_mutex);
+		return found;
+	};
+	omp_set_lock(tree_mutex);
+	long nodes = pos_map->size();
+	omp_unset_lock(tree_mutex);
+	size_t tree_bytes = estimate_tree_bytes(nodes, sizeof(MctsNodeTgmParallel), p->get_vec().size());
+	return reporter.snapshot(p, lookup, nodes, tree_bytes, iterations, elapsed);
+}
+
+// Seconds a thread waits for the batcher before checking the search limits again
+#define BATCH_POLL_WAIT (0.001)
+
+// A virtual loss counts a node whose leaf is being evaluated as a loss for the player who chose it
+static float virtual_loss(MctsNodeTgmParallel* node) {
+	return 1.0 - node->pos->whose_turn();
 }
 
-MctsAgentTgmParallel::MctsAgentTgmParallel() {
+// Adds visits simulations with a total payoff of reward to the nodes on path and the edges
+// between them, and adds (virtual_losses 1) or takes back (-1) a virtual loss on each
+// The caller holds the tree lock
+static void backprop(vector<MctsNodeTgmParallel*>& path, float reward, int visits, int virtual_losses) {
+	for (int i = 0; i < path.size(); i++) {
+		MctsNodeTgmParallel* node = path[i];
+		node->inc_visits(visits + virtual_losses);
+		node->inc_reward(reward + virtual_losses * virtual_loss(node));
+		// Update edge info
+		if (i != path.size() - 1) {
+			// Update edge reward and visits
+			for (int j = 0; j < node->children.size(); j++) {
+				// This is the edge we traversed
+				if (node->children[j].first == path[i+1]) {
+					node->children[j].second.first += reward + virtual_losses * virtual_loss(path[i+1]);
+					node->children[j].second.second += visits + virtual_losses;
+					break;
+				}
+			}
+		}
+	}
+}
+
+// Back propagates one simulation in place of virtual_losses virtual losses,
+// then the solved results and all-moves-as-first statistics it changes
+// The caller holds the tree lock
+static void back_up(vector<MctsNodeTgmParallel*>& path, float reward, int virtual_losses, const vector<PlayedMove>& played, const MctsConfig& config) {
+	backprop(path, reward, 1, -virtual_losses);
+	// Solved results can only change along the path we took, from the bottom up
+	for (int i = path.size() - 1; i >= 0; i--) {
+		if (!path[i]->update_proven()) {
+			break;
+		}
+	}
+	// All-moves-as-first statistics, also from the bottom up
+	if (config.rave) {
+		AmafMoves moves(played);
+		for (int i = path.size() - 1; i >= 0; i--) {
+			MctsNodeTgmParallel* next = i != path.size() - 1 ? path[i+1] : NULL;
+			path[i]->update_amaf(next, moves, reward);
+		}
+	}
+}
+
+// Back propagates the leaves the batcher has evaluated, whichever thread queued them,
+// waiting a little for one if wait is set, and returns how many there were
+static int complete_evaluations(EvalBatcher* batcher, atomic<int>* in_flight, omp_lock_t* tree_mutex, const MctsConfig& config, bool wait) {
+	vector<EvalRequest*> done;
+	if (wait) {
+		batcher->wait(done, BATCH_POLL_WAIT);
+	} else {
+		batcher->poll(done, false);
+	}
+	if (done.empty()) {
+		return 0;
+	}
+	omp_set_lock(tree_mutex);
+	for (EvalRequest* req: done) {
+		// The batcher does not report the moves of its simulations
+		back_up(*(vector<MctsNodeTgmParallel*>*) req->data, req->value, 1, vector<PlayedMove>(), config);
+	}
+	omp_unset_lock(tree_mutex);
+	for (EvalRequest* req: done) {
+		(*in_flight)--;
+		delete (vector<MctsNodeTgmParallel*>*) req->data;
+		delete req;
+	}
+	return done.size();
+}
+
+MctsAgentTgmParallel::MctsAgentTgmParallel(MctsConfig config): config(config) {
+	evaluator = config.evaluator != NULL ? config.evaluator : &rollout_evaluator;
 	omp_init_lock(&tree_mutex);
 }
 
 // time_limit is in seconds
 pair<Move*,int> MctsAgentTgmParallel::best_move(Position* p, float time_limit) {
+	return this->best_move(p, config.search_control(time_limit));
+}
+
+pair<Move*,int> MctsAgentTgmParallel::best_move(Position* p, const SearchControl& control) {
+	// Whatever was searched while pondering stays in the tree
+	ponderer.stop();
+	// Unless every search starts from scratch
+	if (!config.tree_reuse) {
+		this->reset();
+	}
+	return this->search(p, control);
+}
+
+// Grows the tree under p until the next best_move
+void MctsAgentTgmParallel::start_pondering(Position* p) {
+	// A background search would make the tree depend on timing
+	if (!config.ponder || config.deterministic) {
+		return;
+	}
+	SearchControl control = config.search_control(PONDER_TIME_LIMIT);
+	control.stop = ponderer.get_stop_flag();
+	ponderer.start([this, p, control]() {
+		this->search(p, control);
+	});
+}
+
+void MctsAgentTgmParallel::stop_pondering() {
+	ponderer.stop();
+}
+
+pair<Move*,int> MctsAgentTgmParallel::search(Position* p, const SearchControl& control) {
 	double wc_time, cpu_time;
 	timing(&wc_time, &cpu_time);
 	double start = wc_time;
 
+	// Near the end of the game the exact solver is much faster than searching
+	float solved_payoff;
+	Move* solved_move;
+	if (config.solve_root(p, &solved_payoff, &solved_move, control, start)) {
+		return make_pair(solved_move, 0);
+	}
+
 	// Look up node in search tree or create new one
 	MctsNodeTgmParallel* pos_node;
-	if (pos_map.find(p->get_vec()) != pos_map.end()) {
-		pos_node = pos_map.find(p->get_vec())->second;
+	if (pos_map.find(p->get_canonical_vec()) != pos_map.end()) {
+		pos_node = pos_map.find(p->get_canonical_vec())->second;
 	} else {
 		pos_node = new MctsNodeTgmParallel(p);
-		pos_map.insert(make_pair(p->get_vec(), pos_node));
+		pos_map.insert(make_pair(p->get_canonical_vec(), pos_node));
 	}
 
+	SearchReporter reporter(config.listener, config.report_interval, config.report_pv);
+	// Every iteration visits the root once, which lets the master thread count them all
+	int start_visits = pos_node->get_visits();
+	// Only nodes this search adds count against the node cap, not those kept from earlier moves
+	long start_nodes = pos_map.size();
 	int iterations = 0;
+	// Set by the master thread when the search can end early
+	bool stop_early = false;
+	// Order in which threads take the tree in deterministic mode
+	RoundSchedule schedule;
+	// Shared by all threads, which queue leaves to it and back propagate whatever it finishes
+	EvalBatcher* batcher = NULL;
+	if (config.batches_evaluations()) {
+		batcher = new EvalBatcher(evaluator, config.eval_batch, config.eval_wait, config.seed);
+	}
+	int max_in_flight = config.max_in_flight();
+	atomic<int> in_flight(0);
 	#pragma omp parallel \
-		shared(start, time_limit, iterations, pos_node) \
+		num_threads(config.threads()) \
+		shared(start, control, iterations, pos_node, p, reporter, start_visits, start_nodes, stop_early, schedule, batcher, max_in_flight, in_flight) \
 		private(wc_time, cpu_time) \
 		default(none)
 	{
+		config.place(omp_get_thread_num());
+
 		// Each thread get its own seed to generate random numbers with
-		unsigned int seed = omp_get_thread_num();		
+		int thread_num = omp_get_thread_num();
+		unsigned int seed = config.seed + thread_num;
+		if (config.deterministic) {
+			#pragma omp single
+			schedule.set_threads(omp_get_num_threads());
+		}
 		
 		double elapsed = 0.0;
+		double next_check = 0.0;
 		int my_iterations = 0;
+		long round = 0;
 		
-		// Continue search algorithm while time_limit is not complete
-		while (elapsed < time_limit) {
+		// Continue search algorithm until a limit in control is reached
+		// In deterministic mode the master thread decides for everyone
+		while (config.deterministic || !control.should_stop(elapsed, 0, 0)) {
+			bool stopped;
+			#pragma omp atomic read
+			stopped = stop_early;
+			if (stopped) {
+				break;
+			}
+			if (batcher != NULL) {
+				my_iterations += complete_evaluations(batcher, &in_flight, &tree_mutex, config, false);
+			}
+
+			// Wait for results while as many leaves as allowed are queued
+			if (batcher != NULL && in_flight++ >= max_in_flight) {
+				in_flight--;
+				my_iterations += complete_evaluations(batcher, &in_flight, &tree_mutex, config, true);
+				timing(&wc_time, &cpu_time);
+				elapsed = wc_time - start;
+				continue;
+			}
+
 			// Start at base node
 			MctsNodeTgmParallel* leaf_node = pos_node;
 			vector<MctsNodeTgmParallel*> path;
 			path.push_back(pos_node);
 
 			// Only allow one thread access
+			if (config.deterministic) {
+				schedule.wait_descend(thread_num, round);
+			}
 			omp_set_lock(&tree_mutex);
+			// Stop once the position is solved or the iteration or node cap is reached
+			// Queued leaves count, since their virtual losses visit the root
+			long searched = pos_node->get_visits() - start_visits;
+			bool done = pos_node->is_proven() || control.should_stop(elapsed, searched, pos_map.size() - start_nodes);
+			// Every thread leaves after the same round, and threads that would
+			// go past the iteration cap sit the last round out
+			bool skip = false;
+			if (config.deterministic) {
+				if (thread_num == 0) {
+					schedule.set_finished(done);
+				}
+				done = schedule.is_finished();
+				skip = control.max_iterations > 0 && searched + thread_num >= control.max_iterations;
+			}
+			if (done || skip) {
+				omp_unset_lock(&tree_mutex);
+				if (batcher != NULL) {
+					in_flight--;
+				}
+				if (config.deterministic) {
+					schedule.pass();
+					schedule.wait_backup(thread_num, round);
+					schedule.pass();
+					round++;
+				}
+				if (done) {
+					break;
+				}
+				continue;
+			}
 			// Traverse tree until we reach a leaf by picking child with highest UCB
+			// or a node that may try a new move
+			MctsNodeTgmParallel* new_child = NULL;
 			while (!leaf_node->is_leaf()) {
-				leaf_node = leaf_node->select_child(&seed);
+				if (leaf_node->can_widen(config.widening_limit(leaf_node->get_visits())) && leaf_node->prefers_untried(config)) {
+					new_child = leaf_node->expand_child(&pos_map);
+					if (new_child != NULL) {
+						break;
+					}
+				}
+				leaf_node = leaf_node->select_child(config, &seed);
 				path.push_back(leaf_node);
 			}
 
 			float rollout_reward;
-			int rollout_visits = 1;
-
 			Position* curr_pos;
 			// We have now reached leaf
 			// If game over, we have reached terminal node
 			if (leaf_node->pos->is_terminal()) {
 				curr_pos = leaf_node->pos;
+				leaf_node->set_proven(curr_pos->payoff());
 			}
 			// If not game over, then we need to expand and rollout
 			else {
 				// Get the node to rollout from
 				MctsNodeTgmParallel* playout_node;
-				if (leaf_node->get_visits() == 0) {
+				if (new_child != NULL) {
+					playout_node = new_child;
+					path.push_back(playout_node);
+				} else if (leaf_node->get_visits() == 0) {
 					playout_node = leaf_node;
 				} else {
-					leaf_node->expand(&pos_map);
-					playout_node = leaf_node->select_first_child();
+					leaf_node->expand(config.prior);
+					playout_node = leaf_node->expand_child(&pos_map);
 					path.push_back(playout_node);
 				}
 				curr_pos = playout_node->pos; 	
 			}
 			// Done reading and writing to tree
 			omp_unset_lock(&tree_mutex);
+			if (config.deterministic) {
+				schedule.pass();
+			}
 
-			// Rollout phase can be done without access to tree
-			while (!curr_pos->is_terminal()) {
-				vector<Move*> poss_moves = curr_pos->possible_moves();
-				Move* next_move = poss_moves[rand_r(&seed) % poss_moves.size()];
-				curr_pos = curr_pos->make_move(next_move);
+			// Evaluation phase can be done without access to tree
+			bool leaf_solved = false;
+			bool queued = false;
+			// Moves made by the evaluator, for RAVE
+			vector<PlayedMove> played;
+			if (curr_pos->is_terminal()) {
+				rollout_reward = curr_pos->payoff();
+			} else if (config.solve_leaf(curr_pos, &rollout_reward)) {
+				// Exact value, recorded once we have access to the tree again
+				leaf_solved = true;
+			} else if (batcher != NULL) {
+				// The leaf waits for the batcher with a virtual loss, so the next descents go elsewhere
+				omp_set_lock(&tree_mutex);
+				backprop(path, 0, 0, 1);
+				omp_unset_lock(&tree_mutex);
+				vector<MctsNodeTgmParallel*>* queued_path = new vector<MctsNodeTgmParallel*>();
+				queued_path->swap(path);
+				batcher->submit(new EvalRequest(curr_pos, queued_path));
+				queued = true;
+			} else if (config.rave) {
+				rollout_reward = evaluator->evaluate_moves(curr_pos, &seed, &played);
+			} else {
+				rollout_reward = evaluator->evaluate(curr_pos, &seed);
 			}
-			// Now at terminal state
-			rollout_reward = curr_pos->payoff();
-			my_iterations++;
 
-			// Need access to tree again
-			omp_set_lock(&tree_mutex);
-			// Back propagate
-			for (int i = 0; i < path.size(); i++) {
-				MctsNodeTgmParallel* node = path[i];
-				//printf("Path[%d] = %p\n", i, node);
-				Position* node_pos = node->pos;
-				node->inc_visits(rollout_visits);
-				node->inc_reward(rollout_reward);
-				// Update edge info
-				if (i != path.size() - 1) {
-					// Update edge reward and visits
-					for (int j = 0; j < node->children.size(); j++) {
-						// This is the edge we traversed
-						if (node->children[j].first == path[i+1]) {
-							node->children[j].second.first += rollout_reward;
-							node->children[j].second.second += rollout_visits;
-							break;
-						}
-					}
+			if (!queued) {
+				if (batcher != NULL) {
+					in_flight--;
+				}
+				my_iterations++;
+
+				// Need access to tree again
+				if (config.deterministic) {
+					schedule.wait_backup(thread_num, round);
+				}
+				omp_set_lock(&tree_mutex);
+				if (leaf_solved) {
+					path.back()->set_proven(rollout_reward);
+				}
+				back_up(path, rollout_reward, 0, played, config);
+				// Done with tree
+				omp_unset_lock(&tree_mutex);
+				if (config.deterministic) {
+					schedule.pass();
+					round++;
 				}
 			}
-			// Done with tree
-			omp_unset_lock(&tree_mutex);
 
 			// Update elapsed time
 			timing(&wc_time, &cpu_time);
 			elapsed = wc_time - start;
+
+			// Master thread reports progress, locking the tree for one node at a time
+			if (thread_num == 0 && reporter.due(elapsed)) {
+				omp_set_lock(&tree_mutex);
+				searched = pos_node->get_visits() - start_visits;
+				omp_unset_lock(&tree_mutex);
+				reporter.report(snapshot(reporter, p, &pos_map, &tree_mutex, searched, elapsed));
+			}
+
+			// Master thread stops everyone once the most visited move can no longer be overtaken
+			if (thread_num == 0 && config.early_stop && elapsed >= next_check) {
+				next_check = elapsed + config.early_stop_interval;
+				omp_set_lock(&tree_mutex);
+				int best_visits, second_visits;
+				pos_node->top_two_visits(&best_visits, &second_visits);
+				searched = pos_node->get_visits() - start_visits;
+				omp_unset_lock(&tree_mutex);
+				if (config.can_stop_early(best_visits, second_visits, searched, elapsed, control.time_limit)) {
+					#pragma omp atomic write
+					stop_early = true;
+				}
+			}
+		}
+		// Queued leaves are back propagated before the search ends
+		while (batcher != NULL && in_flight > 0) {
+			my_iterations += complete_evaluations(batcher, &in_flight, &tree_mutex, config, true);
 		}
 		#pragma omp atomic update
 		iterations += my_iterations;
 	}
+	delete batcher;
+	if (reporter.enabled()) {
+		timing(&wc_time, &cpu_time);
+		SearchInfo info = snapshot(reporter, p, &pos_map, &tree_mutex, iterations, wc_time - start);
+		info.final = true;
+		reporter.report(info);
+	}
 
 	// Parallel section finished
 	// Can now serially safely access tree results
 	// Choose best action
 	float max_ratio = -INFINITY;
 	Move* best_move = NULL;
-	for (Move* move: p->possible_moves()) {
+	vector<Move*> moves = p->possible_moves();
+	for (Move* move: moves) {
 		Position* next_pos = p->make_move(move);
-		MctsNodeTgmParallel* next_node = pos_map.find(next_pos->get_vec())->second;	
+		// Child may not exist yet if the search was very short
+		if (pos_map.find(next_pos->get_canonical_vec()) == pos_map.end()) {
+			continue;
+		}
+		MctsNodeTgmParallel* next_node = pos_map.find(next_pos->get_canonical_vec())->second;	
 		// printf("%p: (%f, %d)\n", next_node, next_node->get_reward(), next_node->get_visits());
 		// move->print();
-		if (next_node->get_visits() == 0) {
+		float curr_ratio;
+		// Solved children are ranked by their exact value
+		if (next_node->is_proven()) {
+			curr_ratio = proven_ratio(next_node->get_proven());
+		} else if (next_node->get_visits() == 0) {
 			continue;
+		} else {
+			curr_ratio = (float) next_node->get_reward() / (float) next_node->get_visits();
 		}
-		float curr_ratio = (float) next_node->get_reward() / (float) next_node->get_visits();
 		// Player 1 wants least number of wins for player 0
 		if (p->whose_turn() == 1) {
 			curr_ratio *= -1.0;
@@ -232,10 +681,19 @@ pair<Move*,int> MctsAgentTgmParallel::best_move(Position* p, float time_limit) {
 			best_move = move;
 		}
 	}
+	// Nothing was searched, any legal move will do
+	if (best_move == NULL) {
+		best_move = moves[0];
+	}
 	return make_pair(best_move, iterations);
 }
 
+pos_map_tgm_t* MctsAgentTgmParallel::get_pos_map() {
+	return &pos_map;
+}
+
 void MctsAgentTgmParallel::reset() {
+	ponderer.stop();
 	for (auto it: pos_map) {
 		// Delete node
 		delete it.second;
@@ -7,99 +7,315 @@
 using namespace std;
 
 #include "timing.h"
+#include "round_schedule.h"
 #include "mcts_tnm_parallel.h"
 
-MctsNodeTnmParallel::MctsNodeTnmParallel(Position* p): 
-	pos(p), reward(0), visits(0), children(vector<child_info_tnm>()), am_leaf(true) {
-	omp_init_lock(&node_mutex);
+MctsNodeTnmParallel::MctsNodeTnmParallel(Position* p, NodeLockKind lock_kind, bool lock_free_reads):
+	node_mutex(lock_kind), lock_free_reads(lock_free_reads), reward(0), visits(0), proven(UNPROVEN), am_leaf(true),
+	untried_left(0), next_prior(-1), expanding(0), num_children(0), pos(p), children(vector<child_info_tnm>()) {}
+
+MctsNodeTnmParallel::~MctsNodeTnmParallel() {
+	for (Move* move: untried) {
+		delete move;
+	}
+}
+
+void* MctsNodeTnmParallel::operator new(size_t size) {
+	return cache_aligned_alloc(size);
+}
+
+void MctsNodeTnmParallel::operator delete(void* p) {
+	free(p);
 }
 
+// Writers exclude each other with the lock and make lock-free readers retry with the version
 void MctsNodeTnmParallel::lock() {
-	omp_set_lock(&node_mutex);
+	node_mutex.lock();
+	if (lock_free_reads) {
+		seq.write_begin();
+	}
 }
 
 void MctsNodeTnmParallel::unlock() {
-	omp_unset_lock(&node_mutex);
+	if (lock_free_reads) {
+		seq.write_end();
+	}
+	node_mutex.unlock();
 }
 
 // Accessor functions
 float MctsNodeTnmParallel::get_reward() {
-	return reward;
+	return load_acquire(reward);
 }
 
 int MctsNodeTnmParallel::get_visits() {
-	return visits;
+	return load_acquire(visits);
+}
+
+void MctsNodeTnmParallel::read_stats(int* visits, float* reward, float* proven) {
+	this->read([&]() {
+		*visits = load_acquire(this->visits);
+		*reward = load_acquire(this->reward);
+		*proven = load_acquire(this->proven);
+	});
+}
+
+int MctsNodeTnmParallel::read_children(vector<child_info_tnm>& edges, vector<AmafEdge>& amaf_edges, vector<float>& edge_priors) {
+	int my_visits;
+	this->read([&]() {
+		my_visits = load_acquire(visits);
+		int n = num_children.load(memory_order_acquire);
+		edges.clear();
+		amaf_edges.clear();
+		edge_priors.clear();
+		for (int j = 0; j < n; j++) {
+			// The child and the move's key never change once the edge is published
+			edges.push_back(make_pair(children[j].first,
+				make_pair(load_acquire(children[j].second.first), load_acquire(children[j].second.second))));
+			AmafEdge edge(amaf[j].key, amaf[j].mirrored);
+			edge.reward = load_acquire(amaf[j].reward);
+			edge.visits = load_acquire(amaf[j].visits);
+			amaf_edges.push_back(edge);
+			edge_priors.push_back(load_acquire(priors[j]));
+		}
+	});
+	return my_visits;
 }
 
 bool MctsNodeTnmParallel::is_leaf() {
-	return am_leaf;
+	bool leaf;
+	this->read([&]() {
+		leaf = am_leaf.load(memory_order_acquire);
+	});
+	return leaf;
 }
 
-void MctsNodeTnmParallel::add_child(MctsNodeTnmParallel* new_child) {
+// Caller must hold the lock
+void MctsNodeTnmParallel::add_child(MctsNodeTnmParallel* new_child, int key, bool mirrored, float prior) {
 	children.push_back(make_pair(new_child, make_pair(0.0, 0)));
+	amaf.push_back(AmafEdge(key, mirrored));
+	priors.push_back(prior);
+	// Readers may copy the edge from now on
+	num_children.store(children.size(), memory_order_release);
 }
 
 void MctsNodeTnmParallel::inc_reward(float delta) {
-	reward += delta;
+	store_release(reward, reward + delta);
 }
 
 void MctsNodeTnmParallel::inc_visits(float delta) {
-	visits += delta;
+	store_release(visits, (int) (visits + delta));
+}
+
+bool MctsNodeTnmParallel::is_proven() {
+	return this->get_proven() != UNPROVEN;
 }
 
-void MctsNodeTnmParallel::expand(pos_map_tnm_t* pos_map) {
-	// Get next possible moves
-	vector<Move*> next_moves = pos->possible_moves();
-	for (Move* move: next_moves) {
-		// See subsequent positions and either locate corresponding node already in tree
+float MctsNodeTnmParallel::get_proven() {
+	return load_acquire(proven);
+}
+
+void MctsNodeTnmParallel::set_proven(float value) {
+	store_release(proven, value);
+}
+
+// A node is solved once the player to move has a child proven to win
+// or once every child is solved
+// Returns whether the node is solved
+// Like select_child, only holds one lock at a time
+bool MctsNodeTnmParallel::update_proven() {
+	bool done;
+	int n;
+	// Moves that were never tried could still be better
+	bool moves_left;
+	this->read([&]() {
+		done = load_acquire(proven) != UNPROVEN;
+		n = num_children.load(memory_order_acquire);
+		moves_left = load_acquire(untried_left) > 0 || load_acquire(expanding) > 0;
+	});
+	if (done) {
+		return true;
+	}
+	if (n == 0) {
+		return false;
+	}
+	// Payoff that is a win for the player to move
+	float win = pos->whose_turn() == 0 ? 1 : 0;
+	bool all_proven = !moves_left;
+	float best_value = UNPROVEN;
+	for (int j = 0; j < n; j++) {
+		MctsNodeTnmParallel* child = children[j].first;
+		float value;
+		child->read([&]() {
+			value = load_acquire(child->proven);
+		});
+		if (value == UNPROVEN) {
+			all_proven = false;
+			continue;
+		}
+		if (value == win) {
+			best_value = win;
+			all_proven = true;
+			break;
+		}
+		// A draw beats a loss
+		if (best_value == UNPROVEN || value == 0.5) {
+			best_value = value;
+		}
+	}
+	if (all_proven) {
+		this->lock();
+		this->set_proven(best_value);
+		this->unlock();
+	}
+	return all_proven;
+}
+
+// Children are created lazily: expanding only generates the moves
+// and expand_child turns them into children when selection asks for one
+// With priors, the most likely moves become children first
+// Caller must hold the lock
+void MctsNodeTnmParallel::expand(MovePrior* prior) {
+	// Another thread may have expanded it since the caller checked
+	if (!am_leaf.load(memory_order_relaxed)) {
+		return;
+	}
+	untried = pos->possible_moves();
+	if (prior != NULL) {
+		untried_priors = prior->priors(pos, untried);
+		sort_by_prior(untried, untried_priors);
+	}
+	// Each move adds at most one edge, so adding them never moves the edges readers copy
+	children.reserve(untried.size());
+	amaf.reserve(untried.size());
+	priors.reserve(untried.size());
+	store_release(untried_left, (int) untried.size());
+	store_release(next_prior, untried_priors.empty() ? -1.0f : untried_priors.back());
+	am_leaf.store(false, memory_order_release);
+}
+
+// True if there is a move left to try and the node may have another child
+bool MctsNodeTnmParallel::can_widen(int max_children) {
+	int left, n;
+	this->read([&]() {
+		left = load_acquire(untried_left);
+		n = num_children.load(memory_order_acquire);
+	});
+	return left > 0 && n < max_children;
+}
+
+// Creates the child for the next untried move and returns it
+// Returns NULL if the remaining moves only reach children we already have
+// The lock is only held to take a move and to add the edge
+MctsNodeTnmParallel* MctsNodeTnmParallel::expand_child(pos_map_tnm_t* pos_map, omp_lock_t* map_mutex) {
+	while (true) {
+		this->lock();
+		if (untried.empty()) {
+			this->unlock();
+			return NULL;
+		}
+		Move* move = untried.back();
+		untried.pop_back();
+		float prior = -1;
+		if (!untried_priors.empty()) {
+			prior = untried_priors.back();
+			untried_priors.pop_back();
+		}
+		store_release(untried_left, (int) untried.size());
+		store_release(next_prior, untried_priors.empty() ? -1.0f : untried_priors.back());
+		store_release(expanding, expanding + 1);
+		this->unlock();
+
+		// See subsequent position and either locate corresponding node already in tree
 		// or insert into tree
+		// Mirror images of a position share one node
 		Position* new_pos = pos->make_move(move);
-		if (pos_map->find(new_pos->get_vec()) == pos_map->end()) {
-			MctsNodeTnmParallel* new_child = new MctsNodeTnmParallel(new_pos);
-			pos_map->insert(make_pair(new_pos->get_vec(), new_child));
+		int move_key = pos->move_key(move);
+		delete move;
+		vector<int> key = new_pos->get_canonical_vec();
+		MctsNodeTnmParallel* child_node;
+		omp_set_lock(map_mutex);
+		auto it = pos_map->find(key);
+		if (it == pos_map->end()) {
+			child_node = new MctsNodeTnmParallel(new_pos, node_mutex.get_kind(), lock_free_reads);
+			pos_map->insert(make_pair(key, child_node));
+		} else {
+			child_node = it->second;
+		}
+		omp_unset_lock(map_mutex);
+		bool mirrored = false;
+		if (child_node->pos != new_pos) {
+			mirrored = child_node->pos->get_vec() != new_pos->get_vec();
+			delete new_pos;
+		}
+
+		this->lock();
+		// Symmetric moves reach the same child, keep a single edge to it
+		// that carries the priors of both
+		bool duplicate = false;
+		for (int j = 0; j < children.size(); j++) {
+			if (children[j].first == child_node) {
+				duplicate = true;
+				if (prior >= 0) {
+					store_release(priors[j], priors[j] + prior);
+				}
+				break;
+			}
 		}
 		// Add subsequent node as child of current node
-		this->add_child(pos_map->find(new_pos->get_vec())->second);
+		if (!duplicate) {
+			this->add_child(child_node, move_key, mirrored, prior);
+		}
+		store_release(expanding, expanding - 1);
+		this->unlock();
+		if (!duplicate) {
+			return child_node;
+		}
 	}
-	// Update
-	am_leaf = false;
 }
 
-float MctsNodeTnmParallel::calc_ucb2_child(child_info_tnm child, int parent_visits){
-	int edge_visits = child.second.second;	
+float MctsNodeTnmParallel::calc_ucb2_child(child_info_tnm child, const AmafEdge& amaf, float prior, const MctsConfig& config, int parent_visits){
+	int edge_visits = child.second.second;
 	MctsNodeTnmParallel* child_node = child.first;
-	// Lock child node
-	child_node->lock();
+	int child_visits;
+	float child_reward, child_proven;
+	child_node->read_stats(&child_visits, &child_reward, &child_proven);
 
-	// If node has never been visited before
-	if (edge_visits == 0 || child_node->get_visits() == 0) {
-		child_node->unlock();	
-		return INFINITY;
+	// Solved children need no more search
+	if (child_proven != UNPROVEN) {
+		return -INFINITY;
+	}
+	// If node has never been visited before, it is scored by first play urgency
+	if (edge_visits == 0 || child_visits == 0) {
+		return config.selection_score(0, 0, parent_visits, prior);
 	}
-	float exploit = (float) child_node->get_reward() / (float) child_node->get_visits();
-	float explore = sqrt(UCB_CONSTANT * log(parent_visits) / edge_visits);
-	// Player 0 views results favorably while player 1 wants to negate it
+	float exploit = child_reward / (float) child_visits;
+	exploit = rave_value(exploit, edge_visits, amaf, config.amaf_equivalence());
+	// Player 0 views results favorably while player 1 wants to minimize them
+	// The child's turn is the opponent of the player choosing it
 	if (child_node->pos->whose_turn() == 0) {
-		child_node->unlock();	
-		return exploit + explore;
+		exploit = 1 - exploit;
 	}
-	// Done with child node
-	child_node->unlock();
-	return -1.0 * exploit + explore;
+	return config.selection_score(exploit, edge_visits, parent_visits, prior);
 }
 
-// Calculate UCB for each node
-// Return the node that maximizes UCB
-MctsNodeTnmParallel* MctsNodeTnmParallel::select_child(unsigned int* seed) {
+// Calculate UCB (PUCT with priors) for each node
+// Return the node that maximizes it
+// Only holds one lock at a time, and none with lock_free_reads
+MctsNodeTnmParallel* MctsNodeTnmParallel::select_child(const MctsConfig& config, unsigned int* seed) {
 	float max_ucb = -INFINITY;
 	vector<MctsNodeTnmParallel*> optimal_children;
-	this->lock();
-	int my_visits = this->get_visits();
-	vector<child_info_tnm> curr_children = this->children;
-	this->unlock();
+	vector<child_info_tnm> curr_children;
+	vector<AmafEdge> curr_amaf;
+	vector<float> curr_priors;
+	int my_visits = this->read_children(curr_children, curr_amaf, curr_priors);
 
-	for (child_info_tnm child: curr_children) {
-		float child_ucb = this->calc_ucb2_child(child, my_visits);
+	for (int j = 0; j < curr_children.size(); j++) {
+		child_info_tnm child = curr_children[j];
+		float child_ucb = this->calc_ucb2_child(child, curr_amaf[j], curr_priors[j], config, my_visits);
+		if (child_ucb == -INFINITY) {
+			continue;
+		}
 		if (child_ucb == INFINITY) {
 			return child.first;
 		}
@@ -112,143 +328,512 @@ MctsNodeTnmParallel* MctsNodeTnmParallel::select_child(unsigned int* seed) {
 		}
 	}
 
+	// Every child was solved through another parent
+	// The next back propagation will mark this node as solved too
+	if (optimal_children.empty()) {
+		// Another thread took every move but has not added the edges yet
+		if (curr_children.empty()) {
+			return NULL;
+		}
+		return curr_children[0].first;
+	}
 	int rand_idx = rand_r(seed) % optimal_children.size();
 	return optimal_children[rand_idx];
 }
 
-// Assumes that caller has at least one child
-MctsNodeTnmParallel* MctsNodeTnmParallel::select_first_child() { 
-	MctsNodeTnmParallel* ret = this->children[0].first;
-	return ret;
+// True if selection should try the next untried move instead of revisiting a child
+// Always the case while first play urgency is infinite, otherwise the move must
+// score at least as high as every child
+// Like select_child, only holds one lock at a time
+bool MctsNodeTnmParallel::prefers_untried(const MctsConfig& config) {
+	int my_visits;
+	float prior;
+	this->read([&]() {
+		my_visits = load_acquire(visits);
+		prior = load_acquire(next_prior);
+	});
+	float untried_score = config.selection_score(0, 0, my_visits, prior);
+	if (untried_score == INFINITY) {
+		return true;
+	}
+	vector<child_info_tnm> curr_children;
+	vector<AmafEdge> curr_amaf;
+	vector<float> curr_priors;
+	this->read_children(curr_children, curr_amaf, curr_priors);
+
+	for (int j = 0; j < curr_children.size(); j++) {
+		if (this->calc_ucb2_child(curr_children[j], curr_amaf[j], curr_priors[j], config, my_visits) > untried_score) {
+			return false;
+		}
+	}
+	return true;
+}
+
+// Adds the move made here towards next (NULL at the bottom of the path) to the
+// moves of a simulation, then credits reward to every edge whose move the player
+// to move made
+void MctsNodeTnmParallel::update_amaf(MctsNodeTnmParallel* next, AmafMoves& moves, float reward) {
+	int player = pos->whose_turn();
+	this->lock();
+	for (int j = 0; j < children.size(); j++) {
+		if (children[j].first == next) {
+			// The moves below next were made in the frame of its stored position
+			if (amaf[j].mirrored) {
+				moves.mirror(pos);
+			}
+			moves.add(player, amaf[j].key);
+			break;
+		}
+	}
+	// Readers may copy the statistics while we change them, so store each field on its own
+	for (int j = 0; j < amaf.size(); j++) {
+		if (moves.credits(amaf[j], player)) {
+			store_release(amaf[j].reward, amaf[j].reward + reward);
+			store_release(amaf[j].visits, amaf[j].visits + 1);
+		}
+	}
+	this->unlock();
 }
 
-MctsAgentTnmParallel::MctsAgentTnmParallel() {}
+// Visits along the two most visited edges
+void MctsNodeTnmParallel::top_two_visits(int* best, int* second) {
+	vector<int> edge_visits;
+	this->read([&]() {
+		int n = num_children.load(memory_order_acquire);
+		edge_visits.clear();
+		for (int j = 0; j < n; j++) {
+			edge_visits.push_back(load_acquire(children[j].second.second));
+		}
+	});
+	*best = 0;
+	*second = 0;
+	for (int visits: edge_visits) {
+		if (visits > *best) {
+			*second = *best;
+			*best = visits;
+		} else if (visits > *second) {
+			*second = visits;
+		}
+	}
+}
+
+// Snapshot of the search for telemetry
+static SearchInfo snapshot(SearchReporter& reporter, Position* p, pos_map_tnm_t* pos_map, omp_lock_t* map_mutex, long iterations, double elapsed) {
+	node_lookup_t lookup = [pos_map, map_mutex](const vector<int>& key, int* visits, float* reward) {
+		omp_set_lock(map_mutex);
+		auto it = pos_map->find(key);
+		bool found = it != pos_map->end();
+		MctsNodeTnmParallel* node = found ? it->second : NULL;
+		omp_unset_lock(map_mutex);
+		if (!found) {
+			return false;
+		}
+		float proven;
+		node->read_stats(visits, reward, &proven);
+		return true;
+	};
+	omp_set_lock(map_mutex);
+	long nodes = pos_map->size();
+	omp_unset_lock(map_mutex);
+	size_t tree_bytes = estimate_tree_bytes(nodes, sizeof(MctsNodeTnmParallel), p->get_vec().size());
+	return reporter.snapshot(p, lookup, nodes, tree_bytes, iterations, elapsed);
+}
+
+// Seconds a thread waits for the batcher before checking the search limits again
+#define BATCH_POLL_WAIT (0.001)
+
+// Descends from pos_node to a leaf by picking the child with highest UCB, adding a child
+// on the way where a node may try a new move, and returns the position to evaluate,
+// which is that of the last node on path
+static Position* descend(MctsNodeTnmParallel* pos_node, vector<MctsNodeTnmParallel*>& path, pos_map_tnm_t* pos_map, omp_lock_t* map_mutex, const MctsConfig& config, unsigned int* seed) {
+	MctsNodeTnmParallel* leaf_node = pos_node;
+	path.push_back(pos_node);
+	MctsNodeTnmParallel* new_child = NULL;
+	while (!leaf_node->is_leaf()) {
+		if (leaf_node->can_widen(config.widening_limit(leaf_node->get_visits())) && leaf_node->prefers_untried(config)) {
+			new_child = leaf_node->expand_child(pos_map, map_mutex);
+			if (new_child != NULL) {
+				break;
+			}
+		}
+		MctsNodeTnmParallel* next_node = leaf_node->select_child(config, seed);
+		if (next_node == NULL) {
+			break;
+		}
+		leaf_node = next_node;
+		path.push_back(leaf_node);
+	}
+
+	// If game over, we have reached terminal node
+	if (leaf_node->pos->is_terminal()) {
+		leaf_node->lock();
+		leaf_node->set_proven(leaf_node->pos->payoff());
+		leaf_node->unlock();
+		return leaf_node->pos;
+	}
+	// If not game over, then we need to expand and rollout
+	if (new_child == NULL && leaf_node->get_visits() > 0) {
+		leaf_node->lock();
+		leaf_node->expand(config.prior);
+		leaf_node->unlock();
+		// Other threads may already have taken every move, then evaluate the leaf again
+		new_child = leaf_node->expand_child(pos_map, map_mutex);
+	}
+	if (new_child != NULL) {
+		path.push_back(new_child);
+	}
+	return path.back()->pos;
+}
+
+// A virtual loss counts a node whose leaf is being evaluated as a loss for the player who chose it
+static float virtual_loss(MctsNodeTnmParallel* node) {
+	return 1.0 - node->pos->whose_turn();
+}
+
+// Adds visits simulations with a total payoff of reward to the nodes on path and the edges
+// between them, and adds (virtual_losses 1) or takes back (-1) a virtual loss on each
+static void backprop(vector<MctsNodeTnmParallel*>& path, float reward, int visits, int virtual_losses) {
+	for (int i = 0; i < path.size(); i++) {
+		MctsNodeTnmParallel* node = path[i];
+		node->lock();
+		node->inc_visits(visits + virtual_losses);
+		node->inc_reward(reward + virtual_losses * virtual_loss(node));
+		// Update edge info
+		if (i != path.size() - 1) {
+			// Update edge reward and visits
+			for (int j = 0; j < node->children.size(); j++) {
+				// This is the edge we traversed
+				if (node->children[j].first == path[i+1]) {
+					pair<float, int>& edge = node->children[j].second;
+					store_release(edge.first, edge.first + reward + virtual_losses * virtual_loss(path[i+1]));
+					store_release(edge.second, edge.second + visits + virtual_losses);
+					break;
+				}
+			}
+		}
+		node->unlock();
+	}
+}
+
+// Back propagates one simulation in place of virtual_losses virtual losses,
+// then the solved results and all-moves-as-first statistics it changes
+static void back_up(vector<MctsNodeTnmParallel*>& path, float reward, int virtual_losses, const vector<PlayedMove>& played, const MctsConfig& config) {
+	backprop(path, reward, 1, -virtual_losses);
+	// Solved results can only change along the path we took, from the bottom up
+	for (int i = path.size() - 1; i >= 0; i--) {
+		if (!path[i]->update_proven()) {
+			break;
+		}
+	}
+	// All-moves-as-first statistics, also from the bottom up
+	if (config.rave) {
+		AmafMoves moves(played);
+		for (int i = path.size() - 1; i >= 0; i--) {
+			MctsNodeTnmParallel* next = i != path.size() - 1 ? path[i+1] : NULL;
+			path[i]->update_amaf(next, moves, reward);
+		}
+	}
+}
+
+// Back propagates the leaves the batcher has evaluated, whichever thread queued them,
+// waiting a little for one if wait is set, and returns how many there were
+static int complete_evaluations(EvalBatcher* batcher, atomic<int>* in_flight, const MctsConfig& config, bool wait) {
+	vector<EvalRequest*> done;
+	if (wait) {
+		batcher->wait(done, BATCH_POLL_WAIT);
+	} else {
+		batcher->poll(done, false);
+	}
+	for (EvalRequest* req: done) {
+		vector<MctsNodeTnmParallel*>* path = (vector<MctsNodeTnmParallel*>*) req->data;
+		// The batcher does not report the moves of its simulations
+		back_up(*path, req->value, 1, vector<PlayedMove>(), config);
+		(*in_flight)--;
+		delete path;
+		delete req;
+	}
+	return done.size();
+}
+
+MctsAgentTnmParallel::MctsAgentTnmParallel(MctsConfig config): config(config) {
+	evaluator = config.evaluator != NULL ? config.evaluator : &rollout_evaluator;
+	omp_init_lock(&map_mutex);
+}
+
+// Stops any pondering and frees the tree before the lock guarding it
+MctsAgentTnmParallel::~MctsAgentTnmParallel() {
+	this->reset();
+	omp_destroy_lock(&map_mutex);
+}
 
 // time_limit is in seconds
 pair<Move*,int> MctsAgentTnmParallel::best_move(Position* p, float time_limit) {
+	return this->best_move(p, config.search_control(time_limit));
+}
+
+pair<Move*,int> MctsAgentTnmParallel::best_move(Position* p, const SearchControl& control) {
+	// Whatever was searched while pondering stays in the tree
+	ponderer.stop();
+	// Unless every search starts from scratch
+	if (!config.tree_reuse) {
+		this->reset();
+	}
+	return this->search(p, control);
+}
+
+// Grows the tree under p until the next best_move
+void MctsAgentTnmParallel::start_pondering(Position* p) {
+	// A background search would make the tree depend on timing
+	if (!config.ponder || config.deterministic) {
+		return;
+	}
+	SearchControl control = config.search_control(PONDER_TIME_LIMIT);
+	control.stop = ponderer.get_stop_flag();
+	ponderer.start([this, p, control]() {
+		this->search(p, control);
+	});
+}
+
+void MctsAgentTnmParallel::stop_pondering() {
+	ponderer.stop();
+}
+
+pair<Move*,int> MctsAgentTnmParallel::search(Position* p, const SearchControl& control) {
 	double wc_time, cpu_time;
 	timing(&wc_time, &cpu_time);
 	double start = wc_time;
 
+	// Near the end of the game the exact solver is much faster than searching
+	float solved_payoff;
+	Move* solved_move;
+	if (config.solve_root(p, &solved_payoff, &solved_move, control, start)) {
+		return make_pair(solved_move, 0);
+	}
+
 	// Look up node in search tree or create new one
 	MctsNodeTnmParallel* pos_node;
-	if (pos_map.find(p->get_vec()) != pos_map.end()) {
-		pos_node = pos_map.find(p->get_vec())->second;
+	if (pos_map.find(p->get_canonical_vec()) != pos_map.end()) {
+		pos_node = pos_map.find(p->get_canonical_vec())->second;
 	} else {
-		pos_node = new MctsNodeTnmParallel(p);
-		pos_map.insert(make_pair(p->get_vec(), pos_node));
+		pos_node = new MctsNodeTnmParallel(p, config.node_lock, config.lock_free_reads);
+		pos_map.insert(make_pair(p->get_canonical_vec(), pos_node));
 	}
 
+	SearchReporter reporter(config.listener, config.report_interval, config.report_pv);
+	// Every iteration visits the root once, which lets the master thread count them all
+	int start_visits = pos_node->get_visits();
+	// Only nodes this search adds count against the node cap, not those kept from earlier moves
+	long start_nodes = pos_map.size();
 	int iterations = 0;
+	// Set by the master thread when the search can end early
+	bool stop_early = false;
+	// Order in which threads take the tree in deterministic mode
+	RoundSchedule schedule;
+	// Shared by all threads, which queue leaves to it and back propagate whatever it finishes
+	EvalBatcher* batcher = NULL;
+	if (config.batches_evaluations()) {
+		batcher = new EvalBatcher(evaluator, config.eval_batch, config.eval_wait, config.seed);
+	}
+	int max_in_flight = config.max_in_flight();
+	atomic<int> in_flight(0);
 	#pragma omp parallel \
-		shared(start, time_limit, iterations, pos_node) \
+		num_threads(config.threads()) \
+		shared(start, control, iterations, pos_node, p, reporter, start_visits, start_nodes, stop_early, schedule, batcher, max_in_flight, in_flight) \
 		private(wc_time, cpu_time) \
 		default(none)
 	{
+		config.place(omp_get_thread_num());
+
 		// Each thread get its own seed to generate random numbers with
-		unsigned int seed = omp_get_thread_num();		
+		int thread_num = omp_get_thread_num();
+		unsigned int seed = config.seed + thread_num;
+		if (config.deterministic) {
+			#pragma omp single
+			schedule.set_threads(omp_get_num_threads());
+		}
 		
 		double elapsed = 0.0;
+		double next_check = 0.0;
 		int my_iterations = 0;
+		long round = 0;
 		
-		// Continue search algorithm while time_limit is not complete
-		while (elapsed < time_limit) {
-			// Start at base node
-			MctsNodeTnmParallel* leaf_node = pos_node;
-			vector<MctsNodeTnmParallel*> path;
-			path.push_back(pos_node);
-
-			// Traverse tree until we reach a leaf by picking child with highest UCB
-			while (!leaf_node->is_leaf()) {
-				leaf_node = leaf_node->select_child(&seed);
-				path.push_back(leaf_node);
+		// Continue search algorithm until a limit in control is reached
+		// In deterministic mode the master thread decides for everyone
+		while (config.deterministic || !control.should_stop(elapsed, 0, 0)) {
+			bool stopped;
+			#pragma omp atomic read
+			stopped = stop_early;
+			if (stopped) {
+				break;
+			}
+			if (batcher != NULL) {
+				my_iterations += complete_evaluations(batcher, &in_flight, config, false);
 			}
-			printf("thread %d finished traversal\n", omp_get_thread_num());
 
-			float rollout_reward;
-			int rollout_visits = 1;
+			// Descend alone, in thread order, in deterministic mode
+			if (config.deterministic) {
+				schedule.wait_descend(thread_num, round);
+			}
 
-			Position* curr_pos;
-			// We have now reached leaf
-			// If game over, we have reached terminal node
-			if (leaf_node->pos->is_terminal()) {
-				curr_pos = leaf_node->pos;
+			// Stop once the position is solved or the iteration or node cap is reached
+			// Queued leaves count, since their virtual losses visit the root
+			int root_visits;
+			float root_reward, root_proven;
+			pos_node->read_stats(&root_visits, &root_reward, &root_proven);
+			bool solved = root_proven != UNPROVEN;
+			long visited = root_visits - start_visits;
+			long nodes = 0;
+			if (control.max_nodes > 0) {
+				omp_set_lock(&map_mutex);
+				nodes = pos_map.size() - start_nodes;
+				omp_unset_lock(&map_mutex);
 			}
-			// If not game over, then we need to expand and rollout
-			else {
-				// Get the node to rollout from
-				MctsNodeTnmParallel* playout_node;
-				leaf_node->lock();
-				if (leaf_node->get_visits() == 0) {
-					playout_node = leaf_node;
-				} else {
-					leaf_node->expand(&pos_map);
-					playout_node = leaf_node->select_first_child();
-					path.push_back(playout_node);
+			bool done = solved || control.should_stop(elapsed, visited, nodes);
+			// Every thread leaves after the same round, and threads that would
+			// go past the iteration cap sit the last round out
+			bool skip = false;
+			if (config.deterministic) {
+				if (thread_num == 0) {
+					schedule.set_finished(done);
+				}
+				done = schedule.is_finished();
+				skip = control.max_iterations > 0 && visited + thread_num >= control.max_iterations;
+				if (done || skip) {
+					schedule.pass();
+					schedule.wait_backup(thread_num, round);
+					schedule.pass();
+					round++;
 				}
-				leaf_node->unlock();
-				curr_pos = playout_node->pos; 	
 			}
-			printf("thread %d finished expansion\n", omp_get_thread_num());
+			if (done) {
+				break;
+			}
+			if (skip) {
+				continue;
+			}
+
+			// Wait for results while as many leaves as allowed are queued
+			if (batcher != NULL && in_flight++ >= max_in_flight) {
+				in_flight--;
+				my_iterations += complete_evaluations(batcher, &in_flight, config, true);
+				timing(&wc_time, &cpu_time);
+				elapsed = wc_time - start;
+				continue;
+			}
+
+			vector<MctsNodeTnmParallel*> path;
+			Position* curr_pos = descend(pos_node, path, &pos_map, &map_mutex, config, &seed);
+
+			if (config.deterministic) {
+				schedule.pass();
+			}
 
-			// Rollout phase can be done without access to tree
-			while (!curr_pos->is_terminal()) {
-				vector<Move*> poss_moves = curr_pos->possible_moves();
-				Move* next_move = poss_moves[rand_r(&seed) % poss_moves.size()];
-				curr_pos = curr_pos->make_move(next_move);
+			// Evaluation phase can be done without access to tree
+			float rollout_reward;
+			bool leaf_solved = false;
+			bool queued = false;
+			// Moves made by the evaluator, for RAVE
+			vector<PlayedMove> played;
+			if (curr_pos->is_terminal()) {
+				rollout_reward = curr_pos->payoff();
+			} else if (config.solve_leaf(curr_pos, &rollout_reward)) {
+				// Exact value, recorded once we have access to the tree again
+				leaf_solved = true;
+			} else if (batcher != NULL) {
+				// The leaf waits for the batcher with a virtual loss, so the next descents go elsewhere
+				backprop(path, 0, 0, 1);
+				vector<MctsNodeTnmParallel*>* queued_path = new vector<MctsNodeTnmParallel*>();
+				queued_path->swap(path);
+				batcher->submit(new EvalRequest(curr_pos, queued_path));
+				queued = true;
+			} else if (config.rave) {
+				rollout_reward = evaluator->evaluate_moves(curr_pos, &seed, &played);
+			} else {
+				rollout_reward = evaluator->evaluate(curr_pos, &seed);
 			}
-			// Now at terminal state
-			rollout_reward = curr_pos->payoff();
-			my_iterations++;
-			printf("thread %d finished rollout\n", omp_get_thread_num());
-
-			// Back propagate
-			for (int i = 0; i < path.size(); i++) {
-				MctsNodeTnmParallel* node = path[i];
-				node->lock();
-				//printf("Path[%d] = %p\n", i, node);
-				Position* node_pos = node->pos;
-				node->inc_visits(rollout_visits);
-				node->inc_reward(rollout_reward);
-				// Update edge info
-				if (i != path.size() - 1) {
-					// Update edge reward and visits
-					for (int j = 0; j < node->children.size(); j++) {
-						// This is the edge we traversed
-						if (node->children[j].first == path[i+1]) {
-							node->children[j].second.first += rollout_reward;
-							node->children[j].second.second += rollout_visits;
-							break;
-						}
-					}
+
+			if (!queued) {
+				if (batcher != NULL) {
+					in_flight--;
+				}
+				my_iterations++;
+
+				// Back up alone, in thread order, in deterministic mode
+				if (config.deterministic) {
+					schedule.wait_backup(thread_num, round);
+				}
+				if (leaf_solved) {
+					path.back()->lock();
+					path.back()->set_proven(rollout_reward);
+					path.back()->unlock();
+				}
+				back_up(path, rollout_reward, 0, played, config);
+				if (config.deterministic) {
+					schedule.pass();
+					round++;
 				}
-				node->unlock();
 			}
-			printf("thread %d finished backprop\n", omp_get_thread_num());
 			
 			// Update elapsed time
 			timing(&wc_time, &cpu_time);
 			elapsed = wc_time - start;
+
+			// Master thread reports progress, locking at most one node at a time
+			if (thread_num == 0 && reporter.due(elapsed)) {
+				reporter.report(snapshot(reporter, p, &pos_map, &map_mutex, pos_node->get_visits() - start_visits, elapsed));
+			}
+
+			// Master thread stops everyone once the most visited move can no longer be overtaken
+			if (thread_num == 0 && config.early_stop && elapsed >= next_check) {
+				next_check = elapsed + config.early_stop_interval;
+				int best_visits, second_visits;
+				pos_node->top_two_visits(&best_visits, &second_visits);
+				int searched = pos_node->get_visits() - start_visits;
+				if (config.can_stop_early(best_visits, second_visits, searched, elapsed, control.time_limit)) {
+					#pragma omp atomic write
+					stop_early = true;
+				}
+			}
+		}
+		// Queued leaves are back propagated before the search ends
+		while (batcher != NULL && in_flight > 0) {
+			my_iterations += complete_evaluations(batcher, &in_flight, config, true);
 		}
 		#pragma omp atomic update
 		iterations += my_iterations;
 	}
-	cout << "one call to best_move done" << endl;
+	delete batcher;
+	if (reporter.enabled()) {
+		timing(&wc_time, &cpu_time);
+		SearchInfo info = snapshot(reporter, p, &pos_map, &map_mutex, iterations, wc_time - start);
+		info.final = true;
+		reporter.report(info);
+	}
 
 	// Parallel section finished
 	// Can now serially safely access tree results
 	// Choose best action
 	float max_ratio = -INFINITY;
 	Move* best_move = NULL;
-	for (Move* move: p->possible_moves()) {
+	vector<Move*> moves = p->possible_moves();
+	for (Move* move: moves) {
 		Position* next_pos = p->make_move(move);
-		MctsNodeTnmParallel* next_node = pos_map.find(next_pos->get_vec())->second;	
+		// Child may not exist yet if the search was very short
+		if (pos_map.find(next_pos->get_canonical_vec()) == pos_map.end()) {
+			continue;
+		}
+		MctsNodeTnmParallel* next_node = pos_map.find(next_pos->get_canonical_vec())->second;	
 		// printf("%p: (%f, %d)\n", next_node, next_node->get_reward(), next_node->get_visits());
 		// move->print();
-		if (next_node->get_visits() == 0) {
+		float curr_ratio;
+		// Solved children are ranked by their exact value
+		if (next_node->is_proven()) {
+			curr_ratio = proven_ratio(next_node->get_proven());
+		} else if (next_node->get_visits() == 0) {
 			continue;
+		} else {
+			curr_ratio = (float) next_node->get_reward() / (float) next_node->get_visits();
 		}
-		float curr_ratio = (float) next_node->get_reward() / (float) next_node->get_visits();
 		// Player 1 wants least number of wins for player 0
 		if (p->whose_turn() == 1) {
 			curr_ratio *= -1.0;
@@ -258,10 +843,19 @@ pair<Move*,int> MctsAgentTnmParallel::best_move(Position* p, float time_limit) {
 			best_move = move;
 		}
 	}
+	// Nothing was searched, any legal move will do
+	if (best_move == NULL) {
+		best_move = moves[0];
+	}
 	return make_pair(best_move, iterations);
 }
 
+pos_map_tnm_t* MctsAgentTnmParallel::get_pos_map() {
+	return &pos_map;
+}
+
 void MctsAgentTnmParallel::reset() {
+	ponderer.stop();
 	for (auto it: pos_map) {
 		// Delete node
 		delete it.second;
@@ -3,40 +3,103 @@
 
 #include <omp.h>
 
+#include <atomic>
 #include <cstdlib>
 #include <unordered_map>
 #include <vector>
 using namespace std;
 
 #include "game.h"
+#include "mcts_config.h"
+#include "node_lock.h"
+#include "seqlock.h"
 
-#define UCB_CONSTANT (2)
 
 // Node in computation tree to represent positions
-class MctsNodeTnmParallel {
+// Every node starts on its own cache line, with the lock and the statistics
+// that threads change under it at the front
+// Writers always take the lock. Readers take it too, or with lock_free_reads
+// copy what they need through a seqlock and retry if a writer got in the way;
+// like the lock kind, this is fixed when the node is created
+class alignas(CACHE_LINE_SIZE) MctsNodeTnmParallel {
 	private:
+		NodeLock node_mutex;
+		SeqLock seq;
+		bool lock_free_reads;
 		float reward;
 		int visits;
-		omp_lock_t node_mutex;
-		bool am_leaf;
+		// Exact payoff once the node is solved, UNPROVEN otherwise
+		float proven;
+		atomic<bool> am_leaf;
+		// Moves that have not been turned into children yet
+		vector<Move*> untried;
+		// Priors of the untried moves, in the same order (empty without priors)
+		vector<float> untried_priors;
+		// Copies of untried.size() and the prior of the next untried move (-1 without priors)
+		// for readers
+		int untried_left;
+		float next_prior;
+		// Moves taken from untried whose edge is not added yet; the node is not
+		// solved by its children while any are in flight
+		int expanding;
+		// Children visible to readers, published after the edge is complete
+		atomic<int> num_children;
+		// Runs copy so that it sees the node between two writes
+		// copy may run more than once and must only load fields with load_acquire
+		template <class F>
+		void read(F copy) {
+			if (lock_free_reads) {
+				unsigned version;
+				do {
+					version = seq.read_begin();
+					copy();
+				} while (seq.read_retry(version));
+			} else {
+				node_mutex.lock();
+				copy();
+				node_mutex.unlock();
+			}
+		}
+		// Copies the published edges, returns the node's visits at the same moment
+		int read_children(vector<pair<MctsNodeTnmParallel*, pair<float, int>>>& edges, vector<AmafEdge>& amaf_edges, vector<float>& edge_priors);
 	public:
 		Position* pos;
+		// Room for every move is reserved on expansion, so the edges never move
+		// while readers copy them
 		vector<pair<MctsNodeTnmParallel*, pair<float, int>>> children;
+		// All-moves-as-first statistics of each edge, in the same order as children
+		vector<AmafEdge> amaf;
+		// Prior of each edge, in the same order as children (-1 without priors)
+		vector<float> priors;
 		// Functions
+		// Held to change the node; fields readers copy are written with store_release
 		void lock();
 		void unlock();
-		MctsNodeTnmParallel(Position* p);
+		MctsNodeTnmParallel(Position* p, NodeLockKind lock_kind = LOCK_OMP, bool lock_free_reads = false);
+		~MctsNodeTnmParallel();
+		// new does not align past 16 bytes before C++17
+		static void* operator new(size_t size);
+		static void operator delete(void* p);
 		float get_reward();
 		int get_visits();
+		// Visits, reward and proven value from the same moment
+		void read_stats(int* visits, float* reward, float* proven);
 		bool is_leaf();
-		int get_player();
-		void add_child(MctsNodeTnmParallel* new_child);
+		void add_child(MctsNodeTnmParallel* new_child, int key, bool mirrored, float prior);
 		void inc_reward(float delta);
 		void inc_visits(float delta);
-		void expand(unordered_map<vector<int>, MctsNodeTnmParallel*, pos_hash>* pos_map);
-		float calc_ucb2_child(pair<MctsNodeTnmParallel*, pair<float, int>> child, int parent_visits);
-		MctsNodeTnmParallel* select_child(unsigned int* seed);
-		MctsNodeTnmParallel* select_first_child();
+		bool is_proven();
+		float get_proven();
+		void set_proven(float value);
+		bool update_proven();
+		void expand(MovePrior* prior);
+		bool can_widen(int max_children);
+		bool prefers_untried(const MctsConfig& config);
+		MctsNodeTnmParallel* expand_child(unordered_map<vector<int>, MctsNodeTnmParallel*, pos_hash>* pos_map, omp_lock_t* map_mutex);
+		float calc_ucb2_child(pair<MctsNodeTnmParallel*, pair<float, int>> child, const AmafEdge& amaf, float prior, const MctsConfig& config, int parent_visits);
+		MctsNodeTnmParallel* select_child(const MctsConfig& config, unsigned int* seed);
+		void update_amaf(MctsNodeTnmParallel* next, AmafMoves& moves, float reward);
+		void top_two_visits(int* best, int* second);
 };
 
 typedef pair<MctsNodeTnmParallel*, pair<float,int>> child_info_tnm;
@@ -44,11 +107,25 @@ typedef unordered_map<vector<int>, MctsNodeTnmParallel*, pos_hash> pos_map_tnm_t
 
 class MctsAgentTnmParallel: public Agent {
 	private:
+		MctsConfig config;
+		Evaluator* evaluator;
+		RolloutEvaluator rollout_evaluator;
 		pos_map_tnm_t pos_map;
+		// Threads insert into pos_map while expanding
+		omp_lock_t map_mutex;
+		// Background search between moves, declared last so it stops before the tree goes away
+		Ponderer ponderer;
+		pair<Move*,int> search(Position* p, const SearchControl& control);
 	public:
-		MctsAgentTnmParallel();
+		MctsAgentTnmParallel(MctsConfig config = MctsConfig());
+		~MctsAgentTnmParallel();
 		pair<Move*,int> best_move(Position* p, float time_limit);
+		pair<Move*,int> best_move(Position* p, const SearchControl& control) override;
 		void reset();
+		// Search tree for tests and tools, not to be used while a search is running
+		pos_map_tnm_t* get_pos_map();
+		void start_pondering(Position* p) override;
+		void stop_pondering() override;
 };
 
 #endif
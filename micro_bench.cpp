@@ -0,0 +1,202 @@
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+using namespace std;
+
+#include "game.h"
+#include "timing.h"
+#include "connect_four.h"
+#include "connect_four_bitboard.h"
+#include "rollout_policy.h"
+#include "mcts_serial.h"
+
+// Microbenchmarks of the game kernel and the search primitives, each timed in
+// isolation on fixed positions so that a change to a hot path can be measured
+// before it shows up in agent throughput
+
+// Seconds per sample, and samples per benchmark
+#define SAMPLE_SECONDS (0.02)
+#define DEFAULT_SAMPLES (15)
+
+// Middle game position most benchmarks start from: columns played (1-7)
+#define MIDGAME "44433352"
+// Depth of the path back propagated by the backprop benchmark
+#define PATH_DEPTH (8)
+
+// Results of every call go here so the compiler cannot drop them
+volatile unsigned long sink;
+
+// Seconds taken by reps calls of op
+template <class Op>
+double time_batch(Op& op, long reps) {
+	double start, end, cpu;
+	unsigned long total = 0;
+	timing(&start, &cpu);
+	for (long i = 0; i < reps; i++) {
+		total += op(i);
+	}
+	timing(&end, &cpu);
+	sink += total;
+	return end - start;
+}
+
+// Times op in samples of about SAMPLE_SECONDS each, after a warm-up batch that
+// also picks the number of calls per sample
+// Reports the median time per call, the fastest sample, and the median absolute
+// deviation of the samples relative to the median
+template <class Op>
+void bench(const string& name, const string& filter, int samples, Op op) {
+	if (name.find(filter) == string::npos) {
+		return;
+	}
+	long reps = 1;
+	while (time_batch(op, reps) < SAMPLE_SECONDS) {
+		reps *= 2;
+	}
+	vector<double> ns;
+	for (int s = 0; s < samples; s++) {
+		ns.push_back(time_batch(op, reps) * 1e9 / reps);
+	}
+	sort(ns.begin(), ns.end());
+	double median = ns[ns.size() / 2];
+	vector<double> deviations;
+	for (double t: ns) {
+		deviations.push_back(fabs(t - median));
+	}
+	sort(deviations.begin(), deviations.end());
+	double mad = deviations[deviations.size() / 2];
+	printf("%-34s %12.1f %12.1f %8.1f%%\n", name.c_str(), median, ns[0], 100 * mad / median);
+	fflush(stdout);
+}
+
+int main(int argc, char* argv[]) {
+	string filter = argc > 1 ? argv[1] : "";
+	int samples = argc > 2 ? atoi(argv[2]) : DEFAULT_SAMPLES;
+	if (samples <= 0) {
+		cout << "Usage: ./micro_bench [Filter] [Samples]" << endl;
+		exit(-1);
+	}
+
+	ConnectFourGame game;
+	Position* empty = game.new_game();
+	Position* midgame = game.from_moves(MIDGAME);
+	vector<Move*> moves = midgame->possible_moves();
+	ConnectFourBitboard bb = ConnectFourBitboard::from_vec(midgame->get_vec());
+	unsigned int seed = 1;
+
+	printf("%-34s %12s %12s %9s\n", "benchmark", "median ns", "min ns", "MAD");
+
+	// Game kernel, vector representation
+	bench("vector make_move", filter, samples, [&](long i) {
+		Position* next = midgame->make_move(moves[i % moves.size()]);
+		unsigned long turn = next->whose_turn();
+		delete next;
+		return turn;
+	});
+	bench("vector possible_moves", filter, samples, [&](long) {
+		vector<Move*> m = midgame->possible_moves();
+		unsigned long n = m.size();
+		for (Move* move: m) {
+			delete move;
+		}
+		return n;
+	});
+	bench("vector is_terminal (check_winner)", filter, samples, [&](long) {
+		return (unsigned long) midgame->is_terminal();
+	});
+	bench("vector get_canonical_vec", filter, samples, [&](long) {
+		return (unsigned long) midgame->get_canonical_vec()[0];
+	});
+
+	// Game kernel, bitboard representation
+	bench("bitboard play", filter, samples, [&](long i) {
+		ConnectFourBitboard next = bb;
+		next.play(i % COLS);
+		return (unsigned long) next.mask;
+	});
+	bench("bitboard possible", filter, samples, [&](long i) {
+		ConnectFourBitboard b = bb;
+		b.current ^= i;
+		return (unsigned long) __builtin_popcountll(b.possible());
+	});
+	bench("bitboard last_player_won", filter, samples, [&](long i) {
+		ConnectFourBitboard b = bb;
+		b.current ^= i & 1;
+		return (unsigned long) b.last_player_won();
+	});
+	bench("bitboard from_vec", filter, samples, [&](long) {
+		return (unsigned long) ConnectFourBitboard::from_vec(midgame->get_vec()).mask;
+	});
+
+	// Whole rollouts from the empty board
+	RandomRolloutPolicy random_policy;
+	ConnectFourRolloutPolicy bitboard_policy(false, 0);
+	ConnectFourRolloutPolicy tactical_policy(true, 0);
+	bench("rollout random (vector)", filter, samples, [&](long) {
+		return (unsigned long) (2 * random_policy.rollout(empty, &seed));
+	});
+	bench("rollout random (bitboard)", filter, samples, [&](long) {
+		return (unsigned long) (2 * bitboard_policy.rollout(empty, &seed));
+	});
+	bench("rollout tactical (bitboard)", filter, samples, [&](long) {
+		return (unsigned long) (2 * tactical_policy.rollout(empty, &seed));
+	});
+
+	// Search primitives on a small serial tree: a node with every child visited
+	// and a path of PATH_DEPTH nodes below it
+	MctsConfig config;
+	pos_map_t pos_map;
+	vector<MctsNodeSerial*> path;
+	MctsNodeSerial* node = new MctsNodeSerial(midgame);
+	pos_map.insert(make_pair(midgame->get_canonical_vec(), node));
+	for (int depth = 0; depth < PATH_DEPTH && !node->pos->is_terminal(); depth++) {
+		path.push_back(node);
+		node->inc_visits(1);
+		node->expand(NULL);
+		MctsNodeSerial* child;
+		while ((child = node->expand_child(&pos_map)) != NULL) {
+			int visits = 1 + rand_r(&seed) % 20;
+			node->update_edge(child, rand_r(&seed) % (visits + 1), visits);
+			child->inc_visits(visits);
+			child->inc_reward(rand_r(&seed) % (visits + 1));
+			node->inc_visits(visits);
+		}
+		node = node->children[0].first;
+	}
+	path.push_back(node);
+	MctsNodeSerial* root = path[0];
+	bench("select_child", filter, samples, [&](long) {
+		return (unsigned long) root->select_child(config, &seed);
+	});
+	// What back propagation does for each iteration of the serial agent
+	bench("backprop (8 plies)", filter, samples, [&](long i) {
+		float reward = i & 1;
+		for (int p = 0; p < path.size(); p++) {
+			path[p]->inc_visits(1);
+			path[p]->inc_reward(reward);
+			if (p != path.size() - 1) {
+				path[p]->update_edge(path[p+1], reward, 1);
+			}
+		}
+		return (unsigned long) path.size();
+	});
+	bench("pos_map find", filter, samples, [&](long i) {
+		return (unsigned long) pos_map.count(path[i % path.size()]->pos->get_canonical_vec());
+	});
+
+	for (auto it: pos_map) {
+		delete it.second;
+	}
+	for (Move* move: moves) {
+		delete move;
+	}
+	delete midgame;
+	delete empty;
+	return 0;
+}
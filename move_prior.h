@@ -0,0 +1,35 @@
+#ifndef MOVE_PRIOR_H
+#define MOVE_PRIOR_H
+
+#include <algorithm>
+#include <vector>
+using namespace std;
+
+#include "game.h"
+
+// Cheap static guess of how good each move of a position is, for PUCT selection
+class MovePrior {
+	public:
+		// Priors of the given moves of pos, in the same order, summing to 1
+		// Must be safe to call from several threads at once
+		virtual vector<float> priors(Position* pos, const vector<Move*>& moves) = 0;
+		virtual ~MovePrior() {}
+};
+
+// Orders moves, and their priors with them, from the least to the most likely,
+// so that taking moves from the back tries the most likely first
+inline void sort_by_prior(vector<Move*>& moves, vector<float>& priors) {
+	vector<pair<float, Move*>> order;
+	for (int i = 0; i < moves.size(); i++) {
+		order.push_back(make_pair(priors[i], moves[i]));
+	}
+	stable_sort(order.begin(), order.end(), [](const pair<float, Move*>& a, const pair<float, Move*>& b) {
+		return a.first < b.first;
+	});
+	for (int i = 0; i < moves.size(); i++) {
+		priors[i] = order[i].first;
+		moves[i] = order[i].second;
+	}
+}
+
+#endif
@@ -0,0 +1,93 @@
+#include <stdlib.h>
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include <new>
+using namespace std;
+
+#include "node_lock.h"
+
+static const char* LOCK_NAMES[] = {"omp", "spin", "ticket", "futex"};
+
+bool parse_node_lock(const string& name, NodeLockKind* kind) {
+#ifndef __linux__
+	// Futexes are Linux only
+	if (name == LOCK_NAMES[LOCK_FUTEX]) {
+		return false;
+	}
+#endif
+	for (int i = 0; i < sizeof(LOCK_NAMES) / sizeof(LOCK_NAMES[0]); i++) {
+		if (name == LOCK_NAMES[i]) {
+			*kind = (NodeLockKind) i;
+			return true;
+		}
+	}
+	return false;
+}
+
+const char* node_lock_name(NodeLockKind kind) {
+	return LOCK_NAMES[kind];
+}
+
+NodeLock::NodeLock(NodeLockKind kind): kind(kind), state(0), serving(0) {
+	if (kind == LOCK_OMP) {
+		omp_init_lock(&omp_lock);
+	}
+}
+
+NodeLock::~NodeLock() {
+	if (kind == LOCK_OMP) {
+		omp_destroy_lock(&omp_lock);
+	}
+}
+
+#ifdef __linux__
+
+static long futex(atomic<int>* addr, int op, int value) {
+	return syscall(SYS_futex, (int*) addr, op, value, NULL, NULL, 0);
+}
+
+// Marks the lock as having waiters and sleeps until an unlock finds it free
+void NodeLock::futex_lock() {
+	int c = state.exchange(2, memory_order_acquire);
+	while (c != 0) {
+		futex(&state, FUTEX_WAIT_PRIVATE, 2);
+		c = state.exchange(2, memory_order_acquire);
+	}
+}
+
+// Called once unlock has seen waiters: frees the lock and wakes one of them
+void NodeLock::futex_unlock() {
+	state.store(0, memory_order_release);
+	futex(&state, FUTEX_WAKE_PRIVATE, 1);
+}
+
+#else
+
+// Without futexes a contended lock spins like LOCK_SPIN
+void NodeLock::futex_lock() {
+	for (int spins = 0; state.exchange(2, memory_order_acquire) != 0; ) {
+		if (++spins % LOCK_SPINS == 0) {
+			this_thread::yield();
+		} else {
+			cpu_relax();
+		}
+	}
+}
+
+void NodeLock::futex_unlock() {
+	state.store(0, memory_order_release);
+}
+
+#endif
+
+void* cache_aligned_alloc(size_t size) {
+	void* p;
+	if (posix_memalign(&p, CACHE_LINE_SIZE, size) != 0) {
+		throw bad_alloc();
+	}
+	return p;
+}
@@ -0,0 +1,123 @@
+#ifndef NODE_LOCK_H
+#define NODE_LOCK_H
+
+#include <omp.h>
+
+#include <atomic>
+#include <string>
+#include <thread>
+using namespace std;
+
+// Size of a cache line; nodes that threads lock are aligned and padded to it
+// so that locking one node never invalidates the line of another
+#define CACHE_LINE_SIZE (64)
+
+// Spins of a waiting thread before it gives up its CPU for a while
+#define LOCK_SPINS (64)
+
+// How a node lock waits for its holder
+enum NodeLockKind {
+	// omp_lock_t
+	LOCK_OMP,
+	// Test-and-test-and-set spinlock
+	LOCK_SPIN,
+	// Ticket lock, which hands the lock out in arrival order
+	LOCK_TICKET,
+	// Mutex that sleeps in the kernel (futex) once it is contended
+	// Linux only; elsewhere it spins instead and is not accepted by name
+	LOCK_FUTEX,
+};
+
+// Parses omp, spin, ticket or futex (on Linux)
+// Returns false if the name is unknown
+bool parse_node_lock(const string& name, NodeLockKind* kind);
+const char* node_lock_name(NodeLockKind kind);
+
+inline void cpu_relax() {
+#if defined(__x86_64__) || defined(__i386__)
+	__builtin_ia32_pause();
+#endif
+}
+
+// Lock of one tree node, of the kind chosen when it is created
+// The kind is fixed for the lock's lifetime, so lock and unlock branch predictably
+class NodeLock {
+	private:
+		NodeLockKind kind;
+		omp_lock_t omp_lock;
+		// Spin: 1 while held
+		// Ticket: next ticket to hand out
+		// Futex: 0 free, 1 held, 2 held with waiters
+		atomic<int> state;
+		// Ticket: ticket allowed in
+		atomic<int> serving;
+		void futex_lock();
+		void futex_unlock();
+	public:
+		NodeLock(NodeLockKind kind = LOCK_OMP);
+		~NodeLock();
+		NodeLockKind get_kind() const {
+			return kind;
+		}
+		void lock() {
+			switch (kind) {
+				case LOCK_OMP:
+					omp_set_lock(&omp_lock);
+					break;
+				case LOCK_SPIN:
+					for (int spins = 0; state.exchange(1, memory_order_acquire); ) {
+						// Wait on our cached copy until the holder lets go
+						while (state.load(memory_order_relaxed)) {
+							if (++spins % LOCK_SPINS == 0) {
+								this_thread::yield();
+							} else {
+								cpu_relax();
+							}
+						}
+					}
+					break;
+				case LOCK_TICKET: {
+					int ticket = state.fetch_add(1, memory_order_relaxed);
+					for (int spins = 0; serving.load(memory_order_acquire) != ticket; ) {
+						if (++spins % LOCK_SPINS == 0) {
+							this_thread::yield();
+						} else {
+							cpu_relax();
+						}
+					}
+					break;
+				}
+				case LOCK_FUTEX: {
+					int expected = 0;
+					if (!state.compare_exchange_strong(expected, 1, memory_order_acquire)) {
+						this->futex_lock();
+					}
+					break;
+				}
+			}
+		}
+		void unlock() {
+			switch (kind) {
+				case LOCK_OMP:
+					omp_unset_lock(&omp_lock);
+					break;
+				case LOCK_SPIN:
+					state.store(0, memory_order_release);
+					break;
+				case LOCK_TICKET:
+					serving.store(serving.load(memory_order_relaxed) + 1, memory_order_release);
+					break;
+				case LOCK_FUTEX:
+					// Only wake someone if a thread went to sleep on the lock
+					if (state.fetch_sub(1, memory_order_release) != 1) {
+						this->futex_unlock();
+					}
+					break;
+			}
+		}
+};
+
+// Allocation aligned to a cache line, for classes whose objects must not share one
+void* cache_aligned_alloc(size_t size);
+
+#endif
@@ -0,0 +1,160 @@
+#include <dirent.h>
+#include <linux/perf_event.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <cstdint>
+using namespace std;
+
+#include "perf_counters.h"
+
+// Type and config of each PerfEvent for perf_event_open
+static const struct {
+	const char* name;
+	uint32_t type;
+	uint64_t config;
+} EVENTS[PERF_EVENT_COUNT] = {
+	{"cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+	{"instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+	{"llc_misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+	{"branch_misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+	{"context_switches", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES},
+};
+
+const char* perf_event_name(PerfEvent event) {
+	return EVENTS[event].name;
+}
+
+PerfCounts::PerfCounts() {
+	for (int e = 0; e < PERF_EVENT_COUNT; e++) {
+		counts[e] = -1;
+	}
+}
+
+void PerfCounts::add(const PerfCounts& other) {
+	for (int e = 0; e < PERF_EVENT_COUNT; e++) {
+		if (other.counts[e] >= 0) {
+			counts[e] = max(counts[e], 0LL) + other.counts[e];
+		}
+	}
+}
+
+double PerfCounts::ipc() const {
+	if (!this->has(PERF_CYCLES) || !this->has(PERF_INSTRUCTIONS) || counts[PERF_CYCLES] == 0) {
+		return -1;
+	}
+	return (double) counts[PERF_INSTRUCTIONS] / counts[PERF_CYCLES];
+}
+
+double PerfCounts::per(PerfEvent event, double work) const {
+	if (!this->has(event) || work <= 0) {
+		return -1;
+	}
+	return counts[event] / work;
+}
+
+// Opens a disabled counter of event on thread tid, -1 if that is not possible
+static int open_counter(int tid, PerfEvent event) {
+	struct perf_event_attr attr;
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = EVENTS[event].type;
+	attr.config = EVENTS[event].config;
+	attr.disabled = 1;
+	attr.inherit = 1;
+	attr.exclude_hv = 1;
+	// Counters are multiplexed when there are more than the PMU has
+	attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+	int fd = syscall(SYS_perf_event_open, &attr, tid, -1, -1, 0);
+	if (fd < 0) {
+		// perf_event_paranoid may still allow counting user space
+		attr.exclude_kernel = 1;
+		fd = syscall(SYS_perf_event_open, &attr, tid, -1, -1, 0);
+	}
+	return fd;
+}
+
+// Count of a counter, scaled up if it only ran part of the time, -1 if it cannot be read
+static long long read_counter(int fd) {
+	uint64_t values[3];
+	if (fd < 0 || read(fd, values, sizeof(values)) != sizeof(values)) {
+		return -1;
+	}
+	if (values[2] == 0) {
+		return 0;
+	}
+	return (long long) ((double) values[0] * values[1] / values[2]);
+}
+
+PerfCounters::~PerfCounters() {
+	this->close_all();
+}
+
+void PerfCounters::close_all() {
+	for (ThreadCounters& thread: threads) {
+		for (int e = 0; e < PERF_EVENT_COUNT; e++) {
+			if (thread.fds[e] >= 0) {
+				close(thread.fds[e]);
+			}
+		}
+	}
+	threads.clear();
+}
+
+void PerfCounters::start() {
+	this->close_all();
+	DIR* dir = opendir("/proc/self/task");
+	if (dir == NULL) {
+		return;
+	}
+	struct dirent* entry;
+	while ((entry = readdir(dir)) != NULL) {
+		if (entry->d_name[0] == '.') {
+			continue;
+		}
+		ThreadCounters thread;
+		thread.tid = atoi(entry->d_name);
+		for (int e = 0; e < PERF_EVENT_COUNT; e++) {
+			thread.fds[e] = open_counter(thread.tid, (PerfEvent) e);
+		}
+		threads.push_back(thread);
+	}
+	closedir(dir);
+	for (ThreadCounters& thread: threads) {
+		for (int e = 0; e < PERF_EVENT_COUNT; e++) {
+			if (thread.fds[e] >= 0) {
+				ioctl(thread.fds[e], PERF_EVENT_IOC_ENABLE, 0);
+			}
+		}
+	}
+}
+
+void PerfCounters::stop() {
+	for (ThreadCounters& thread: threads) {
+		for (int e = 0; e < PERF_EVENT_COUNT; e++) {
+			if (thread.fds[e] >= 0) {
+				ioctl(thread.fds[e], PERF_EVENT_IOC_DISABLE, 0);
+			}
+			thread.counts.counts[e] = read_counter(thread.fds[e]);
+		}
+	}
+}
+
+PerfCounts PerfCounters::total() const {
+	PerfCounts total;
+	for (const ThreadCounters& thread: threads) {
+		total.add(thread.counts);
+	}
+	return total;
+}
+
+vector<pair<int, PerfCounts>> PerfCounters::per_thread() const {
+	vector<pair<int, PerfCounts>> result;
+	for (const ThreadCounters& thread: threads) {
+		result.push_back(make_pair(thread.tid, thread.counts));
+	}
+	return result;
+}
@@ -0,0 +1,63 @@
+#ifndef PERF_COUNTERS_H
+#define PERF_COUNTERS_H
+
+#include <vector>
+using namespace std;
+
+// Events counted by PerfCounters
+enum PerfEvent {
+	PERF_CYCLES,
+	PERF_INSTRUCTIONS,
+	// Last level cache misses
+	PERF_LLC_MISSES,
+	PERF_BRANCH_MISSES,
+	PERF_CONTEXT_SWITCHES,
+	PERF_EVENT_COUNT,
+};
+
+// Event counts of a thread or of the whole process
+// -1 means the event could not be counted
+struct PerfCounts {
+	long long counts[PERF_EVENT_COUNT];
+	PerfCounts();
+	bool has(PerfEvent event) const {
+		return counts[event] >= 0;
+	}
+	// Sums counts, an event stays unavailable only if it is in neither
+	void add(const PerfCounts& other);
+	// Instructions per cycle, -1 if either is unavailable
+	double ipc() const;
+	// Count of event per unit of work, -1 if unavailable
+	double per(PerfEvent event, double work) const;
+};
+
+// Counts events of every thread of the process between start and stop
+// through Linux perf_event_open, counting user space only when the kernel
+// does not allow more. Events the machine or its permissions do not support
+// (no PMU in a VM, perf_event_paranoid, seccomp) are left out silently and
+// read as -1, so callers only need to check has() before using a count
+// Threads created while counting are added to the thread that created them
+class PerfCounters {
+	private:
+		struct ThreadCounters {
+			int tid;
+			int fds[PERF_EVENT_COUNT];
+			PerfCounts counts;
+		};
+		vector<ThreadCounters> threads;
+		void close_all();
+	public:
+		~PerfCounters();
+		// Opens counters on the threads that exist now and starts counting
+		void start();
+		// Stops counting and keeps the counts of each thread
+		void stop();
+		// Counts of the process since start
+		PerfCounts total() const;
+		// Thread ids and counts of each thread since start
+		vector<pair<int, PerfCounts>> per_thread() const;
+};
+
+const char* perf_event_name(PerfEvent event);
+
+#endif
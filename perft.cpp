@@ -0,0 +1,276 @@
+#include <omp.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+using namespace std;
+
+#include "game.h"
+#include "timing.h"
+#include "connect_four.h"
+#include "connect_four_bitboard.h"
+
+// Counts the positions reached after exactly depth moves (perft), through the
+// Position interface and through the bitboard, to check move generation and
+// win detection against known counts and to measure their throughput
+// Finished games are not extended, so a game won on move 7 adds nothing to depth 8
+
+// Known counts from the empty board, by depth
+static const long long EMPTY_BOARD_COUNTS[] = {1, 7, 49, 343, 2401, 16807, 117649, 823536, 5673234};
+#define KNOWN_DEPTH ((int) (sizeof(EMPTY_BOARD_COUNTS) / sizeof(EMPTY_BOARD_COUNTS[0])) - 1)
+
+// Transposition tables, one per thread: count below a position for a remaining depth
+// Mirror images have the same counts, so the vector table is keyed by the canonical vec
+typedef unordered_map<vector<int>, long long, pos_hash> vec_table_t;
+typedef unordered_map<uint64_t, long long> bitboard_table_t;
+
+// Only subtrees at least this deep are stored, shallower ones are cheaper to count again
+#define TABLE_MIN_DEPTH (2)
+
+long long perft(Position* pos, int depth, vec_table_t* table) {
+	if (depth == 0) {
+		return 1;
+	}
+	if (pos->is_terminal()) {
+		return 0;
+	}
+	vector<int> key;
+	if (table != NULL && depth >= TABLE_MIN_DEPTH) {
+		key = pos->get_canonical_vec();
+		key.push_back(depth);
+		auto it = table->find(key);
+		if (it != table->end()) {
+			return it->second;
+		}
+	}
+	long long nodes = 0;
+	for (Move* move: pos->possible_moves()) {
+		Position* child = pos->make_move(move);
+		nodes += perft(child, depth - 1, table);
+		delete child;
+		delete move;
+	}
+	if (!key.empty()) {
+		table->insert(make_pair(key, nodes));
+	}
+	return nodes;
+}
+
+long long perft(const ConnectFourBitboard& bb, int depth, bitboard_table_t* table) {
+	if (depth == 0) {
+		return 1;
+	}
+	if (bb.last_player_won() || bb.is_full()) {
+		return 0;
+	}
+	uint64_t key = 0;
+	if (table != NULL && depth >= TABLE_MIN_DEPTH) {
+		// key() fits in COLS * BB_HEIGHT = 49 bits, which leaves room for the depth
+		key = (bb.key() << 6) | depth;
+		auto it = table->find(key);
+		if (it != table->end()) {
+			return it->second;
+		}
+	}
+	long long nodes = 0;
+	for (int col = 0; col < COLS; col++) {
+		if (bb.can_play(col)) {
+			ConnectFourBitboard child = bb;
+			child.play(col);
+			nodes += perft(child, depth - 1, table);
+		}
+	}
+	if (key != 0) {
+		table->insert(make_pair(key, nodes));
+	}
+	return nodes;
+}
+
+// Helpers that let parallel_perft treat both boards alike
+bool finished(Position* pos) {
+	return pos->is_terminal();
+}
+
+bool finished(const ConnectFourBitboard& bb) {
+	return bb.last_player_won() || bb.is_full();
+}
+
+vector<Position*> children(Position* pos) {
+	vector<Position*> result;
+	for (Move* move: pos->possible_moves()) {
+		result.push_back(pos->make_move(move));
+		delete move;
+	}
+	return result;
+}
+
+vector<ConnectFourBitboard> children(const ConnectFourBitboard& bb) {
+	vector<ConnectFourBitboard> result;
+	for (int col = 0; col < COLS; col++) {
+		if (bb.can_play(col)) {
+			result.push_back(bb);
+			result.back().play(col);
+		}
+	}
+	return result;
+}
+
+void release(Position* pos) {
+	delete pos;
+}
+
+void release(const ConnectFourBitboard&) {}
+
+// Positions split moves below board, which the caller releases
+template <class Board>
+void collect_frontier(const Board& board, int split, vector<Board>* frontier) {
+	if (split == 0) {
+		frontier->push_back(board);
+		return;
+	}
+	if (finished(board)) {
+		return;
+	}
+	for (Board& child: children(board)) {
+		collect_frontier(child, split - 1, frontier);
+		if (split > 1) {
+			release(child);
+		}
+	}
+}
+
+// perft of board, with the subtrees split moves down shared out among threads
+template <class Board, class Table>
+long long parallel_perft(const Board& board, int depth, int split, bool use_table, int threads) {
+	split = min(split, depth - 1);
+	if (split <= 0) {
+		Table table;
+		return perft(board, depth, use_table ? &table : NULL);
+	}
+	vector<Board> frontier;
+	collect_frontier(board, split, &frontier);
+	long long nodes = 0;
+	#pragma omp parallel num_threads(threads) reduction(+:nodes)
+	{
+		Table table;
+		#pragma omp for schedule(dynamic)
+		for (int i = 0; i < frontier.size(); i++) {
+			nodes += perft(frontier[i], depth - split, use_table ? &table : NULL);
+			release(frontier[i]);
+		}
+	}
+	return nodes;
+}
+
+vector<string> split_list(const string& list) {
+	vector<string> items;
+	size_t pos = 0;
+	while (pos <= list.size()) {
+		size_t comma = list.find(',', pos);
+		if (comma == string::npos) {
+			comma = list.size();
+		}
+		if (comma > pos) {
+			items.push_back(list.substr(pos, comma - pos));
+		}
+		pos = comma + 1;
+	}
+	return items;
+}
+
+void usage() {
+	cout << "Usage: ./perft [Options]" << endl;
+	cout << "\t--positions=<list>   positions as columns played (1-7), start for the empty board (default start)" << endl;
+	cout << "\t--depth=<n>          count every depth up to n (default 8)" << endl;
+	cout << "\t--boards=<list>      vector (the Position interface) and/or bitboard (default vector,bitboard)" << endl;
+	cout << "\t--threads=<n>        threads (default all)" << endl;
+	cout << "\t--split=<n>          depth of the subtrees shared out among threads (default 2)" << endl;
+	cout << "\t--table=<bool>       reuse counts of transpositions (default false)" << endl;
+	exit(-1);
+}
+
+int main(int argc, char* argv[]) {
+	vector<string> positions = {"start"};
+	vector<string> boards = {"vector", "bitboard"};
+	int depth = 8;
+	int threads = omp_get_max_threads();
+	int split = 2;
+	bool use_table = false;
+	for (int i = 1; i < argc; i++) {
+		const char* eq = strchr(argv[i], '=');
+		if (strncmp(argv[i], "--", 2) || eq == NULL) {
+			usage();
+		}
+		string name(argv[i] + 2, eq - argv[i] - 2);
+		string value(eq + 1);
+		if (name == "positions") {
+			positions = split_list(value);
+		} else if (name == "depth") {
+			depth = atoi(value.c_str());
+		} else if (name == "boards") {
+			boards = split_list(value);
+			for (string& b: boards) {
+				if (b != "vector" && b != "bitboard") {
+					usage();
+				}
+			}
+		} else if (name == "threads") {
+			threads = atoi(value.c_str());
+		} else if (name == "split") {
+			split = atoi(value.c_str());
+		} else if (name == "table") {
+			use_table = value == "true" || value == "1";
+		} else {
+			usage();
+		}
+	}
+	if (positions.empty() || boards.empty() || depth <= 0 || threads <= 0 || split < 0) {
+		usage();
+	}
+
+	ConnectFourGame game;
+	bool failed = false;
+	printf("%-16s %-9s %6s %14s %10s %14s  %s\n", "position", "board", "depth", "nodes", "seconds", "nodes/s", "check");
+	for (string& moves: positions) {
+		Position* pos = moves == "start" ? game.new_game() : game.from_moves(moves);
+		if (pos == NULL) {
+			cout << "Illegal moves in position " << moves << endl;
+			exit(-1);
+		}
+		ConnectFourBitboard bb = ConnectFourBitboard::from_vec(pos->get_vec());
+		for (int d = 1; d <= depth; d++) {
+			// Counts of the boards must agree with each other, and with the known ones
+			long long first = -1;
+			for (string& board: boards) {
+				double start, end, cpu;
+				timing(&start, &cpu);
+				long long nodes = board == "vector"
+					? parallel_perft<Position*, vec_table_t>(pos, d, split, use_table, threads)
+					: parallel_perft<ConnectFourBitboard, bitboard_table_t>(bb, d, split, use_table, threads);
+				timing(&end, &cpu);
+				const char* check = "";
+				if (moves == "start" && d <= KNOWN_DEPTH) {
+					check = nodes == EMPTY_BOARD_COUNTS[d] ? "ok" : "WRONG";
+				} else if (first >= 0) {
+					check = nodes == first ? "agrees" : "DIFFERS";
+				}
+				if (!strcmp(check, "WRONG") || !strcmp(check, "DIFFERS")) {
+					failed = true;
+				}
+				if (first < 0) {
+					first = nodes;
+				}
+				double seconds = end - start;
+				printf("%-16s %-9s %6d %14lld %10.3f %14.0f  %s\n", moves.c_str(), board.c_str(), d, nodes, seconds,
+					seconds > 0 ? nodes / seconds : 0.0, check);
+				fflush(stdout);
+			}
+		}
+		delete pos;
+	}
+	return failed ? 1 : 0;
+}
@@ -0,0 +1,25 @@
+#include "ponder.h"
+
+Ponderer::Ponderer(): stop_flag(false) {}
+
+Ponderer::~Ponderer() {
+	stop();
+}
+
+void Ponderer::start(function<void()> search) {
+	stop();
+	worker = thread(search);
+}
+
+void Ponderer::stop() {
+	if (!worker.joinable()) {
+		return;
+	}
+	stop_flag.store(true);
+	worker.join();
+	stop_flag.store(false);
+}
+
+atomic<bool>* Ponderer::get_stop_flag() {
+	return &stop_flag;
+}
@@ -0,0 +1,28 @@
+#ifndef PONDER_H
+#define PONDER_H
+
+#include <atomic>
+#include <functional>
+#include <thread>
+using namespace std;
+
+// Time limit given to a background search, which runs until it is stopped
+#define PONDER_TIME_LIMIT (1e6)
+
+// Runs an agent's search on a background thread while the opponent thinks
+class Ponderer {
+	private:
+		thread worker;
+		atomic<bool> stop_flag;
+	public:
+		Ponderer();
+		~Ponderer();
+		// Stops any running search and starts a new one
+		void start(function<void()> search);
+		// Asks the search to finish and waits for it
+		void stop();
+		// Set while the search is being stopped, for its SearchControl
+		atomic<bool>* get_stop_flag();
+};
+
+#endif
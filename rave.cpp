@@ -0,0 +1,50 @@
+#include <vector>
+using namespace std;
+
+#include "rave.h"
+
+AmafMoves::AmafMoves(const vector<PlayedMove>& played) {
+	// Added from last to first, so whoever made a move first keeps it
+	for (int i = played.size() - 1; i >= 0; i--) {
+		this->add(played[i].player, played[i].key);
+	}
+}
+
+void AmafMoves::add(int player, int key) {
+	// Games without move keys
+	if (key < 0) {
+		return;
+	}
+	if (key >= first_player.size()) {
+		first_player.resize(key + 1, -1);
+	}
+	first_player[key] = player;
+}
+
+void AmafMoves::mirror(Position* parent) {
+	vector<int> mirrored;
+	for (int key = 0; key < first_player.size(); key++) {
+		if (first_player[key] < 0) {
+			continue;
+		}
+		int mirror_key = parent->mirror_key(key);
+		if (mirror_key >= mirrored.size()) {
+			mirrored.resize(mirror_key + 1, -1);
+		}
+		mirrored[mirror_key] = first_player[key];
+	}
+	first_player.swap(mirrored);
+}
+
+bool AmafMoves::credits(const AmafEdge& edge, int player) const {
+	return edge.key >= 0 && edge.key < first_player.size() && first_player[edge.key] == player;
+}
+
+void AmafMoves::update(vector<AmafEdge>& amaf, int player, float reward) const {
+	for (AmafEdge& edge: amaf) {
+		if (this->credits(edge, player)) {
+			edge.reward += reward;
+			edge.visits++;
+		}
+	}
+}
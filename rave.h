@@ -0,0 +1,54 @@
+#ifndef RAVE_H
+#define RAVE_H
+
+#include <cmath>
+#include <vector>
+using namespace std;
+
+#include "game.h"
+
+// All-moves-as-first statistics of an edge, kept next to the edge's own statistics:
+// payoffs (for player 0) of the simulations through the parent in which the player
+// to move there made the edge's move at any point, not just as the first move
+struct AmafEdge {
+	// Position::move_key of the edge's move in the parent
+	int key;
+	// The child is stored as the mirror image of the position the move reaches
+	bool mirrored;
+	float reward;
+	int visits;
+	AmafEdge(int key, bool mirrored): key(key), mirrored(mirrored), reward(0), visits(0) {}
+};
+
+// Which player first made each move of one simulation, seen from a node on its path
+// Back propagation walks the path from the bottom up, adding the move made at each node
+class AmafMoves {
+	private:
+		// Player who first made the move with each key, -1 if nobody did
+		vector<int> first_player;
+	public:
+		// played holds the moves made by the evaluator after the last node of the path
+		AmafMoves(const vector<PlayedMove>& played);
+		// Add a move made before all the others
+		void add(int player, int key);
+		// Express the moves in the frame of a parent whose edge leads to a mirrored child
+		void mirror(Position* parent);
+		// True if player made the edge's move, so the edge is credited
+		bool credits(const AmafEdge& edge, int player) const;
+		// Credit reward to the edges whose move player made
+		void update(vector<AmafEdge>& amaf, int player, float reward) const;
+};
+
+// Blends the value of an edge's child with the edge's AMAF value
+// The AMAF value is gathered much faster but biased, so its weight
+// sqrt(equivalence / (3 * edge_visits + equivalence)) shrinks as the edge is visited;
+// both count the same once the edge has equivalence visits
+inline float rave_value(float value, int edge_visits, const AmafEdge& amaf, float equivalence) {
+	if (equivalence <= 0 || amaf.visits == 0) {
+		return value;
+	}
+	float beta = sqrt(equivalence / (3 * edge_visits + equivalence));
+	return (1 - beta) * value + beta * amaf.reward / amaf.visits;
+}
+
+#endif
@@ -0,0 +1,216 @@
+#include <stdlib.h>
+
+#include <vector>
+using namespace std;
+
+#include "rollout_policy.h"
+
+float RandomRolloutPolicy::rollout(Position* pos, unsigned int* seed) {
+	return this->rollout_moves(pos, seed, NULL);
+}
+
+// played may be NULL
+float RandomRolloutPolicy::rollout_moves(Position* pos, unsigned int* seed, vector<PlayedMove>* played) {
+	Position* curr_pos = pos;
+	while (!curr_pos->is_terminal()) {
+		vector<Move*> poss_moves = curr_pos->possible_moves();
+		Move* next_move = poss_moves[rand_r(seed) % poss_moves.size()];
+		if (played != NULL) {
+			played->push_back(PlayedMove(curr_pos->whose_turn(), curr_pos->move_key(next_move)));
+		}
+		Position* next_pos = curr_pos->make_move(next_move);
+		// Positions and moves made during rollout are not part of the tree
+		for (Move* move: poss_moves) {
+			delete move;
+		}
+		if (curr_pos != pos) {
+			delete curr_pos;
+		}
+		curr_pos = next_pos;
+	}
+	// Now at terminal state
+	float reward = curr_pos->payoff();
+	if (curr_pos != pos) {
+		delete curr_pos;
+	}
+	return reward;
+}
+
+static const char* ROLLOUT_POLICY_NAMES[] = {"random", "bitboard", "tactical"};
+
+bool parse_rollout_policy(const string& name, RolloutPolicyKind* kind) {
+	for (int i = 0; i < sizeof(ROLLOUT_POLICY_NAMES) / sizeof(ROLLOUT_POLICY_NAMES[0]); i++) {
+		if (name == ROLLOUT_POLICY_NAMES[i]) {
+			*kind = (RolloutPolicyKind) i;
+			return true;
+		}
+	}
+	return false;
+}
+
+RolloutPolicy* new_rollout_policy(RolloutPolicyKind kind, int max_depth) {
+	if (kind == ROLLOUT_RANDOM) {
+		return new RandomRolloutPolicy();
+	}
+	return new ConnectFourRolloutPolicy(kind == ROLLOUT_TACTICAL, max_depth);
+}
+
+ConnectFourRolloutPolicy::ConnectFourRolloutPolicy(bool tactics, int max_depth):
+	tactics(tactics), max_depth(max_depth) {}
+
+// Payoff for player 0 when the given player wins
+static float win_for(int player) {
+	return player == 0 ? 1 : 0;
+}
+
+// Appends the move filling a bitboard slot to played (if not NULL)
+// with the same key as ConnectFourPosition::move_key
+static void record_move(vector<PlayedMove>* played, int player, int slot) {
+	if (played != NULL) {
+		played->push_back(PlayedMove(player, slot / BB_HEIGHT * ROWS + slot % BB_HEIGHT));
+	}
+}
+
+float ConnectFourRolloutPolicy::rollout(Position* pos, unsigned int* seed) {
+	return this->rollout_moves(pos, seed, NULL);
+}
+
+// played may be NULL
+float ConnectFourRolloutPolicy::rollout_moves(Position* pos, unsigned int* seed, vector<PlayedMove>* played) {
+	ConnectFourPosition* cf_pos = dynamic_cast<ConnectFourPosition*>(pos);
+	if (cf_pos == NULL) {
+		return fallback.rollout_moves(pos, seed, played);
+	}
+	ConnectFourBitboard bb = ConnectFourBitboard::from_vec(cf_pos->get_vec());
+	if (bb.last_player_won()) {
+		return win_for(1 - bb.whose_turn());
+	}
+
+	int depth = 0;
+	while (!bb.is_full()) {
+		uint64_t moves = bb.possible();
+		if (tactics) {
+			// Take an immediate win
+			uint64_t wins = bb.current_winning_slots() & moves;
+			if (wins) {
+				record_move(played, bb.whose_turn(), __builtin_ctzll(wins));
+				return win_for(bb.whose_turn());
+			}
+			// Block an immediate loss, two of them cannot both be blocked
+			uint64_t threats = bb.opponent_winning_slots();
+			uint64_t forced = threats & moves;
+			if (forced) {
+				if (forced & (forced - 1)) {
+					return win_for(1 - bb.whose_turn());
+				}
+				moves = forced;
+			}
+			// Do not play right below a slot the opponent wins with
+			uint64_t safe = moves & ~(threats >> 1);
+			if (safe) {
+				moves = safe;
+			}
+		}
+		if (max_depth > 0 && depth >= max_depth) {
+			return static_eval(bb);
+		}
+
+		// Pick a random move among the candidates
+		int k = rand_r(seed) % __builtin_popcountll(moves);
+		for (int i = 0; i < k; i++) {
+			moves &= moves - 1;
+		}
+		int slot = __builtin_ctzll(moves);
+		record_move(played, bb.whose_turn(), slot);
+		bb.play(slot / BB_HEIGHT);
+		depth++;
+		// With tactics on, a winning move would have been found above
+		if (!tactics && bb.last_player_won()) {
+			return win_for(1 - bb.whose_turn());
+		}
+	}
+	// Board full so tie
+	return 0.5;
+}
+
+// Favors having more open threats and more chips in the center column
+float ConnectFourRolloutPolicy::static_eval(const ConnectFourBitboard& bb) {
+	uint64_t player0 = bb.whose_turn() == 0 ? bb.current : bb.mask ^ bb.current;
+	uint64_t player1 = bb.mask ^ player0;
+	int threats = __builtin_popcountll(ConnectFourBitboard::winning_slots(player0, bb.mask))
+		- __builtin_popcountll(ConnectFourBitboard::winning_slots(player1, bb.mask));
+	uint64_t center = ConnectFourBitboard::column_mask(COLS / 2);
+	int center_chips = __builtin_popcountll(player0 & center) - __builtin_popcountll(player1 & center);
+	float value = 0.5 + 0.1 * threats + 0.02 * center_chips;
+	if (value < 0.1) {
+		return 0.1;
+	}
+	if (value > 0.9) {
+		return 0.9;
+	}
+	return value;
+}
+
+float HexRolloutPolicy::rollout(Position* pos, unsigned int* seed) {
+	return this->rollout_moves(pos, seed, NULL);
+}
+
+// played may be NULL
+float HexRolloutPolicy::rollout_moves(Position* pos, unsigned int* seed, vector<PlayedMove>* played) {
+	HexPosition* hex_pos = dynamic_cast<HexPosition*>(pos);
+	if (hex_pos == NULL) {
+		return fallback.rollout_moves(pos, seed, played);
+	}
+	if (hex_pos->is_terminal()) {
+		return hex_pos->payoff();
+	}
+	uint8_t cells[HEX_CELLS];
+	int empty[HEX_CELLS];
+	int n = 0;
+	for (int cell = 0; cell < HEX_CELLS; cell++) {
+		cells[cell] = hex_pos->get_cell(cell);
+		if (cells[cell] == 0) {
+			empty[n++] = cell;
+		}
+	}
+	// Shuffle the empty cells and hand them out in turn
+	int player = hex_pos->whose_turn();
+	for (int i = 0; i < n; i++) {
+		int j = i + rand_r(seed) % (n - i);
+		swap(empty[i], empty[j]);
+		cells[empty[i]] = player + 1;
+		if (played != NULL) {
+			played->push_back(PlayedMove(player, empty[i]));
+		}
+		player = 1 - player;
+	}
+	return win_for(full_board_winner(cells) - 1);
+}
+
+// Player 0 wins if a flood fill from their stones on the top row reaches the bottom row
+int HexRolloutPolicy::full_board_winner(const uint8_t cells[HEX_CELLS]) {
+	bool seen[HEX_CELLS] = {false};
+	int stack[HEX_CELLS];
+	int top = 0;
+	for (int col = 0; col < HEX_SIZE; col++) {
+		if (cells[col] == 1) {
+			seen[col] = true;
+			stack[top++] = col;
+		}
+	}
+	while (top > 0) {
+		int cell = stack[--top];
+		if (cell >= HEX_CELLS - HEX_SIZE) {
+			return 1;
+		}
+		int neighbors[6];
+		int n = hex_neighbors(cell, neighbors);
+		for (int i = 0; i < n; i++) {
+			if (cells[neighbors[i]] == 1 && !seen[neighbors[i]]) {
+				seen[neighbors[i]] = true;
+				stack[top++] = neighbors[i];
+			}
+		}
+	}
+	return 2;
+}
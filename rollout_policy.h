@@ -0,0 +1,82 @@
+#ifndef ROLLOUT_POLICY_H
+#define ROLLOUT_POLICY_H
+
+#include <string>
+#include <vector>
+using namespace std;
+
+#include "game.h"
+#include "connect_four_bitboard.h"
+#include "hex.h"
+
+// Plays a position out (or part of the way) and returns the estimated payoff
+// from the perspective of player 0
+class RolloutPolicy {
+	public:
+		// Must be safe to call from several threads at once
+		virtual float rollout(Position* pos, unsigned int* seed) = 0;
+		// Same, and appends the moves it makes to played for RAVE
+		// Policies that do not override this record nothing
+		virtual float rollout_moves(Position* pos, unsigned int* seed, vector<PlayedMove>* /* played */) {
+			return this->rollout(pos, seed);
+		}
+		virtual ~RolloutPolicy() {}
+};
+
+// Uniformly random moves until a terminal state, works for any game
+class RandomRolloutPolicy: public RolloutPolicy {
+	public:
+		float rollout(Position* pos, unsigned int* seed) override;
+		float rollout_moves(Position* pos, unsigned int* seed, vector<PlayedMove>* played) override;
+};
+
+// Connect Four playouts on a bitboard
+// Optionally takes immediate wins, blocks immediate losses and avoids playing
+// right below an opponent's threat, and optionally stops after max_depth moves
+// and scores the position statically
+// Positions of other games fall back to random rollouts
+class ConnectFourRolloutPolicy: public RolloutPolicy {
+	private:
+		bool tactics;
+		// 0 means play until the game ends
+		int max_depth;
+		RandomRolloutPolicy fallback;
+	public:
+		ConnectFourRolloutPolicy(bool tactics, int max_depth);
+		float rollout(Position* pos, unsigned int* seed) override;
+		float rollout_moves(Position* pos, unsigned int* seed, vector<PlayedMove>* played) override;
+		// Static evaluation of a non-terminal board, used at the depth cutoff
+		static float static_eval(const ConnectFourBitboard& bb);
+};
+
+// Rollout policies that can be picked by name at run time
+enum RolloutPolicyKind {
+	// RandomRolloutPolicy
+	ROLLOUT_RANDOM,
+	// ConnectFourRolloutPolicy without tactics
+	ROLLOUT_BITBOARD,
+	// ConnectFourRolloutPolicy with tactics
+	ROLLOUT_TACTICAL,
+};
+
+// Parses random, bitboard or tactical
+// Returns false if the name is unknown
+bool parse_rollout_policy(const string& name, RolloutPolicyKind* kind);
+// New policy of the given kind, max_depth as in ConnectFourRolloutPolicy
+RolloutPolicy* new_rollout_policy(RolloutPolicyKind kind, int max_depth);
+
+// Hex playouts that fill every empty cell at random, alternating colors, and then
+// find the winner of the full board once, which is equivalent to playing random
+// moves until someone wins since a Hex board has exactly one winner when full
+// Positions of other games fall back to random rollouts
+class HexRolloutPolicy: public RolloutPolicy {
+	private:
+		RandomRolloutPolicy fallback;
+	public:
+		float rollout(Position* pos, unsigned int* seed) override;
+		float rollout_moves(Position* pos, unsigned int* seed, vector<PlayedMove>* played) override;
+		// Winner of a full board of stones (1 for player 0, 2 for player 1)
+		static int full_board_winner(const uint8_t cells[HEX_CELLS]);
+};
+
+#endif
@@ -0,0 +1,36 @@
+#include <thread>
+using namespace std;
+
+#include "round_schedule.h"
+
+RoundSchedule::RoundSchedule(): threads(1), turn(0), finished(false) {}
+
+void RoundSchedule::set_threads(int threads) {
+	this->threads = threads;
+}
+
+void RoundSchedule::wait(long ticket) {
+	while (turn.load(memory_order_acquire) != ticket) {
+		this_thread::yield();
+	}
+}
+
+void RoundSchedule::wait_descend(int thread_num, long round) {
+	this->wait(round * 2 * threads + thread_num);
+}
+
+void RoundSchedule::wait_backup(int thread_num, long round) {
+	this->wait(round * 2 * threads + threads + thread_num);
+}
+
+void RoundSchedule::pass() {
+	turn.fetch_add(1, memory_order_release);
+}
+
+void RoundSchedule::set_finished(bool finished) {
+	this->finished = finished;
+}
+
+bool RoundSchedule::is_finished() {
+	return finished;
+}
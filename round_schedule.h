@@ -0,0 +1,35 @@
+#ifndef ROUND_SCHEDULE_H
+#define ROUND_SCHEDULE_H
+
+#include <atomic>
+using namespace std;
+
+// Makes threads that share a tree take turns in a fixed order, so that a search
+// with a fixed number of iterations builds the same tree on every run
+// Each round, every thread descends in thread order, all threads evaluate
+// their leaves in parallel, then every thread backs up in thread order
+class RoundSchedule {
+	private:
+		int threads;
+		// Number of turns taken so far
+		atomic<long> turn;
+		// Decided by thread 0 at the start of each round
+		bool finished;
+		void wait(long ticket);
+	public:
+		RoundSchedule();
+		// Number of threads taking turns, set once before the first turn
+		void set_threads(int threads);
+		// Block until it is thread_num's turn to descend or to back up in round
+		void wait_descend(int thread_num, long round);
+		void wait_backup(int thread_num, long round);
+		// Hand the turn to the next thread
+		void pass();
+		// Thread 0 decides during its descend turn whether this round ends the search
+		// The other threads read the decision during their descend turns, so all
+		// threads leave after the same round
+		void set_finished(bool finished);
+		bool is_finished();
+};
+
+#endif
@@ -0,0 +1,28 @@
+#!/bin/bash
+
+#SBATCH --reservation=cpsc424
+#SBATCH --cpus-per-task=20
+#SBATCH --nodes=1
+#SBATCH --ntasks=1
+#SBATCH --time=4:00:00
+#SBATCH --mem-per-cpu=4G
+#SBATCH --job-name=mcts_scaling_study
+#SBATCH --output=%x-%j.out
+
+# For OpenMP
+module load intel
+
+# Make study program
+PROGRAM=scaling_study
+make $PROGRAM
+
+AGENTS="leaf,root,tgm,tnm"
+THREADS="1,2,4,10,20"
+TIMES="0.01,0.1"
+GAMES=5
+ITERATIONS=20000
+
+echo "Running Scaling Study for MCTS on Connect Four"
+echo ""
+time "./$PROGRAM" --agents=$AGENTS --threads=$THREADS --times=$TIMES --games=$GAMES --iterations=$ITERATIONS --pin_threads=true --csv=scaling-$SLURM_JOB_ID.csv
+echo "**All done**"
@@ -13,7 +13,7 @@
 module load intel
 # Set up OpenMP
 THREADS=2
-OMP_NUM_THREADS=$THREADS
+export OMP_NUM_THREADS=$THREADS
 
 # Make test program
 PROGRAM=mcts_connect_four
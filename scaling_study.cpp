@@ -0,0 +1,471 @@
+#include <stdio.h>
+#include <string.h>
+
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+using namespace std;
+
+#include "game.h"
+#include "timing.h"
+#include "connect_four.h"
+#include "hex.h"
+#include "rollout_policy.h"
+#include "evaluator.h"
+#include "agent_registry.h"
+#include "perf_counters.h"
+
+// Fixed opening and middle game positions: columns played (1-7) from the empty board
+const char* SCALING_SUITE[] = {
+	"",
+	"4",
+	"44",
+	"4453",
+	"3443",
+	"4536",
+	"12344",
+	"445566",
+	"3345215",
+	"44433352",
+};
+#define SUITE_SIZE ((int) (sizeof(SCALING_SUITE) / sizeof(SCALING_SUITE[0])))
+
+// The same for Hex, where nodes have 100 or more children: cells played from the empty board
+const char* HEX_SCALING_SUITE[] = {
+	"",
+	"f6",
+	"f6e7",
+	"f6e7g5d8",
+	"c3i9f6e7g5",
+	"f6e7g5d8e6f5h4c9",
+	"f6e7g5d8e6f5h4c9g4b10d7i3",
+	"a1k11f6e7g5d8e6f5h4c9g4b10d7i3e5j2",
+};
+#define HEX_SUITE_SIZE ((int) (sizeof(HEX_SCALING_SUITE) / sizeof(HEX_SCALING_SUITE[0])))
+
+// Hardware and software event counts of the searches of one measurement
+struct PhasePerf {
+	PerfCounts total;
+	long iterations;
+	// Per thread id, over all searches
+	vector<pair<int, PerfCounts>> threads;
+	PhasePerf(): iterations(0) {}
+	void add(const PerfCounters& counters, long search_iterations) {
+		total.add(counters.total());
+		iterations += search_iterations;
+		for (const pair<int, PerfCounts>& thread: counters.per_thread()) {
+			int t = 0;
+			while (t < threads.size() && threads[t].first != thread.first) {
+				t++;
+			}
+			if (t == threads.size()) {
+				threads.push_back(make_pair(thread.first, PerfCounts()));
+			}
+			threads[t].second.add(thread.second);
+		}
+	}
+};
+
+// Everything measured for one agent at one thread count and time budget
+struct ScalingRow {
+	string agent;
+	int threads;
+	float time_limit;
+	double ips;
+	// Iterations per second relative to the serial agent, and that divided by threads
+	double speedup;
+	double efficiency;
+	// Match score against the serial agent at equal wall time (-1 if not played)
+	double score;
+	// Seconds for a fixed number of iterations (strong) and for that many per thread (weak)
+	double strong_time;
+	double weak_time;
+	// Counters of the throughput and strong scaling searches
+	PhasePerf throughput_perf;
+	PhasePerf strong_perf;
+};
+
+int suite_size(Game* game) {
+	return dynamic_cast<HexGame*>(game) != NULL ? HEX_SUITE_SIZE : SUITE_SIZE;
+}
+
+Position* suite_position(Game* game, int i) {
+	HexGame* hex = dynamic_cast<HexGame*>(game);
+	if (hex != NULL) {
+		return hex->from_moves(HEX_SCALING_SUITE[i]);
+	}
+	return ((ConnectFourGame*) game)->from_moves(SCALING_SUITE[i]);
+}
+
+// Iterations per second over the suite, each position searched from an empty tree
+// The searches are counted in perf unless it is NULL
+double iterations_per_second(Agent* agent, Game* game, float time_limit, PhasePerf* perf = NULL) {
+	PerfCounters counters;
+	long iterations = 0;
+	double elapsed = 0;
+	for (int i = 0; i < suite_size(game); i++) {
+		Position* pos = suite_position(game, i);
+		double start, end, cpu;
+		if (perf != NULL) {
+			counters.start();
+		}
+		timing(&start, &cpu);
+		pair<Move*, int> res = agent->best_move(pos, time_limit);
+		timing(&end, &cpu);
+		if (perf != NULL) {
+			counters.stop();
+			perf->add(counters, res.second);
+		}
+		iterations += res.second;
+		elapsed += end - start;
+		agent->reset();
+		delete res.first;
+		delete pos;
+	}
+	return elapsed > 0 ? iterations / elapsed : 0;
+}
+
+// Seconds to search every suite position for a fixed number of iterations
+// The searches are counted in perf unless it is NULL
+double time_for_iterations(Agent* agent, Game* game, long iterations, PhasePerf* perf = NULL) {
+	PerfCounters counters;
+	double elapsed = 0;
+	for (int i = 0; i < suite_size(game); i++) {
+		Position* pos = suite_position(game, i);
+		SearchControl control(UNBOUNDED_TIME);
+		control.max_iterations = iterations;
+		double start, end, cpu;
+		if (perf != NULL) {
+			counters.start();
+		}
+		timing(&start, &cpu);
+		pair<Move*, int> res = agent->best_move(pos, control);
+		timing(&end, &cpu);
+		if (perf != NULL) {
+			counters.stop();
+			perf->add(counters, res.second);
+		}
+		elapsed += end - start;
+		agent->reset();
+		delete res.first;
+		delete pos;
+	}
+	return elapsed;
+}
+
+// Average score of agent against opponent, playing the first positions of the suite
+// once with each color
+double play_match(Agent* agent, Agent* opponent, Game* game, int positions, float time_limit) {
+	double score = 0;
+	int games = 0;
+	for (int i = 0; i < positions && i < suite_size(game); i++) {
+		for (int color = 0; color < 2; color++) {
+			// The agents' trees point into the game's positions until they are reset
+			vector<Position*> history;
+			Position* pos = suite_position(game, i);
+			history.push_back(pos);
+			while (!pos->is_terminal()) {
+				Agent* mover = pos->whose_turn() == color ? agent : opponent;
+				pair<Move*, int> res = mover->best_move(pos, time_limit);
+				pos = pos->make_move(res.first);
+				history.push_back(pos);
+				delete res.first;
+			}
+			score += color == 0 ? pos->payoff() : 1 - pos->payoff();
+			games++;
+			agent->reset();
+			opponent->reset();
+			for (Position* p: history) {
+				delete p;
+			}
+		}
+	}
+	return games > 0 ? score / games : 0;
+}
+
+// Splits a comma separated list
+vector<string> split_list(const string& list) {
+	vector<string> items;
+	size_t pos = 0;
+	while (pos <= list.size()) {
+		size_t comma = list.find(',', pos);
+		if (comma == string::npos) {
+			comma = list.size();
+		}
+		if (comma > pos) {
+			items.push_back(list.substr(pos, comma - pos));
+		}
+		pos = comma + 1;
+	}
+	return items;
+}
+
+// Value printed with fmt, or "-" if it is unavailable (negative)
+string format_value(double value, const char* fmt) {
+	char text[32] = "-";
+	if (value >= 0) {
+		snprintf(text, sizeof(text), fmt, value);
+	}
+	return text;
+}
+
+// One line of counters per iteration for a phase, then one per thread if asked
+void print_perf(const string& agent, int threads, float time_limit, const char* phase, const PhasePerf& perf, bool per_thread) {
+	const PerfCounts& c = perf.total;
+	double n = perf.iterations;
+	printf("%-8s %7d %8.3f %-7s %12s %12s %6s %10s %10s %10s\n", agent.c_str(), threads, time_limit, phase,
+		format_value(c.per(PERF_CYCLES, n), "%.0f").c_str(), format_value(c.per(PERF_INSTRUCTIONS, n), "%.0f").c_str(),
+		format_value(c.ipc(), "%.2f").c_str(), format_value(c.per(PERF_LLC_MISSES, n), "%.2f").c_str(),
+		format_value(c.per(PERF_BRANCH_MISSES, n), "%.2f").c_str(), format_value(c.per(PERF_CONTEXT_SWITCHES, n), "%.4f").c_str());
+	if (!per_thread) {
+		return;
+	}
+	// Totals of each thread, to see which threads do the work and which wait
+	for (const pair<int, PerfCounts>& thread: perf.threads) {
+		const PerfCounts& t = thread.second;
+		printf("    tid %-8d %12s cycles %12s instructions %6s IPC %10s LLC misses %8s switches\n", thread.first,
+			format_value(t.counts[PERF_CYCLES], "%.0f").c_str(), format_value(t.counts[PERF_INSTRUCTIONS], "%.0f").c_str(),
+			format_value(t.ipc(), "%.2f").c_str(), format_value(t.counts[PERF_LLC_MISSES], "%.0f").c_str(),
+			format_value(t.counts[PERF_CONTEXT_SWITCHES], "%.0f").c_str());
+	}
+}
+
+// Counters per iteration as CSV fields, empty where unavailable
+void write_perf_csv(FILE* csv, const PhasePerf& perf) {
+	double n = perf.iterations;
+	double values[] = {perf.total.per(PERF_CYCLES, n), perf.total.per(PERF_INSTRUCTIONS, n), perf.total.ipc(),
+		perf.total.per(PERF_LLC_MISSES, n), perf.total.per(PERF_BRANCH_MISSES, n), perf.total.per(PERF_CONTEXT_SWITCHES, n)};
+	for (double value: values) {
+		fprintf(csv, ",%s", value >= 0 ? format_value(value, "%.4f").c_str() : "");
+	}
+}
+
+void usage() {
+	cout << "Usage: ./scaling_study [Options]" << endl;
+	cout << "\t--agents=<list>      agents to study (default leaf,root,tgm,tnm)" << endl;
+	cout << "\t--threads=<list>     thread counts (default 1,2,4,8)" << endl;
+	cout << "\t--times=<list>       time budgets in seconds (default 0.05,0.1)" << endl;
+	cout << "\t--game=<name>        connect_four or hex (default connect_four)" << endl;
+	cout << "\t--games=<n>          suite positions played with each color against serial, 0 to skip (default 2)" << endl;
+	cout << "\t--iterations=<n>     iterations per position for strong and weak scaling, 0 to skip (default 5000)" << endl;
+	cout << "\t--csv=<file>         also write the results as CSV" << endl;
+	cout << "\t--perf=<bool>        read hardware counters around the searches, where the system allows (default false)" << endl;
+	cout << "\t--perf_threads=<bool> also report the counters of each thread (default false)" << endl;
+	cout << "Any other --name=value sets an agent option, as in mcts_connect_four" << endl;
+	exit(-1);
+}
+
+int main(int argc, char* argv[]) {
+	vector<string> agent_names = {"leaf", "root", "tgm", "tnm"};
+	vector<int> thread_counts = {1, 2, 4, 8};
+	vector<float> time_limits = {0.05, 0.1};
+	int games = 2;
+	long iterations = 5000;
+	string csv_path;
+	bool perf = false;
+	bool perf_threads = false;
+	string game_name = "connect_four";
+	MctsConfig base;
+	for (int i = 1; i < argc; i++) {
+		string name, value;
+		if (strncmp(argv[i], "--", 2) || !parse_option(argv[i], &name, &value)) {
+			usage();
+		}
+		if (name == "agents") {
+			agent_names = split_list(value);
+		} else if (name == "threads") {
+			thread_counts.clear();
+			for (string& t: split_list(value)) {
+				thread_counts.push_back(atoi(t.c_str()));
+			}
+		} else if (name == "times") {
+			time_limits.clear();
+			for (string& t: split_list(value)) {
+				time_limits.push_back(atof(t.c_str()));
+			}
+		} else if (name == "game") {
+			game_name = value;
+		} else if (name == "games") {
+			games = atoi(value.c_str());
+		} else if (name == "iterations") {
+			iterations = atol(value.c_str());
+		} else if (name == "csv") {
+			csv_path = value;
+		} else if (name == "perf") {
+			if (!parse_bool(value, &perf)) {
+				usage();
+			}
+		} else if (name == "perf_threads") {
+			if (!parse_bool(value, &perf_threads)) {
+				usage();
+			}
+			perf = perf || perf_threads;
+		} else if (!set_config_option(&base, name, value)) {
+			cout << "Invalid option: " << name << "=" << value << endl;
+			exit(-1);
+		}
+	}
+	if (agent_names.empty() || thread_counts.empty() || time_limits.empty()) {
+		usage();
+	}
+
+	Game* game;
+	// Hex fills the board in one go instead of playing random moves through Position
+	HexRolloutPolicy hex_policy;
+	RolloutEvaluator hex_evaluator(&hex_policy);
+	if (game_name == "connect_four") {
+		game = new ConnectFourGame();
+	} else if (game_name == "hex") {
+		game = new HexGame();
+		base.evaluator = &hex_evaluator;
+	} else {
+		usage();
+	}
+	if (base.rollout_policy != ROLLOUT_RANDOM) {
+		if (game_name != "connect_four") {
+			cout << "Invalid options: rollout_policy is for connect_four" << endl;
+			exit(-1);
+		}
+		base.evaluator = new RolloutEvaluator(new_rollout_policy(base.rollout_policy, base.rollout_depth));
+	}
+	AgentRegistry registry = builtin_agents();
+	for (string& name: agent_names) {
+		string error;
+		if (!registry.check(name, base, &error)) {
+			cout << "Invalid options: " << error << endl;
+			exit(-1);
+		}
+	}
+	Agent* serial = registry.create("serial", base);
+
+	// Serial baseline at every time budget
+	vector<double> serial_ips;
+	vector<PhasePerf> serial_perf(time_limits.size());
+	for (int t = 0; t < time_limits.size(); t++) {
+		serial_ips.push_back(iterations_per_second(serial, game, time_limits[t], perf ? &serial_perf[t] : NULL));
+	}
+
+	vector<ScalingRow> rows;
+	for (string& name: agent_names) {
+		for (int threads: thread_counts) {
+			MctsConfig config = base;
+			config.num_threads = threads;
+			Agent* agent = registry.create(name, config);
+			if (agent == NULL) {
+				cout << "Invalid agent: " << name << endl;
+				exit(-1);
+			}
+			double strong_time = 0;
+			double weak_time = 0;
+			PhasePerf strong_perf;
+			if (iterations > 0) {
+				strong_time = time_for_iterations(agent, game, iterations, perf ? &strong_perf : NULL);
+				weak_time = time_for_iterations(agent, game, iterations * threads / thread_counts[0]);
+			}
+			for (int t = 0; t < time_limits.size(); t++) {
+				ScalingRow row;
+				row.agent = name;
+				row.threads = threads;
+				row.time_limit = time_limits[t];
+				row.ips = iterations_per_second(agent, game, time_limits[t], perf ? &row.throughput_perf : NULL);
+				row.speedup = serial_ips[t] > 0 ? row.ips / serial_ips[t] : 0;
+				row.efficiency = row.speedup / threads;
+				row.score = games > 0 ? play_match(agent, serial, game, games, time_limits[t]) : -1;
+				row.strong_time = strong_time;
+				row.weak_time = weak_time;
+				row.strong_perf = strong_perf;
+				rows.push_back(row);
+				fprintf(stderr, "%s threads=%d time=%g done\n", name.c_str(), threads, time_limits[t]);
+			}
+			delete agent;
+		}
+	}
+
+	printf("Throughput against serial (%d positions)\n", suite_size(game));
+	printf("%-8s %7s %8s %12s %8s %10s %10s\n", "agent", "threads", "time", "iter/s", "speedup", "efficiency", "vs serial");
+	for (int t = 0; t < time_limits.size(); t++) {
+		printf("%-8s %7d %8.3f %12.0f %8.2f %10.2f %10s\n", "serial", 1, time_limits[t], serial_ips[t], 1.0, 1.0, "-");
+	}
+	for (ScalingRow& row: rows) {
+		char score[16] = "-";
+		if (row.score >= 0) {
+			snprintf(score, sizeof(score), "%.2f", row.score);
+		}
+		printf("%-8s %7d %8.3f %12.0f %8.2f %10.2f %10s\n", row.agent.c_str(), row.threads, row.time_limit,
+			row.ips, row.speedup, row.efficiency, score);
+	}
+
+	if (iterations > 0) {
+		printf("\nStrong scaling: %ld iterations per position, weak scaling: %ld per position per %d threads\n",
+			iterations, iterations, thread_counts[0]);
+		printf("%-8s %7s %10s %8s %10s %10s %10s\n", "agent", "threads", "strong s", "speedup", "efficiency", "weak s", "efficiency");
+		// Relative to the agent's first thread count
+		int per_agent = thread_counts.size() * time_limits.size();
+		for (int r = 0; r < rows.size(); r += time_limits.size()) {
+			ScalingRow& row = rows[r];
+			ScalingRow& first = rows[r / per_agent * per_agent];
+			double speedup = row.strong_time > 0 ? first.strong_time / row.strong_time : 0;
+			double scale = (double) row.threads / first.threads;
+			double weak_efficiency = row.weak_time > 0 ? first.weak_time / row.weak_time : 0;
+			printf("%-8s %7d %10.3f %8.2f %10.2f %10.3f %10.2f\n", row.agent.c_str(), row.threads,
+				row.strong_time, speedup, speedup / scale, row.weak_time, weak_efficiency);
+		}
+	}
+
+	if (perf) {
+		printf("\nCounters per iteration (- where the system does not provide them)\n");
+		printf("%-8s %7s %8s %-7s %12s %12s %6s %10s %10s %10s\n", "agent", "threads", "time", "phase",
+			"cycles", "instr", "IPC", "LLC miss", "br miss", "ctx sw");
+		for (int t = 0; t < time_limits.size(); t++) {
+			print_perf("serial", 1, time_limits[t], "search", serial_perf[t], perf_threads);
+		}
+		for (ScalingRow& row: rows) {
+			print_perf(row.agent, row.threads, row.time_limit, "search", row.throughput_perf, perf_threads);
+			if (iterations > 0) {
+				print_perf(row.agent, row.threads, row.time_limit, "strong", row.strong_perf, perf_threads);
+			}
+		}
+	}
+
+	if (!csv_path.empty()) {
+		FILE* csv = fopen(csv_path.c_str(), "w");
+		if (csv == NULL) {
+			cout << "Cannot write " << csv_path << endl;
+			exit(-1);
+		}
+		fprintf(csv, "agent,threads,time_limit,ips,speedup,efficiency,score_vs_serial,strong_time,weak_time");
+		// Counters per iteration of the throughput and strong scaling searches
+		if (perf) {
+			for (const char* phase: {"search", "strong"}) {
+				for (const char* field: {"cycles", "instructions", "ipc", "llc_misses", "branch_misses", "context_switches"}) {
+					fprintf(csv, ",%s_%s", phase, field);
+				}
+			}
+		}
+		fprintf(csv, "\n");
+		for (int t = 0; t < time_limits.size(); t++) {
+			fprintf(csv, "serial,1,%g,%.1f,1,1,,,", time_limits[t], serial_ips[t]);
+			if (perf) {
+				write_perf_csv(csv, serial_perf[t]);
+				fprintf(csv, ",,,,,,");
+			}
+			fprintf(csv, "\n");
+		}
+		for (ScalingRow& row: rows) {
+			fprintf(csv, "%s,%d,%g,%.1f,%.4f,%.4f,", row.agent.c_str(), row.threads, row.time_limit,
+				row.ips, row.speedup, row.efficiency);
+			if (row.score >= 0) {
+				fprintf(csv, "%.4f", row.score);
+			}
+			fprintf(csv, ",%.4f,%.4f", row.strong_time, row.weak_time);
+			if (perf) {
+				write_perf_csv(csv, row.throughput_perf);
+				write_perf_csv(csv, row.strong_perf);
+			}
+			fprintf(csv, "\n");
+		}
+		fclose(csv);
+	}
+	delete serial;
+}
@@ -0,0 +1,63 @@
+#ifndef SEQLOCK_H
+#define SEQLOCK_H
+
+#include <atomic>
+#include <thread>
+using namespace std;
+
+// Version counter that lets readers copy data without taking a lock
+// Writers, which must already exclude each other, make the version odd while
+// they change the data, and readers retry any copy that overlapped a change:
+//
+//	unsigned version;
+//	do {
+//		version = seq.read_begin();
+//		... copy with load_acquire ...
+//	} while (seq.read_retry(version));
+//
+// Data read this way must be written with store_release. Ordering comes from
+// the atomics themselves rather than from fences, which ThreadSanitizer does
+// not model: a copy that sees any store of a write also sees the odd version
+// stored before it, so read_retry catches it
+class SeqLock {
+	private:
+		atomic<unsigned> version;
+	public:
+		SeqLock(): version(0) {}
+		// Waits until no write is in progress and returns the version to check against
+		unsigned read_begin() const {
+			unsigned v = version.load(memory_order_acquire);
+			while (v & 1) {
+				// The writer may be waiting for our CPU
+				this_thread::yield();
+				v = version.load(memory_order_acquire);
+			}
+			return v;
+		}
+		// True if a write overlapped the copy started by read_begin
+		bool read_retry(unsigned start) const {
+			return version.load(memory_order_relaxed) != start;
+		}
+		void write_begin() {
+			version.store(version.load(memory_order_relaxed) + 1, memory_order_relaxed);
+		}
+		void write_end() {
+			version.store(version.load(memory_order_relaxed) + 1, memory_order_release);
+		}
+};
+
+// Reads and writes of plain fields that readers copy while a writer may change them
+// On x86 both are plain moves
+template <class T>
+inline T load_acquire(const T& field) {
+	T value;
+	__atomic_load(&field, &value, __ATOMIC_ACQUIRE);
+	return value;
+}
+
+template <class T>
+inline void store_release(T& field, T value) {
+	__atomic_store(&field, &value, __ATOMIC_RELEASE);
+}
+
+#endif
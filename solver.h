@@ -0,0 +1,23 @@
+#ifndef SOLVER_H
+#define SOLVER_H
+
+#include "game.h"
+
+// Exact solver for positions close to the end of the game
+class Solver {
+	public:
+		// Solves pos if it has at most max_empty empty slots (or moves left)
+		// On success sets payoff (perspective of player 0) and, if best is not NULL,
+		// a move achieving it; returns false if the position is too deep
+		// Must be safe to call from several threads at once
+		virtual bool solve(Position* pos, int max_empty, float* payoff, Move** best) = 0;
+		// Same, but also returns false once control would stop a search started at
+		// wall clock time start (see timing.h), so the caller can search instead
+		// Solvers that cannot be interrupted run to the end
+		virtual bool solve(Position* pos, int max_empty, float* payoff, Move** best, const SearchControl& /* control */, double /* start */) {
+			return this->solve(pos, max_empty, payoff, best);
+		}
+		virtual ~Solver() {}
+};
+
+#endif
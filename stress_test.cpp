@@ -0,0 +1,494 @@
+#include <omp.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+using namespace std;
+
+#include "game.h"
+#include "timing.h"
+#include "connect_four.h"
+#include "hex.h"
+#include "connect_four_solver.h"
+#include "connect_four_prior.h"
+#include "rollout_policy.h"
+#include "evaluator.h"
+#include "time_manager.h"
+#include "agent_registry.h"
+#include "tree_check.h"
+#include "mcts_serial.h"
+#include "mcts_leaf_parallel.h"
+#include "mcts_tgm_parallel.h"
+#include "mcts_tnm_parallel.h"
+
+// Openings, middle games and endgames: columns played (1-7) from the empty board
+const char* STRESS_SUITE[] = {
+	"",
+	"44",
+	"3443",
+	"445566",
+	"44433352",
+	"517331313527737654",
+	"12545613563544317314453",
+};
+#define SUITE_SIZE ((int) (sizeof(STRESS_SUITE) / sizeof(STRESS_SUITE[0])))
+
+// Hex positions, whose nodes have 100 or more children: cells played from the empty board
+const char* HEX_STRESS_SUITE[] = {
+	"",
+	"f6e7",
+	"f6e7g5d8e6f5h4c9",
+};
+#define HEX_SUITE_SIZE ((int) (sizeof(HEX_STRESS_SUITE) / sizeof(HEX_STRESS_SUITE[0])))
+
+#define TIME_LIMIT (0.02)
+#define ITERATION_CAP (500)
+// Solved nodes are checked on this many times the usual threads, in suite
+// positions with at most this many empty slots
+#define SOLVED_THREAD_FACTOR (4)
+#define SOLVED_MAX_EMPTY (24)
+// Node cap of the capped games, and their moves
+#define NODE_CAP (300)
+#define NODE_CAP_MOVES (6)
+
+ConnectFourGame game;
+ConnectFourSolver solver;
+ConnectFourPrior prior;
+HexGame hex_game;
+HexRolloutPolicy hex_policy;
+RolloutEvaluator hex_evaluator(&hex_policy);
+int failures = 0;
+
+// Checks the tree of the agents that keep one, other agents pass
+bool check_agent_tree(const string& name, Agent* agent, Position* pos, long iterations, string* error) {
+	if (name == "serial") {
+		return check_tree<MctsNodeSerial>(*((MctsAgentSerial*) agent)->get_pos_map(), pos, iterations, error);
+	} else if (name == "leaf") {
+		return check_tree<MctsNodeLeafParallel>(*((MctsAgentLeafParallel*) agent)->get_pos_map(), pos, iterations, error);
+	} else if (name == "tgm") {
+		return check_tree<MctsNodeTgmParallel>(*((MctsAgentTgmParallel*) agent)->get_pos_map(), pos, iterations, error);
+	} else if (name == "tnm" || name == "tnm_seq") {
+		return check_tree<MctsNodeTnmParallel>(*((MctsAgentTnmParallel*) agent)->get_pos_map(), pos, iterations, error);
+	}
+	return true;
+}
+
+// True if the agent's tree has solved pos, agents without a kept tree never have
+bool root_proven(const string& name, Agent* agent, Position* pos) {
+	vector<int> key = pos->get_canonical_vec();
+	if (name == "serial") {
+		auto* pos_map = ((MctsAgentSerial*) agent)->get_pos_map();
+		return pos_map->count(key) && pos_map->at(key)->is_proven();
+	} else if (name == "leaf") {
+		auto* pos_map = ((MctsAgentLeafParallel*) agent)->get_pos_map();
+		return pos_map->count(key) && pos_map->at(key)->is_proven();
+	} else if (name == "tgm") {
+		auto* pos_map = ((MctsAgentTgmParallel*) agent)->get_pos_map();
+		return pos_map->count(key) && pos_map->at(key)->is_proven();
+	} else if (name == "tnm" || name == "tnm_seq") {
+		auto* pos_map = ((MctsAgentTnmParallel*) agent)->get_pos_map();
+		return pos_map->count(key) && pos_map->at(key)->is_proven();
+	}
+	return false;
+}
+
+// Visits of the root's children, in the order they were added
+vector<int> root_visits(const string& name, Agent* agent, Position* pos) {
+	vector<int> visits;
+	if (name == "tgm") {
+		MctsNodeTgmParallel* node = ((MctsAgentTgmParallel*) agent)->get_pos_map()->at(pos->get_canonical_vec());
+		for (auto& child: node->children) {
+			visits.push_back(child.second.second);
+		}
+	} else if (name == "tnm" || name == "tnm_seq") {
+		MctsNodeTnmParallel* node = ((MctsAgentTnmParallel*) agent)->get_pos_map()->at(pos->get_canonical_vec());
+		for (auto& child: node->children) {
+			visits.push_back(child.second.second);
+		}
+	}
+	return visits;
+}
+
+bool is_legal(Position* pos, Move* move) {
+	bool legal = false;
+	for (Move* m: pos->possible_moves()) {
+		legal = legal || m->to_string() == move->to_string();
+		delete m;
+	}
+	return legal;
+}
+
+void report(const string& test, const string& name, bool passed, const string& error) {
+	if (passed) {
+		printf("PASS %-14s %s\n", test.c_str(), name.c_str());
+	} else {
+		printf("FAIL %-14s %s: %s\n", test.c_str(), name.c_str(), error.c_str());
+		failures++;
+	}
+	fflush(stdout);
+}
+
+// Searches every suite position with a fresh tree and checks the tree afterwards
+// Searches that are bounded by cap must not run more than slack extra iterations
+// With hex set, the positions are those of the Hex suite
+void search_suite(const string& test, const string& name, MctsConfig config, long cap, long slack, bool hex = false) {
+	AgentRegistry registry = builtin_agents();
+	Agent* agent = registry.create(name, config);
+	string error;
+	bool passed = true;
+	const char** suite = hex ? HEX_STRESS_SUITE : STRESS_SUITE;
+	int suite_size = hex ? HEX_SUITE_SIZE : SUITE_SIZE;
+	for (int i = 0; i < suite_size && passed; i++) {
+		Position* pos = hex ? hex_game.from_moves(suite[i]) : game.from_moves(suite[i]);
+		SearchControl control = config.search_control(TIME_LIMIT);
+		if (cap > 0) {
+			control.max_iterations = cap;
+		}
+		pair<Move*, int> res = agent->best_move(pos, control);
+		if (!is_legal(pos, res.first)) {
+			error = string("illegal move at ") + suite[i];
+			passed = false;
+		} else if (cap > 0 && res.second > cap + slack) {
+			error = to_string(res.second) + " iterations with a cap of " + to_string(cap);
+			passed = false;
+		} else if (!check_agent_tree(name, agent, pos, res.second, &error)) {
+			error += string(" at ") + suite[i];
+			passed = false;
+		}
+		delete res.first;
+		agent->reset();
+		delete pos;
+	}
+	delete agent;
+	report(test, name, passed, error);
+}
+
+// Two runs of a deterministic search must build the same tree
+void check_deterministic(const string& name, MctsConfig config) {
+	config.deterministic = true;
+	config.max_iterations = 2000;
+	AgentRegistry registry = builtin_agents();
+	string error;
+	bool passed = true;
+	for (int i = 0; i < SUITE_SIZE && passed; i++) {
+		Position* pos = game.from_moves(STRESS_SUITE[i]);
+		string moves[2];
+		int iterations[2];
+		vector<int> visits[2];
+		for (int run = 0; run < 2; run++) {
+			Agent* agent = registry.create(name, config);
+			pair<Move*, int> res = agent->best_move(pos, TIME_LIMIT);
+			moves[run] = res.first->to_string();
+			iterations[run] = res.second;
+			visits[run] = root_visits(name, agent, pos);
+			delete res.first;
+			delete agent;
+		}
+		if (moves[0] != moves[1] || iterations[0] != iterations[1] || visits[0] != visits[1]) {
+			error = string("runs differ at ") + STRESS_SUITE[i];
+			passed = false;
+		}
+		delete pos;
+	}
+	report("deterministic", name, passed, error);
+}
+
+// A stop request from another thread must end a long search quickly
+void check_stop_flag(const string& name, MctsConfig config) {
+	AgentRegistry registry = builtin_agents();
+	Agent* agent = registry.create(name, config);
+	Position* pos = game.from_moves("44");
+	atomic<bool> stop(false);
+	SearchControl control(10);
+	control.stop = &stop;
+	thread stopper([&stop]() {
+		this_thread::sleep_for(chrono::milliseconds(20));
+		stop = true;
+	});
+	double start, end, cpu;
+	timing(&start, &cpu);
+	pair<Move*, int> res = agent->best_move(pos, control);
+	timing(&end, &cpu);
+	stopper.join();
+	string error;
+	bool passed = is_legal(pos, res.first) && end - start < 1;
+	if (!passed) {
+		error = "search took " + to_string(end - start) + " s after being stopped";
+	}
+	delete res.first;
+	delete agent;
+	delete pos;
+	report("stop flag", name, passed, error);
+}
+
+// A root too deep to solve within the time limit must be searched instead
+void check_solver_clock(const string& name, MctsConfig config) {
+	config.solver = &solver;
+	config.solver_root_empty = ROWS * COLS;
+	AgentRegistry registry = builtin_agents();
+	Agent* agent = registry.create(name, config);
+	Position* pos = game.from_moves("44");
+	double start, end, cpu;
+	timing(&start, &cpu);
+	pair<Move*, int> res = agent->best_move(pos, TIME_LIMIT);
+	timing(&end, &cpu);
+	string error;
+	bool passed = is_legal(pos, res.first) && end - start < 1;
+	if (!passed) {
+		error = "solving the root took " + to_string(end - start) + " s";
+	}
+	delete res.first;
+	delete agent;
+	delete pos;
+	report("solver clock", name, passed, error);
+}
+
+// Searches the endgames of the suite with the solver on many threads, then checks
+// every node the tnm tree marked as solved against the exact solver
+void check_solved_nodes(const string& name, MctsConfig config) {
+	config.num_threads *= SOLVED_THREAD_FACTOR;
+	config.solver = &solver;
+	config.solver_root_empty = 0;
+	config.solver_leaf_empty = 12;
+	AgentRegistry registry = builtin_agents();
+	Agent* agent = registry.create(name, config);
+	string error;
+	bool passed = true;
+	for (int i = 0; i < SUITE_SIZE && passed; i++) {
+		Position* pos = game.from_moves(STRESS_SUITE[i]);
+		if (ROWS * COLS - (int) strlen(STRESS_SUITE[i]) > SOLVED_MAX_EMPTY) {
+			delete pos;
+			continue;
+		}
+		pair<Move*, int> res = agent->best_move(pos, TIME_LIMIT);
+		delete res.first;
+		for (auto& it: *((MctsAgentTnmParallel*) agent)->get_pos_map()) {
+			MctsNodeTnmParallel* node = it.second;
+			float payoff;
+			if (node->is_proven() && solver.solve(node->pos, ROWS * COLS, &payoff, NULL) && payoff != node->get_proven()) {
+				error = "node solved as " + to_string(node->get_proven()) + " instead of " + to_string(payoff)
+					+ string(" below ") + STRESS_SUITE[i];
+				passed = false;
+				break;
+			}
+		}
+		agent->reset();
+		delete pos;
+	}
+	delete agent;
+	report("solved nodes", name, passed, error);
+}
+
+// Plays moves with a node cap and tree reuse: the nodes kept from earlier moves
+// must not use up the cap of later searches
+// A root the kept tree has already solved needs no iterations
+void check_node_cap(const string& name, MctsConfig config) {
+	config.max_nodes = NODE_CAP;
+	config.tree_reuse = true;
+	AgentRegistry registry = builtin_agents();
+	Agent* agent = registry.create(name, config);
+	string error;
+	bool passed = true;
+	vector<Position*> history;
+	Position* pos = game.new_game();
+	history.push_back(pos);
+	for (int i = 0; i < NODE_CAP_MOVES && passed; i++) {
+		pair<Move*, int> res = agent->best_move(pos, TIME_LIMIT);
+		if (!is_legal(pos, res.first)) {
+			error = "illegal move";
+			passed = false;
+		} else if (res.second <= 0 && !root_proven(name, agent, pos)) {
+			error = "no iterations at move " + to_string(i + 1);
+			passed = false;
+		} else {
+			pos = pos->make_move(res.first);
+			history.push_back(pos);
+		}
+		delete res.first;
+	}
+	agent->reset();
+	for (Position* p: history) {
+		delete p;
+	}
+	delete agent;
+	report("node cap", name, passed, error);
+}
+
+// Plays games where the agent ponders between its moves and reuses its tree
+void check_ponder(const string& name, MctsConfig config) {
+	config.ponder = true;
+	AgentRegistry registry = builtin_agents();
+	Agent* agent = registry.create(name, config);
+	string error;
+	bool passed = true;
+	vector<Position*> history;
+	Position* pos = game.new_game();
+	history.push_back(pos);
+	while (!pos->is_terminal() && passed) {
+		pair<Move*, int> res = agent->best_move(pos, TIME_LIMIT / 4);
+		if (!is_legal(pos, res.first)) {
+			error = "illegal move";
+			passed = false;
+			break;
+		}
+		pos = pos->make_move(res.first);
+		history.push_back(pos);
+		delete res.first;
+		if (!pos->is_terminal()) {
+			agent->start_pondering(pos);
+			this_thread::sleep_for(chrono::milliseconds(2));
+		}
+	}
+	agent->stop_pondering();
+	agent->reset();
+	for (Position* p: history) {
+		delete p;
+	}
+	delete agent;
+	report("ponder", name, passed, error);
+}
+
+// Plays a game where the agent spreads a game clock over the moves of both sides
+// It must not run out of time or play an illegal move
+void check_clock(const string& name, MctsConfig config) {
+	TimeManager clock(0.3, 0, ROWS * COLS);
+	config.listener = &clock;
+	config.report_interval = INFINITY;
+	AgentRegistry registry = builtin_agents();
+	Agent* agent = registry.create(name, config);
+	string error;
+	bool passed = true;
+	vector<Position*> history;
+	Position* pos = game.new_game();
+	history.push_back(pos);
+	while (!pos->is_terminal()) {
+		pair<Move*, int> res = clock.search(agent, pos);
+		if (!is_legal(pos, res.first)) {
+			error = "illegal move";
+			passed = false;
+			break;
+		}
+		pos = pos->make_move(res.first);
+		history.push_back(pos);
+		delete res.first;
+	}
+	if (passed && clock.flagged()) {
+		error = "out of time, " + to_string(clock.total_time_used()) + " s used";
+		passed = false;
+	}
+	agent->reset();
+	for (Position* p: history) {
+		delete p;
+	}
+	delete agent;
+	report("clock", name, passed, error);
+}
+
+int main(int argc, char* argv[]) {
+	int threads = argc > 1 ? atoi(argv[1]) : 8;
+	int rounds = argc > 2 ? atoi(argv[2]) : 1;
+	if (threads <= 0 || rounds <= 0) {
+		cout << "Usage: ./stress_test [Threads] [Rounds]" << endl;
+		exit(-1);
+	}
+	printf("Stress testing with %d threads, %d rounds\n", threads, rounds);
+
+	vector<string> names = {"serial", "leaf", "root", "tgm", "tnm", "tnm_seq"};
+	for (int round = 0; round < rounds; round++) {
+		for (string& name: names) {
+			MctsConfig config;
+			config.num_threads = threads;
+			// Iterations that may finish after a capped search is told to stop
+			long slack = name == "leaf" ? config.rollouts : threads;
+
+			search_suite("plain", name, config, 0, 0);
+			search_suite("capped", name, config, ITERATION_CAP, slack);
+
+			MctsConfig widening = config;
+			widening.widening_constant = 1;
+			search_suite("widening", name, widening, 0, 0);
+
+			if (name != "leaf" && name != "root") {
+				MctsConfig rave = config;
+				rave.rave = true;
+				search_suite("rave", name, rave, 0, 0);
+			}
+
+			MctsConfig puct = config;
+			puct.prior = &prior;
+			puct.first_play_urgency = 0.5;
+			search_suite("puct", name, puct, 0, 0);
+
+			if (name == "tnm" || name == "tnm_seq") {
+				for (NodeLockKind kind: {LOCK_SPIN, LOCK_TICKET, LOCK_FUTEX}) {
+					MctsConfig locked = config;
+					locked.node_lock = kind;
+					search_suite(string(node_lock_name(kind)) + " lock", name, locked, 0, 0);
+				}
+			}
+
+			MctsConfig solved = config;
+			solved.solver = &solver;
+			solved.solver_root_empty = 0;
+			solved.solver_leaf_empty = 12;
+			search_suite("solver", name, solved, 0, 0);
+
+			MctsConfig hex = config;
+			hex.evaluator = &hex_evaluator;
+			search_suite("hex", name, hex, 0, 0, true);
+			search_suite("hex capped", name, hex, ITERATION_CAP, slack, true);
+			if (name != "leaf" && name != "root") {
+				hex.rave = true;
+				search_suite("hex rave", name, hex, 0, 0, true);
+			}
+
+			MctsConfig early = config;
+			early.early_stop = true;
+			early.early_stop_interval = 0.001;
+			search_suite("early stop", name, early, 0, 0);
+
+			if (name == "serial") {
+				MctsConfig interleaved = config;
+				interleaved.interleave = 4;
+				search_suite("interleaved", name, interleaved, 0, 0);
+				search_suite("interleaved cap", name, interleaved, ITERATION_CAP, 0);
+				check_deterministic(name, interleaved);
+			}
+			if (name == "serial" || name == "tgm" || name == "tnm" || name == "tnm_seq") {
+				MctsConfig batched = config;
+				batched.eval_batch = 4;
+				search_suite("batched", name, batched, 0, 0);
+				search_suite("batched cap", name, batched, ITERATION_CAP, slack);
+				batched.rave = true;
+				search_suite("batched rave", name, batched, 0, 0);
+			}
+
+			check_deterministic(name, config);
+			check_stop_flag(name, config);
+			check_solver_clock(name, config);
+			check_node_cap(name, config);
+			if (name == "tnm" || name == "tnm_seq") {
+				check_solved_nodes(name, config);
+			}
+			check_clock(name, config);
+			// The registry rejects ponder for root
+			if (name != "root") {
+				check_ponder(name, config);
+			}
+		}
+	}
+
+	if (failures > 0) {
+		printf("%d checks failed\n", failures);
+		return 1;
+	}
+	printf("All checks passed\n");
+	return 0;
+}
@@ -0,0 +1,109 @@
+#include <algorithm>
+using namespace std;
+
+#include "telemetry.h"
+
+NdjsonListener::NdjsonListener(FILE* out): out(out) {}
+
+void NdjsonListener::on_search_info(const SearchInfo& info) {
+	double ips = info.elapsed > 0 ? info.iterations / info.elapsed : 0;
+	fprintf(out, "{\"elapsed\":%.4f,\"iterations\":%ld,\"ips\":%.0f,\"nodes\":%ld,\"tree_bytes\":%zu",
+		info.elapsed, info.iterations, ips, info.nodes, info.tree_bytes);
+	fprintf(out, ",\"best\":\"%s\",\"pv\":[", info.root.empty() ? "" : info.root[0].move.c_str());
+	for (int i = 0; i < info.pv.size(); i++) {
+		fprintf(out, "%s\"%s\"", i > 0 ? "," : "", info.pv[i].c_str());
+	}
+	fprintf(out, "],\"root\":[");
+	for (int i = 0; i < info.root.size(); i++) {
+		fprintf(out, "%s{\"move\":\"%s\",\"visits\":%d,\"value\":%.4f}", i > 0 ? "," : "",
+			info.root[i].move.c_str(), info.root[i].visits, info.root[i].value);
+	}
+	fprintf(out, "],\"final\":%s}\n", info.final ? "true" : "false");
+	fflush(out);
+}
+
+// Statistics of every child of pos that is in the tree, most visited first
+static vector<pair<RootMoveInfo, Position*>> child_infos(Position* pos, node_lookup_t& lookup) {
+	vector<pair<RootMoveInfo, Position*>> infos;
+	for (Move* move: pos->possible_moves()) {
+		Position* next_pos = pos->make_move(move);
+		RootMoveInfo info;
+		info.move = move->to_string();
+		float reward;
+		if (lookup(next_pos->get_canonical_vec(), &info.visits, &reward) && info.visits > 0) {
+			info.value = reward / info.visits;
+			infos.push_back(make_pair(info, next_pos));
+		} else {
+			delete next_pos;
+		}
+		delete move;
+	}
+	stable_sort(infos.begin(), infos.end(), [](const pair<RootMoveInfo, Position*>& a, const pair<RootMoveInfo, Position*>& b) {
+		return a.first.visits > b.first.visits;
+	});
+	return infos;
+}
+
+void collect_search_info(Position* pos, node_lookup_t lookup, int max_pv, SearchInfo* info) {
+	info->root.clear();
+	info->pv.clear();
+	Position* curr_pos = pos;
+	for (int depth = 0; depth < max_pv && !curr_pos->is_terminal(); depth++) {
+		vector<pair<RootMoveInfo, Position*>> infos = child_infos(curr_pos, lookup);
+		if (depth == 0) {
+			for (auto& child: infos) {
+				info->root.push_back(child.first);
+			}
+		}
+		if (curr_pos != pos) {
+			delete curr_pos;
+		}
+		if (infos.empty()) {
+			return;
+		}
+		info->pv.push_back(infos[0].first.move);
+		curr_pos = infos[0].second;
+		for (int i = 1; i < infos.size(); i++) {
+			delete infos[i].second;
+		}
+	}
+	if (curr_pos != pos) {
+		delete curr_pos;
+	}
+}
+
+size_t estimate_tree_bytes(long nodes, size_t node_bytes, size_t key_len) {
+	// The node, the edge from its parent, its position and map key,
+	// and the hash map's own entry and bucket
+	size_t per_node = node_bytes + 2 * sizeof(void*) + 2 * key_len * sizeof(int) + 4 * sizeof(void*);
+	return nodes * per_node;
+}
+
+SearchReporter::SearchReporter(SearchListener* listener, double interval, int max_pv):
+	listener(listener), interval(interval), max_pv(max_pv), next(interval) {}
+
+bool SearchReporter::enabled() {
+	return listener != NULL;
+}
+
+bool SearchReporter::due(double elapsed) {
+	if (listener == NULL || elapsed < next) {
+		return false;
+	}
+	next = elapsed + interval;
+	return true;
+}
+
+SearchInfo SearchReporter::snapshot(Position* pos, node_lookup_t lookup, long nodes, size_t tree_bytes, long iterations, double elapsed) {
+	SearchInfo info;
+	info.elapsed = elapsed;
+	info.iterations = iterations;
+	info.nodes = nodes;
+	info.tree_bytes = tree_bytes;
+	collect_search_info(pos, lookup, max_pv, &info);
+	return info;
+}
+
+void SearchReporter::report(const SearchInfo& info) {
+	listener->on_search_info(info);
+}
@@ -0,0 +1,85 @@
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <stdio.h>
+
+#include <functional>
+#include <string>
+#include <vector>
+using namespace std;
+
+#include "game.h"
+
+// Statistics of one root move
+struct RootMoveInfo {
+	string move;
+	int visits;
+	// Win ratio for player 0
+	float value;
+};
+
+// Snapshot of a running search
+struct SearchInfo {
+	double elapsed;
+	long iterations;
+	long nodes;
+	// Rough size of the search tree
+	size_t tree_bytes;
+	// Most visited root move first
+	vector<RootMoveInfo> root;
+	// Principal variation: most visited child at each level
+	vector<string> pv;
+	// Set on the last report of a search
+	bool final;
+	SearchInfo(): elapsed(0), iterations(0), nodes(0), tree_bytes(0), final(false) {}
+};
+
+// Receives snapshots while a search runs
+// Called from the master search thread, so it should return quickly
+class SearchListener {
+	public:
+		virtual void on_search_info(const SearchInfo& info) = 0;
+		virtual ~SearchListener() {}
+};
+
+// Writes each snapshot as one line of JSON
+class NdjsonListener: public SearchListener {
+	private:
+		FILE* out;
+	public:
+		NdjsonListener(FILE* out = stdout);
+		void on_search_info(const SearchInfo& info) override;
+};
+
+// Reads visits and total reward of the node with the given key
+// Returns false if the position is not in the tree
+typedef function<bool(const vector<int>& key, int* visits, float* reward)> node_lookup_t;
+
+// Fills in the root moves and the principal variation by following
+// the most visited children from pos
+// Works on real positions so moves are reported in pos's orientation
+void collect_search_info(Position* pos, node_lookup_t lookup, int max_pv, SearchInfo* info);
+
+// Estimated bytes used by a tree of the given number of nodes
+// key_len is the length of a position's vector
+size_t estimate_tree_bytes(long nodes, size_t node_bytes, size_t key_len);
+
+// Takes snapshots of a search at a fixed interval and hands them to a listener
+class SearchReporter {
+	private:
+		SearchListener* listener;
+		double interval;
+		int max_pv;
+		double next;
+	public:
+		SearchReporter(SearchListener* listener, double interval, int max_pv);
+		bool enabled();
+		// True (and schedules the next report) if a listener is set and a report is due
+		bool due(double elapsed);
+		// Reads the tree, callers that share it should hold its locks while this runs
+		SearchInfo snapshot(Position* pos, node_lookup_t lookup, long nodes, size_t tree_bytes, long iterations, double elapsed);
+		// Hands a snapshot to the listener, no locks need to be held
+		void report(const SearchInfo& info);
+};
+
+#endif
@@ -20,7 +20,7 @@ make $PROGRAM
 THREADS=4
 TRIALS=5
 
-OMP_NUM_THREADS=$THREADS
+export OMP_NUM_THREADS=$THREADS
 
 echo "Running Test Script for MCTS on Connect Four"
 echo ""
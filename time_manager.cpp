@@ -0,0 +1,124 @@
+#include <algorithm>
+using namespace std;
+
+#include "time_manager.h"
+#include "timing.h"
+
+TimeManager::TimeManager(double game_time, double increment, int expected_moves, SearchListener* forward):
+	game_time(game_time), increment(increment), expected_moves(expected_moves), forward(forward),
+	remaining(game_time), moves_played(0), time_used(0), has_last(false) {}
+
+void TimeManager::on_search_info(const SearchInfo& info) {
+	if (info.final) {
+		lock_guard<mutex> guard(last_mutex);
+		// Reports from other threads, e.g. a Ponderer, are not this clock's search
+		if (this_thread::get_id() == searcher) {
+			last = info;
+			has_last = true;
+		}
+	}
+	if (forward != NULL) {
+		forward->on_search_info(info);
+	}
+}
+
+double TimeManager::budget() {
+	int moves_to_go = max(expected_moves - moves_played, MIN_MOVES_TO_GO);
+	// Keep back what starting and ending each search costs
+	double usable = max(remaining - moves_to_go * MOVE_OVERHEAD, 0.0);
+	double planned = usable / moves_to_go + INCREMENT_SHARE * increment;
+	return min(planned, this->max_budget());
+}
+
+double TimeManager::max_budget() {
+	return max(remaining - MOVE_OVERHEAD, 0.0) * MAX_CLOCK_SHARE + INCREMENT_SHARE * increment;
+}
+
+bool TimeManager::settled(const SearchInfo& info, const string& previous_best) {
+	if (info.root.empty() || info.root[0].move != previous_best) {
+		return false;
+	}
+	long total = 0;
+	for (const RootMoveInfo& move: info.root) {
+		total += move.visits;
+	}
+	int best = info.root[0].visits;
+	int runner_up = info.root.size() > 1 ? info.root[1].visits : 0;
+	return best >= SETTLED_SHARE * total && runner_up < RUNNER_UP_RATIO * best;
+}
+
+pair<Move*, int> TimeManager::search(Agent* agent, Position* pos) {
+	double planned = this->budget();
+	// Even a flagged clock has to produce a move
+	double limit = max(min(planned * MAX_EXTENSION, this->max_budget()), MIN_MOVE_TIME);
+	double slice = max(planned / BUDGET_SLICES, MIN_MOVE_TIME);
+	Move* move = NULL;
+	string best;
+	int iterations = 0;
+	double start, now, cpu;
+	timing(&start, &cpu);
+	now = start;
+	{
+		lock_guard<mutex> guard(last_mutex);
+		searcher = this_thread::get_id();
+	}
+	while (move == NULL || now - start + MIN_MOVE_TIME <= limit) {
+		{
+			lock_guard<mutex> guard(last_mutex);
+			has_last = false;
+		}
+		pair<Move*, int> res = agent->best_move(pos, max(min(slice, limit - (now - start)), MIN_MOVE_TIME));
+		iterations += res.second;
+		SearchInfo info;
+		bool reported;
+		{
+			lock_guard<mutex> guard(last_mutex);
+			info = last;
+			reported = has_last;
+		}
+		bool stable = move != NULL && reported && this->settled(info, best);
+		delete move;
+		move = res.first;
+		best = reported && !info.root.empty() ? info.root[0].move : move->to_string();
+		timing(&now, &cpu);
+		double elapsed = now - start;
+		// Agents that report nothing get their planned budget, or a single call
+		// if they return without using their slice (e.g. a random agent)
+		if (!reported) {
+			if (elapsed >= planned || elapsed < slice / 2) {
+				break;
+			}
+			continue;
+		}
+		// Settled choices end early, unsettled ones run past their budget
+		if (stable && elapsed >= planned / 2) {
+			break;
+		}
+	}
+	{
+		lock_guard<mutex> guard(last_mutex);
+		searcher = thread::id();
+	}
+	double elapsed = now - start;
+	time_used += elapsed;
+	remaining += increment - elapsed;
+	moves_played++;
+	return make_pair(move, iterations);
+}
+
+void TimeManager::new_game() {
+	remaining = game_time;
+	moves_played = 0;
+}
+
+double TimeManager::time_left() const {
+	return remaining;
+}
+
+double TimeManager::total_time_used() const {
+	return time_used;
+}
+
+bool TimeManager::flagged() const {
+	return remaining < 0;
+}
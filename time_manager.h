@@ -0,0 +1,81 @@
+#ifndef TIME_MANAGER_H
+#define TIME_MANAGER_H
+
+#include <mutex>
+#include <thread>
+#include <utility>
+using namespace std;
+
+#include "game.h"
+#include "telemetry.h"
+
+// Own moves still expected in a game is never taken to be below this
+#define MIN_MOVES_TO_GO (4)
+// Share of the increment spent on the move it comes with
+#define INCREMENT_SHARE (0.9)
+// A move may take at most this many times its planned budget when the search
+// is unsettled, and never more than this share of the clock left
+#define MAX_EXTENSION (3)
+#define MAX_CLOCK_SHARE (0.25)
+// Each budget is searched in this many slices, checking the root between them
+#define BUDGET_SLICES (4)
+// The root is settled once the best move stayed the same over a slice, has at
+// least this share of the root visits, and the runner-up has less than this
+// ratio of its visits
+#define SETTLED_SHARE (0.5)
+#define RUNNER_UP_RATIO (0.8)
+// Shortest search a move is given
+#define MIN_MOVE_TIME (0.001)
+// Seconds kept back for each move beyond its search, e.g. for starting threads
+#define MOVE_OVERHEAD (0.001)
+
+// Splits a game clock, with an optional increment per move, into search budgets
+// for each move of one player. A move is planned an even share of the clock over
+// the moves expected to remain, and is searched in slices: it ends after half its
+// budget when the root has settled on a move, and runs past its budget, up to
+// MAX_EXTENSION times, while the best move keeps changing or is close to the
+// runner-up. Works with any agent: the root is read from the final report of each
+// search, so MCTS agents must have the manager as their listener, and other
+// agents just get their planned budget. Slices are cheap for agents that keep
+// their tree between calls (tree_reuse), which continue where they left off.
+// Only reports from the thread inside search() are used, so an agent sharing the
+// listener with a Ponderer has its pondering reports passed on but not read
+class TimeManager: public SearchListener {
+	private:
+		double game_time;
+		double increment;
+		int expected_moves;
+		// Reports are passed on to this listener (NULL means none)
+		SearchListener* forward;
+		double remaining;
+		int moves_played;
+		double time_used;
+		// Root of the last finished search, guarded by last_mutex
+		SearchInfo last;
+		bool has_last;
+		// Thread inside search(), or no thread outside of it
+		thread::id searcher;
+		mutex last_mutex;
+		// Whether the root in info has settled on best since the previous slice
+		bool settled(const SearchInfo& info, const string& previous_best);
+	public:
+		// expected_moves is a typical number of own moves in a game
+		TimeManager(double game_time, double increment, int expected_moves, SearchListener* forward = NULL);
+		void on_search_info(const SearchInfo& info) override;
+		// Planned seconds for the next move
+		double budget();
+		// Longest the next move may take
+		double max_budget();
+		// Searches pos with agent within the budget and charges the clock
+		// Returns the move and the iterations, as best_move
+		pair<Move*, int> search(Agent* agent, Position* pos);
+		// Full clock for a new game
+		void new_game();
+		double time_left() const;
+		// Seconds spent on moves so far, over all games
+		double total_time_used() const;
+		// True if the clock ran out this game
+		bool flagged() const;
+};
+
+#endif
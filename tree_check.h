@@ -0,0 +1,85 @@
+#ifndef TREE_CHECK_H
+#define TREE_CHECK_H
+
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+using namespace std;
+
+#include "game.h"
+
+// Checks the statistics of a tree grown by a single search of root
+// that ran the given number of iterations:
+// - the root was visited once per iteration
+// - every other node was visited exactly as often as the edges into it were
+//   traversed, and its reward is the sum of theirs
+// - no node passed on more visits to its children than it received
+// - every node is stored under its own position, and has no duplicate children
+// Works with any agent's node and map types, and must not run during a search
+// Returns false with a description of the first violation in error
+template <class Node, class Map>
+bool check_tree(Map& pos_map, Position* root, long iterations, string* error) {
+	auto root_it = pos_map.find(root->get_canonical_vec());
+	if (root_it == pos_map.end()) {
+		*error = "root is not in the tree";
+		return false;
+	}
+	Node* root_node = root_it->second;
+	if (root_node->get_visits() != iterations) {
+		*error = "root has " + to_string(root_node->get_visits()) + " visits after "
+			+ to_string(iterations) + " iterations";
+		return false;
+	}
+
+	// Visits and reward flowing into each node through its parents' edges
+	unordered_map<Node*, pair<double, long>> incoming;
+	for (auto& entry: pos_map) {
+		Node* node = entry.second;
+		if (entry.first != node->pos->get_canonical_vec()) {
+			*error = "node stored under another position";
+			return false;
+		}
+		long edge_visits = 0;
+		unordered_set<Node*> seen;
+		for (auto& child: node->children) {
+			if (!seen.insert(child.first).second) {
+				*error = "duplicate child edge";
+				return false;
+			}
+			auto child_it = pos_map.find(child.first->pos->get_canonical_vec());
+			if (child_it == pos_map.end() || child_it->second != child.first) {
+				*error = "child is missing from the tree";
+				return false;
+			}
+			edge_visits += child.second.second;
+			incoming[child.first].first += child.second.first;
+			incoming[child.first].second += child.second.second;
+		}
+		if (edge_visits > node->get_visits()) {
+			*error = "node with " + to_string(node->get_visits()) + " visits passed "
+				+ to_string(edge_visits) + " to its children";
+			return false;
+		}
+	}
+	for (auto& entry: pos_map) {
+		Node* node = entry.second;
+		if (node == root_node) {
+			continue;
+		}
+		pair<double, long> in = incoming[node];
+		if (in.second != node->get_visits()) {
+			*error = "node has " + to_string(node->get_visits()) + " visits but its edges were traversed "
+				+ to_string(in.second) + " times";
+			return false;
+		}
+		if (in.first != node->get_reward()) {
+			*error = "node has reward " + to_string(node->get_reward()) + " but its edges carried "
+				+ to_string(in.first);
+			return false;
+		}
+	}
+	return true;
+}
+
+#endif
@@ -0,0 +1,81 @@
+// Tells ThreadSanitizer about the synchronization done inside libgomp, which is
+// not instrumented, so that only races in our own code are reported
+// Linked into the tsan build only: each OpenMP entry point we use is wrapped
+// and calls the real one from libgomp
+#include <dlfcn.h>
+#include <omp.h>
+#include <sanitizer/tsan_interface.h>
+
+// Looks up the libgomp function our calls would otherwise have reached
+#define REAL(name, version, ...) \
+	static auto real_##name = (__VA_ARGS__) dlvsym(RTLD_NEXT, #name, version)
+
+// Shared addresses that stand for the synchronization of every critical section and barrier
+static char critical_token;
+static char barrier_token;
+
+// Work handed to the threads of a parallel region
+struct Region {
+	void (*fn)(void*);
+	void* data;
+};
+
+// Every thread of the region sees what the master did before it started the region,
+// and the master sees everything the threads did once the region has ended
+static void run_region(void* arg) {
+	Region* region = (Region*) arg;
+	__tsan_acquire(region);
+	region->fn(region->data);
+	__tsan_release(region);
+}
+
+extern "C" {
+
+void GOMP_parallel(void (*fn)(void*), void* data, unsigned num_threads, unsigned flags) {
+	REAL(GOMP_parallel, "GOMP_4.0", void (*)(void (*)(void*), void*, unsigned, unsigned));
+	Region region = {fn, data};
+	__tsan_release(&region);
+	real_GOMP_parallel(run_region, &region, num_threads, flags);
+	__tsan_acquire(&region);
+}
+
+void GOMP_barrier() {
+	REAL(GOMP_barrier, "GOMP_1.0", void (*)());
+	__tsan_release(&barrier_token);
+	real_GOMP_barrier();
+	__tsan_acquire(&barrier_token);
+}
+
+// Implicit barrier at the end of a worksharing loop
+void GOMP_loop_end() {
+	REAL(GOMP_loop_end, "GOMP_1.0", void (*)());
+	__tsan_release(&barrier_token);
+	real_GOMP_loop_end();
+	__tsan_acquire(&barrier_token);
+}
+
+void GOMP_critical_start() {
+	REAL(GOMP_critical_start, "GOMP_1.0", void (*)());
+	real_GOMP_critical_start();
+	__tsan_acquire(&critical_token);
+}
+
+void GOMP_critical_end() {
+	REAL(GOMP_critical_end, "GOMP_1.0", void (*)());
+	__tsan_release(&critical_token);
+	real_GOMP_critical_end();
+}
+
+void omp_set_lock(omp_lock_t* lock) throw() {
+	REAL(omp_set_lock, "OMP_3.0", void (*)(omp_lock_t*));
+	real_omp_set_lock(lock);
+	__tsan_acquire(lock);
+}
+
+void omp_unset_lock(omp_lock_t* lock) throw() {
+	REAL(omp_unset_lock, "OMP_3.0", void (*)(omp_lock_t*));
+	__tsan_release(lock);
+	real_omp_unset_lock(lock);
+}
+
+}